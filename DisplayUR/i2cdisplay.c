@@ -58,12 +58,17 @@ int main(void)
 
   uint16_t * data_left;
   uint16_t * data_right;
+  uint16_t * timeout;
 
 
   while ( 1 ) {
 
     if ( !gTWI_SlaveStopReceived ) continue;
 
+    // execute each command once, a repeated I2C_DISP_DATA_TIMED would
+    // restart its timer
+    gTWI_SlaveStopReceived = 0;
+
     switch ( gTWI_SlaveRxBuffer[0] ) { // command
 
       case I2C_DISP_OFF:
@@ -102,6 +107,17 @@ int main(void)
       case I2C_DISP_RAWDATA_RIGHT:
            MultiplexSetRRaw( (uint8_t *)&gTWI_SlaveRxBuffer[1] );
            break;
+
+      case I2C_DISP_DATA_TIMED:
+           data_left = (uint16_t *)&gTWI_SlaveRxBuffer[1];
+	   data_right = (uint16_t *)&gTWI_SlaveRxBuffer[3];
+	   timeout = (uint16_t *)&gTWI_SlaveRxBuffer[5];
+           MultiplexSetL( *data_left );
+           if ( *timeout == I2C_DISP_NO_TIMEOUT )
+             MultiplexSetR( *data_right );
+           else
+             MultiplexSetRTimed( *data_right, *timeout );
+           break;
     }
 
   } // while ( 1 ) ...
@@ -87,5 +87,18 @@
 // byte 03 : raw data for digit 05
 // byte 04 : raw data for right most digit, = digit 06
 //
+#define I2C_DISP_DATA_TIMED     0x08
+//
+// byte 02 : data for left digit, lsb
+// byte 03 : data for left digit, msb
+// byte 04 : data for right digit, lsb
+// byte 05 : data for right digit, msb
+// byte 06 : time [ms] until the right digits show "---", lsb
+// byte 07 : time [ms] until the right digits show "---", msb
+//
+// A time of 0 shows "---" at once, I2C_DISP_NO_TIMEOUT keeps the right
+// digits. Any other write to the right digits stops the timer.
+//
+#define I2C_DISP_NO_TIMEOUT     0xffff
 
 #endif // _i2cdisplaydefs_h_
@@ -52,6 +52,12 @@ volatile uint8_t gSegmentData[kNSegments] = { 0 };
 
 volatile unsigned char gMultiplexMode;
 
+// Timer2 overflows until the right digits show "---", 0 = no timer
+static volatile uint16_t gDashCounter = 0;
+
+// Timer2 overflows per second, prescaler 64
+#define kOverflowsPerSec  (F_CPU / 64 / 256)
+
 // --------------------------------------------------------------------------
 
 // Timer2 overflow interrupt
@@ -63,6 +69,9 @@ ISR(TIMER2_OVF_vect)
  {
   PORTD = 0;
 
+  if ( gDashCounter && --gDashCounter == 0 )
+    memset( (void *)&gSegmentData[3], kSegmentDash, 3 );
+
   if ( (gMultiplexMode & kDisplayOn) != kDisplayOn ) return;
 
   PORTB = (1<<gSegmentCounter);
@@ -114,6 +123,8 @@ void MultiplexSetL(uint16_t l_data)
 
 void MultiplexSetR(uint16_t r_data)
  {
+  MultiplexStopTimer();
+
   for ( uint8_t segment=kNSegments/2; segment<kNSegments; segment++) {
 
     switch (segment) {
@@ -133,5 +144,33 @@ void MultiplexSetR(uint16_t r_data)
   } // for ( segment=... )
 }
 
+// --------------------------------------------------------------------------
+
+void MultiplexSetRTimed(uint16_t r_data,uint16_t timeout_ms)
+ {
+  uint16_t counter = (uint32_t)timeout_ms * kOverflowsPerSec / 1000;
+
+  if ( timeout_ms == 0 ) {
+    uint8_t dash[3] = { kSegmentDash, kSegmentDash, kSegmentDash };
+    MultiplexSetRRaw( dash );
+    return;
+  }
+
+  MultiplexSetR( r_data );
+
+  cli();
+   gDashCounter = counter ? counter : 1;
+  sei();
+}
+
+// --------------------------------------------------------------------------
+
+void MultiplexStopTimer(void)
+ {
+  cli();
+   gDashCounter = 0;
+  sei();
+}
+
 // --------------------------------------------------------------------------
 // --------------------------------------------------------------------------
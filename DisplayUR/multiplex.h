@@ -39,6 +39,9 @@ enum {
 extern volatile unsigned char gMultiplexMode;
 extern volatile uint8_t gSegmentData[];
 
+/** Raw data of "---", shown by the right digits after a timeout. */
+#define kSegmentDash  0x08
+
 /** This function initializes and starts the Timer2 which is used for
   * 7-segment multiplexing. */
 extern void MultiplexInit(void);
@@ -57,6 +60,13 @@ extern void MultiplexSetL(uint16_t l_data);
 /** Set the value for the rightmost 3 digits. */
 extern void MultiplexSetR(uint16_t r_data);
 
+/** Set the value for the rightmost 3 digits which are replaced by "---"
+  * after 'timeout_ms', see I2C_DISP_DATA_TIMED. */
+extern void MultiplexSetRTimed(uint16_t r_data,uint16_t timeout_ms);
+
+/** Stop the timer started by MultiplexSetRTimed(). */
+extern void MultiplexStopTimer(void);
+
 /** Set the values for the display */
 static inline void MultiplexSet(uint16_t l_data,uint16_t r_data)
  { MultiplexSetL( l_data ); MultiplexSetR( r_data ); }
@@ -67,7 +77,7 @@ static inline void MultiplexSetLRaw(const uint8_t *l_raw)
 
 /** Write raw values to the rightmost 3 digits. */
 static inline void MultiplexSetRRaw(uint8_t *r_raw)
- { memcpy((void *)&gSegmentData[3], r_raw, 3 ); }
+ { MultiplexStopTimer(); memcpy((void *)&gSegmentData[3], r_raw, 3 ); }
 
 /** Write raw values to the display. */
 
@@ -0,0 +1,147 @@
+
+/*
+ * File   : binframe.c
+ *
+ * Purpose: Compact binary frames (COBS, CRC-16) for the sensor data
+ *
+ * References: S.Cheshire, M.Baker: Consistent Overhead Byte Stuffing,
+ *             IEEE/ACM Transactions on Networking, 1999
+ *
+ */
+
+
+#include <stdint.h>
+
+#ifdef __AVR__
+# include <util/crc16.h>
+#endif
+
+#include "binframe.h"
+
+/** Marks a decoder which waits for the next 0x00 byte. */
+#define BINFRAME_SKIP   0xff
+
+// --------------------------------------------------------------------------
+
+uint16_t BinFrameCRC16(uint16_t crc,uint8_t data) {
+
+#ifdef __AVR__
+  return _crc_xmodem_update( crc, data );
+#else
+  crc ^= (uint16_t)data << 8;
+
+  for ( uint8_t i=0; i<8; ++i )
+    crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+
+  return crc;
+#endif // __AVR__
+}
+
+// --------------------------------------------------------------------------
+
+uint8_t BinFrameEncode(const bin_frame_t *frame,uint8_t *buffer) {
+
+  uint8_t payload[BINFRAME_PAYLOAD];
+  uint8_t n = 0;
+  uint16_t crc = 0xffff;
+
+  payload[n++] = frame->fSequence;
+
+  for ( uint8_t i=0; i<BINFRAME_N_VALUES; ++i ) {
+    payload[n++] = (uint16_t)frame->fValue[i] & 0xff;
+    payload[n++] = (uint16_t)frame->fValue[i] >> 8;
+  }
+
+  for ( uint8_t i=0; i<n; ++i )
+    crc = BinFrameCRC16( crc, payload[i] );
+
+  payload[n++] = crc & 0xff;
+  payload[n++] = crc >> 8;
+
+  // COBS: each 0x00 is replaced by the distance to the next one, the
+  // first byte holds the distance to the first 0x00
+  uint8_t code_pos = 0, length = 1;
+
+  for ( uint8_t i=0; i<n; ++i ) {
+
+    if ( payload[i] == 0 ) {
+      buffer[code_pos] = length - code_pos;
+      code_pos = length++;
+    }
+    else
+      buffer[length++] = payload[i];
+  }
+
+  buffer[code_pos] = length - code_pos;
+  buffer[length++] = 0;
+
+  return length;
+}
+
+// --------------------------------------------------------------------------
+
+void BinFrameInit(bin_decoder_t *decoder) {
+
+  decoder->fLength = 0;
+}
+
+// --------------------------------------------------------------------------
+
+uint8_t BinFrameDecode(bin_decoder_t *decoder,uint8_t data,
+                       bin_frame_t *frame) {
+
+  if ( data != 0 ) {
+
+    if ( decoder->fLength == BINFRAME_SKIP ) return 0;
+
+    if ( decoder->fLength == BINFRAME_SIZE - 1 )   // too long (or ASCII)
+      decoder->fLength = BINFRAME_SKIP;
+    else
+      decoder->fBuffer[decoder->fLength++] = data;
+
+    return 0;
+  }
+
+  // end of frame, all frames have the same length
+
+  uint8_t length = decoder->fLength;
+
+  decoder->fLength = 0;
+
+  if ( length != BINFRAME_SIZE - 1 ) return 0;
+
+  // COBS decoding in place: payload[i] = fBuffer[i+1] except at the
+  // positions given by the chain of distances, these are 0x00
+  uint8_t *payload = decoder->fBuffer;
+  uint8_t next = payload[0];
+
+  for ( uint8_t i=1; i<length; ++i ) {
+
+    if ( i == next ) {
+      next = i + payload[i];
+      payload[i-1] = 0;
+    }
+    else
+      payload[i-1] = payload[i];
+  }
+
+  if ( next != length ) return 0;              // broken chain
+
+  uint16_t crc = 0xffff;
+
+  for ( uint8_t i=0; i<BINFRAME_PAYLOAD-2; ++i )
+    crc = BinFrameCRC16( crc, payload[i] );
+
+  if ( crc != (payload[BINFRAME_PAYLOAD-2]
+               | (uint16_t)payload[BINFRAME_PAYLOAD-1] << 8) ) return 0;
+
+  frame->fSequence = payload[0];
+
+  for ( uint8_t i=0; i<BINFRAME_N_VALUES; ++i )
+    frame->fValue[i] = (int16_t)(payload[1+2*i] | (uint16_t)payload[2+2*i] << 8);
+
+  return 1;
+}
+
+// --------------------------------------------------------------------------
+// --------------------------------------------------------------------------
@@ -0,0 +1,78 @@
+
+/*
+ * File   : binframe.h
+ *
+ * Purpose: Header file for binframe.c
+ *
+ */
+
+
+/** @file binframe.h
+  * Compact binary frame for the sensor data on the RS485 link.
+  *
+  * Payload (little endian):
+  *
+  *   seq(1) acx(2) acy(2) acz(2) mx(2) my(2) mz(2) crc(2)
+  *
+  * The CRC-16 (CCITT, polynomial 0x1021, start 0xFFFF) covers seq and the
+  * six values. The payload is COBS encoded (one overhead byte) and each
+  * frame ends with a 0x00 byte, i.e. 17 bytes per frame instead of about
+  * 40 characters of an $ACRAW sentence.
+  */
+
+#ifndef _binframe_h_
+#define _binframe_h_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Number of values per frame: ACC x,y,z and MAG x,y,z. */
+#define BINFRAME_N_VALUES     6
+
+/** Size of the payload: sequence number, values and CRC. */
+#define BINFRAME_PAYLOAD      (1 + 2*BINFRAME_N_VALUES + 2)
+
+/** Size of an encoded frame: COBS overhead byte, payload and delimiter. */
+#define BINFRAME_SIZE         (BINFRAME_PAYLOAD + 2)
+
+/** Contents of one frame. */
+typedef struct bin_frame {
+
+  uint8_t  fSequence;
+  int16_t  fValue[BINFRAME_N_VALUES];
+
+} bin_frame_t;
+
+/** State of the receiver of frames. */
+typedef struct bin_decoder {
+
+  uint8_t  fBuffer[BINFRAME_SIZE];
+  uint8_t  fLength;
+
+} bin_decoder_t;
+
+/** Update CRC-16 (CCITT) with one byte. */
+extern uint16_t BinFrameCRC16(uint16_t crc,uint8_t data);
+
+/** Encode 'frame' into 'buffer' (BINFRAME_SIZE bytes, including the
+  * terminating 0x00), returns the number of bytes.
+  */
+extern uint8_t BinFrameEncode(const bin_frame_t *frame,uint8_t *buffer);
+
+/** Reset the receiver. */
+extern void BinFrameInit(bin_decoder_t *decoder);
+
+/** Feed one received byte into the decoder, returns 1 if a complete frame
+  * with correct CRC was received and stored in 'frame'.
+  */
+extern uint8_t BinFrameDecode(bin_decoder_t *decoder,uint8_t data,
+                              bin_frame_t *frame);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // _binframe_h_
@@ -41,8 +41,9 @@
 
 /** @file lsm303read.c
   * Program to readout the LSM303DLH sensor and send its data via UART.
-  * The data is either sent in plain ASCII format or in NMEA formatted
-  * strings (favored mode of operation).
+  * The data is either sent in plain ASCII format, in NMEA formatted
+  * strings (favored mode of operation) or in compact binary frames
+  * (binframe.h, 17 instead of about 40 bytes per reading).
   * @author H.-J. Mathes <dc2ip@darc.de>
   */
 
@@ -58,6 +59,10 @@
 #include "global.h"
 #include "LSM303DLH.h"
 
+#ifdef BINARY_FORMAT
+# include "binframe.h"
+#endif
+
 /** Flag which signals to main() that 0.1 sec are over and a new sensor
   * reading is required.
   *
@@ -97,7 +102,7 @@ volatile uint8_t gSensorReadout = 1;
 static const char cBlank[] PROGMEM = " ";
 static const char cCRLF[] PROGMEM = "\r\n";
 
-#ifdef NMEA_FORMAT
+#if defined(NMEA_FORMAT) && !defined(BINARY_FORMAT)
 static char *strcat_p(char *dest,const char *progmem_src) {
 
   register char c;
@@ -130,8 +135,8 @@ static const char * hex2string(uint8_t val) {
 
   static char buffer[3];
 
-  buffer[0] = pgm_read_byte(&HEX[val & 0x0F]);
-  buffer[1] = pgm_read_byte(&HEX[val >> 4]);
+  buffer[0] = pgm_read_byte(&HEX[val >> 4]);
+  buffer[1] = pgm_read_byte(&HEX[val & 0x0F]);
   buffer[2] = 0;
 
   return buffer;
@@ -180,11 +185,38 @@ static void UartSendLSM303DataNMEA(LSM303DLHData* acc_data,
   uart_puts( message );
   uart_puts_p( cCRLF );
 }
-#endif // NMEA_FORMAT
+#endif // NMEA_FORMAT && !BINARY_FORMAT
+
+// --------------------------------------------------------------------------
+
+#ifdef BINARY_FORMAT
+static void UartSendLSM303DataBinary(LSM303DLHData* acc_data,
+                                     LSM303DLHData* mag_data) {
+
+  static uint8_t sequence = 0;
+
+  bin_frame_t frame;
+  uint8_t buffer[BINFRAME_SIZE];
+
+  frame.fSequence = sequence++;
+
+  frame.fValue[0] = acc_data->fSensorX;
+  frame.fValue[1] = acc_data->fSensorY;
+  frame.fValue[2] = acc_data->fSensorZ;
+  frame.fValue[3] = mag_data->fSensorX;
+  frame.fValue[4] = mag_data->fSensorY;
+  frame.fValue[5] = mag_data->fSensorZ;
+
+  uint8_t length = BinFrameEncode( &frame, buffer );
+
+  for ( uint8_t i=0; i<length; ++i )
+    uart_putc( buffer[i] );
+}
+#endif // BINARY_FORMAT
 
 // --------------------------------------------------------------------------
 
-#ifndef NMEA_FORMAT
+#if !defined(NMEA_FORMAT) && !defined(BINARY_FORMAT)
 static void UartSendLSM303Data(LSM303DLHData* data) {
 
   if ( !data ) return;
@@ -200,7 +232,7 @@ static void UartSendLSM303Data(LSM303DLHData* data) {
 
   uart_puts_p( cCRLF );
 }
-#endif // NMEA_FORMAT
+#endif // !NMEA_FORMAT && !BINARY_FORMAT
 
 // --------------------------------------------------------------------------
 
@@ -309,7 +341,9 @@ int main(void) {
       LSM303DLHInit();   // try to init the sensor again
     }
     else {  // send ACC & MAG data via UART
-#ifdef NMEA_FORMAT
+#if defined(BINARY_FORMAT)
+      UartSendLSM303DataBinary( &acc_data, &mag_data );
+#elif defined(NMEA_FORMAT)
       UartSendLSM303DataNMEA( &acc_data, &mag_data );
 #else
       uart_puts_P("ADATA ");
@@ -10,6 +10,7 @@
 
 #include <iostream>
 #include <string>
+#include <vector>
 
 #include <cstdio>
 #include <cstdlib>
@@ -32,7 +33,27 @@ using namespace std;
 #include "../LSM303/vector.c"
 #include "common.cc"
 
-#define USE_NMEA_FORMAT   1
+#include "logreader.cc"
+
+// ---------------------------------------------------------------------------
+
+/** Compact copy of a sample, kept in memory during the calibration. */
+struct sample_t {
+
+  int16_t fA[3];
+  int16_t fM[3];
+
+};
+
+// 12 MB, more than 20 hours of data at 12 samples/second
+static const size_t kMaxSamplesDefault = 1000000;
+
+#ifdef DO_HISTOGRAMS
+static TH1F *gHHead = NULL;
+static TH1F *gDHead = NULL;
+static TH1F *gHDvsT = NULL;
+static unsigned int gSampleId = 0;
+#endif // DO_HISTOGRAMS
 
 // ---------------------------------------------------------------------------
 
@@ -40,59 +61,91 @@ using namespace std;
 // g++ -g -Wall -o analyzedat analyzedat.cc
 //
 
-bool ReadTagFormat(FILE *file,vector_t *a,vector_t *m)
+static void Usage(const char *argv0)
  {
-  if ( feof(file) ) return false;
+  cout << "Usage: " << argv0 << " -i <input_file>" << endl;
+  cout << endl;
+  cout << "where" << endl;
+  cout << "\t-c               : do first a calibration" << endl;
+  cout << "\t-i <input_file>  : name of input file ('-' = stdin)" << endl;
+  cout << "\t-m <samples>     : max. number of samples of a file kept for the"
+       << endl
+       << "\t                   calibration, else a second pass" << endl
+       << "\t                   (default: " << kMaxSamplesDefault << ")" << endl;
+  cout << "\t-h,-?            : display this help page" << endl;
+  cout << endl;
+}
 
-  if ( !a || !m ) return false;
+// ---------------------------------------------------------------------------
 
-  bool status = true;
-  bool a_read = false, m_read = false;
-  char line[80];
+static void UpdateMinMax(const vector_t *v,vector_t *v_min,vector_t *v_max)
+ {
+  if ( v->x < v_min->x ) v_min->x = v->x;
+  if ( v->x > v_max->x ) v_max->x = v->x;
+  if ( v->y < v_min->y ) v_min->y = v->y;
+  if ( v->y > v_max->y ) v_max->y = v->y;
+  if ( v->z < v_min->z ) v_min->z = v->z;
+  if ( v->z > v_max->z ) v_max->z = v->z;
+}
 
-  do {
+// ---------------------------------------------------------------------------
 
-    fgets( line, sizeof(line)-1, file );
+static void PrintMinMax(const vector_t *a_min,const vector_t *a_max,
+                        const vector_t *m_min,const vector_t *m_max)
+ {
+  cout << "Reading for magnetic field: " << endl;
+  cout << "  min= " << m_min->x << " " << m_min->y
+       << " " << m_min->y << endl;
+  cout << "  max= " << m_max->x << " " << m_max->y
+       << " " << m_max->y << endl;
+  cout << "Reading for acceleration: " << endl;
+  cout << "  min= " << a_min->x << " " << a_min->y
+       << " " << a_min->z << endl;
+  cout << "  max= " << a_max->x << " " << a_max->y
+       << " " << a_max->z << endl;
+}
 
-    if ( feof(file) ) return false;
+// ---------------------------------------------------------------------------
 
-    if ( strstr(line, "ADATA") != NULL ) {
-      if ( sscanf( line, "ADATA %f %f %f", &a->x, &a->y, &a->z ) == 3 )
-        a_read = true;
-      else
-        status = false;
-    }
-    else if ( strstr(line, "MDATA") != NULL ) {
-      if ( sscanf( line, "MDATA %f %f %f", &m->x, &m->y, &m->z ) == 3 )
-        m_read = true;
-      else
-        status = false;
+/** Calculate and print 3D and 2D heading of one sample. */
+static void AnalyzeSample(const vector_t *a,vector_t m,
+                          const vector_t *m_min,const vector_t *m_max)
+ {
+  vector_t p = {0, -1, 0}; // X: to the right, Y: backward, Z: down
 
-      //cout << "mx " << m->x << " my " << m->y << " mz " << m->z << endl;
-    }
+  // shift and scale
+  m.x = (m.x - m_min->x) / (m_max->x - m_min->x) * 2 - 1.0;
+  m.y = (m.y - m_min->y) / (m_max->y - m_min->y) * 2 - 1.0;
+  m.z = (m.z - m_min->z) / (m_max->z - m_min->z) * 2 - 1.0;
 
-  } while ( !a_read || !m_read );
+  //cout << "m(x,y)= " << m.x << "," << m.y
+  //     << " " << m.x*m.x + m.y*m.y << endl;
 
-  return status;
-}
+  int heading3D = GetHeading3D(a, &m, &p );
 
-// ---------------------------------------------------------------------------
+#ifdef DO_HISTOGRAMS
+  gHDvsT->Fill( (float)gSampleId, (float)heading3D );
+  gSampleId++;
+#endif // DO_HISTOGRAMS
 
-#if (defined USE_NMEA_FORMAT)
-# define ReadData(_file_,_a_,_m_) ReadNMEAFormat(_file_,_a_,_m_)
-#else
-# define ReadData(_file_,_a_,_m_) ReadTagFormat(_file_,_a_,_m_)
-#endif // USE_NMEA_FORMAT
+  vector_t m2 = { 0, 0, 0 };
 
-static void Usage(const char *argv0)
- {
-  cout << "Usage: " << argv0 << " -i <input_file>" << endl;
-  cout << endl;
-  cout << "where" << endl;
-  cout << "\t-c               : do first a calibration" << endl;
-  cout << "\t-i <input_file>  : name of input file" << endl;
-  cout << "\t-h,-?            : display this help page" << endl;
-  cout << endl;
+  m2.x = m.x / sqrt(m.x*m.x + m.y*m.y);
+  m2.y = m.y / sqrt(m.x*m.x + m.y*m.y);
+
+  //cout << "m2(x,y)= " << m2.x << "," << m2.y
+  //     << " " << m2.x*m2.x + m2.y*m2.y << endl;
+
+  int heading2D = round( atan2( m2.x, m2.y) * 180. / M_PI - 180. );
+  if ( heading2D < 0 ) heading2D += 360;
+
+#ifdef DO_HISTOGRAMS
+  gHHead->Fill( (float)heading3D );
+  gDHead->Fill( (float)heading3D - (float)heading2D );
+#endif // DO_HISTOGRAMS
+
+  cout << "Heading= " << heading3D << " (3D) "
+       << heading2D << " (2D)" << '\n';
 }
 
 // ---------------------------------------------------------------------------
@@ -105,6 +158,7 @@ int main(int argc,char **argv)
  {
   string input_filename("lsm303-nmea.dat");
   bool do_calibrate = false;
+  size_t max_samples = kMaxSamplesDefault;
 
   // --- check and read program parameters from the command line
 
@@ -117,7 +171,7 @@ int main(int argc,char **argv)
 
   do {
 
-    getopt_status = getopt( argc, argv, "chi:?" );
+    getopt_status = getopt( argc, argv, "chi:m:?" );
 
     if ( getopt_status != EOF ) {
 
@@ -129,6 +183,10 @@ int main(int argc,char **argv)
 	case 'i': input_filename = optarg;
                   break;
 
+        case 'm': max_samples = strtoul( optarg, NULL, 0 );
+                  if ( max_samples < 1 ) max_samples = 1;
+                  break;
+
         case 'h':
         case '?': Usage(argv[0]);
                   break;
@@ -144,24 +202,33 @@ int main(int argc,char **argv)
 
   cout << argv[0] << ": reading from file " << input_filename << " ..." << endl;
 
-  FILE *file = fopen( input_filename.c_str(), "r" );
-  if ( !file ) {
+  LogReader reader;
+
+  if ( !reader.Open( input_filename.c_str() ) ) {
     cerr << argv[0] << ": error opening file!" << endl;
     exit( EXIT_FAILURE );
   }
 
+  if ( reader.GetFormat() == LogReader::kFormatUnknown ) {
+    cerr << argv[0] << ": unknown data format!" << endl;
+    exit( EXIT_FAILURE );
+  }
+
+  cout << argv[0] << ": data format is " << reader.GetFormatName() << endl;
+
 #ifdef DO_HISTOGRAMS
-  string histo_filename = input_filename;
-  histo_filename.erase( histo_filename.find(".dat"), string::npos );
+  // "-": stdin.root, else the input name without ".dat"
+  string histo_filename = input_filename == "-" ? string("stdin") : input_filename;
+  size_t suffix = histo_filename.rfind( ".dat" );
+  if ( suffix != string::npos ) histo_filename.erase( suffix );
   histo_filename += ".root";
 
   TFile *hfile = new TFile( histo_filename.c_str(), "recreate" );
 
-  TH1F *hhead = new TH1F( "head", "Calculated heading", 360, -0.5, 359.5 );
-  TH1F *dhead = new TH1F( "dhead", "Difference 3D-2D-heading", 11, -10.0, 10.0 );
+  gHHead = new TH1F( "head", "Calculated heading", 360, -0.5, 359.5 );
+  gDHead = new TH1F( "dhead", "Difference 3D-2D-heading", 11, -10.0, 10.0 );
 
-  TH1F *hdvst = new TH1F( "hdvst", "heading versus sample id", 1000, -0.5, 999.5 );
-  unsigned int sample_id = 0;
+  gHDvsT = new TH1F( "hdvst", "heading versus sample id", 1000, -0.5, 999.5 );
 #endif // DO_HISTOGRAMS
 
   vector_t a, m;
@@ -173,96 +240,93 @@ int main(int argc,char **argv)
   vector_t m_min = {  99999,  99999,  99999 };
   vector_t m_max = { -99999, -99999, -99999 };
 
-  if ( do_calibrate ) {
+  // the calibration is known before the analysis
+  // - for (mapped) files: the samples are kept up to 'max_samples', for
+  //   larger files there is a second pass over the data
+  // - for streams (stdin, pipe) it is done on the fly, i.e. extended with
+  //   each new sample, the results are shown at once (e.g. 'tail -f')
+  std::vector<sample_t> samples;
+  bool running_calibration = do_calibrate && !reader.IsMapped();
 
-    do {
+  if ( do_calibrate && !running_calibration ) {
 
-      if ( !ReadData( file, &a, &m ) ) break;
+    while ( reader.Read( &a, &m ) ) {
 
-      if ( a.x < a_min.x ) a_min.x = a.x;
-      if ( a.x > a_max.x ) a_max.x = a.x;
-      if ( a.y < a_min.y ) a_min.y = a.y;
-      if ( a.y > a_max.y ) a_max.y = a.y;
-      if ( a.z < a_min.z ) a_min.z = a.z;
-      if ( a.z > a_max.z ) a_max.z = a.z;
+      UpdateMinMax( &a, &a_min, &a_max );
+      UpdateMinMax( &m, &m_min, &m_max );
 
-      if ( m.x < m_min.x ) m_min.x = m.x;
-      if ( m.x > m_max.x ) m_max.x = m.x;
-      if ( m.y < m_min.y ) m_min.y = m.y;
-      if ( m.y > m_max.y ) m_max.y = m.y;
-      if ( m.z < m_min.z ) m_min.z = m.z;
-      if ( m.z > m_max.z ) m_max.z = m.z;
+      if ( samples.size() == max_samples ) {
 
-    } while ( !feof(file) );
+        while ( reader.Read( &a, &m ) ) {
+          UpdateMinMax( &a, &a_min, &a_max );
+          UpdateMinMax( &m, &m_min, &m_max );
+        }
+        samples.clear();
+        reader.Rewind();
 
-    rewind( file );
+        break;
+      }
+
+      sample_t s = { { (int16_t)a.x, (int16_t)a.y, (int16_t)a.z },
+                     { (int16_t)m.x, (int16_t)m.y, (int16_t)m.z } };
+      samples.push_back( s );
+    }
 
   } // do_calibrate
-  else {
+  else if ( !do_calibrate ) {
     m_min = gMinDefault_MAG;
     m_max = gMaxDefault_MAG;
   }
 
-  // --- output minimum and maximum values
+  // --- output minimum and maximum values, of a stream at its end
 
-  cout << "Reading for magnetic field: " << endl;
-  cout << "  min= " << m_min.x << " " << m_min.y
-       << " " << m_min.y << endl;
-  cout << "  max= " << m_max.x << " " << m_max.y
-       << " " << m_max.y << endl;
-  cout << "Reading for acceleration: " << endl;
-  cout << "  min= " << a_min.x << " " << a_min.y
-       << " " << a_min.z << endl;
-  cout << "  max= " << a_max.x << " " << a_max.y
-       << " " << a_max.z << endl;
+  if ( !running_calibration )
+    PrintMinMax( &a_min, &a_max, &m_min, &m_max );
 
-  // --- read again, now for data analysis
+  // --- analysis of the kept samples ...
 
-  vector_t p = {0, -1, 0}; // X: to the right, Y: backward, Z: down
+  for ( size_t i=0; i<samples.size(); ++i ) {
 
-  do {
+    vector_t sa, sm;
 
-    if ( !ReadData( file, &a, &m ) ) break;
+    sa.x = samples[i].fA[0]; sa.y = samples[i].fA[1]; sa.z = samples[i].fA[2];
+    sm.x = samples[i].fM[0]; sm.y = samples[i].fM[1]; sm.z = samples[i].fM[2];
 
-    // shift and scale
-    m.x = (m.x - m_min.x) / (m_max.x - m_min.x) * 2 - 1.0;
-    m.y = (m.y - m_min.y) / (m_max.y - m_min.y) * 2 - 1.0;
-    m.z = (m.z - m_min.z) / (m_max.z - m_min.z) * 2 - 1.0;
-
-    //cout << "m(x,y)= " << m.x << "," << m.y
-    //     << " " << m.x*m.x + m.y*m.y << endl;
+    AnalyzeSample( &sa, sm, &m_min, &m_max );
+  }
 
-    int heading3D = GetHeading3D(&a, &m, &p );
+  samples.clear();
 
-#ifdef DO_HISTOGRAMS
-    hdvst->Fill( (float)sample_id, (float)heading3D );
-    sample_id++;
-#endif // DO_HISTOGRAMS
+  // --- ... and of the (remaining) input
 
-    vector_t m2 = { 0, 0, 0 };
+  while ( reader.Read( &a, &m ) ) {
 
-    m2.x = m.x / sqrt(m.x*m.x + m.y*m.y);
-    m2.y = m.y / sqrt(m.x*m.x + m.y*m.y);
+    if ( running_calibration ) {
+      UpdateMinMax( &a, &a_min, &a_max );
+      UpdateMinMax( &m, &m_min, &m_max );
 
-    //cout << "m2(x,y)= " << m2.x << "," << m2.y
-    //     << " " << m2.x*m2.x + m2.y*m2.y << endl;
+      // no heading until each axis has a range
+      if (    m_max.x <= m_min.x || m_max.y <= m_min.y
+           || m_max.z <= m_min.z ) continue;
+    }
 
-    int heading2D = round( atan2( m2.x, m2.y) * 180. / M_PI - 180. );
-    if ( heading2D < 0 ) heading2D += 360;
+    AnalyzeSample( &a, m, &m_min, &m_max );
 
-#ifdef DO_HISTOGRAMS
-    hhead->Fill( (float)heading3D );
-    dhead->Fill( (float)heading3D - (float)heading2D );
-#endif // DO_HISTOGRAMS
+    // live data: show each result before waiting for new input
+    if ( !reader.IsMapped() && !reader.IsLineBuffered() ) cout.flush();
+  }
 
-    cout << "Heading= " << heading3D << " (3D) "
-         << heading2D << " (2D)" << endl;
+  if ( running_calibration )
+    PrintMinMax( &a_min, &a_max, &m_min, &m_max );
 
-  } while ( !feof(file) );
+  cout << argv[0] << ": " << reader.GetLines() << " lines, "
+       << reader.GetSamples() << " samples, "
+       << reader.GetMalformed() << " malformed, "
+       << reader.GetChecksumErrors() << " checksum errors" << endl;
 
   // --- cleanup and propgram termination
 
-  fclose( file );
+  reader.Close();
 
 #ifdef DO_HISTOGRAMS
   hfile->Write();
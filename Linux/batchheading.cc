@@ -0,0 +1,294 @@
+//
+// File   : batchheading.cc
+//
+// Purpose: Heading calculation for many samples at once (SoA arrays)
+//
+// $Id$
+//
+
+
+/** @file batchheading.cc
+  * Heading calculation for many samples at once.
+  *
+  * The samples are stored as structure of arrays (one array per component
+  * ax, ay, az, mx, my, mz), thus 8 samples fit into one AVX register.
+  * The result is the same as GetHeading3D() of common.cc with the facing
+  * vector p = {0, -1, 0} and the MAG readings shifted and scaled as in
+  * analyzedat.cc (differences of one degree are possible due to rounding).
+  *
+  * Normalization: N = a x E is perpendicular to a and E, thus |N| = |a||E|
+  * and with p = {0, -1, 0}
+  *
+  *   heading = atan2(-E.y/|E|, -N.y/(|a||E|)) = atan2(-E.y*|a|, -N.y)
+  *
+  * i.e. one square root per sample and no division. atan2() is replaced by
+  * a polynomial (max. error 0.001 degree).
+  *
+  * Two kernels exist: a portable one which is written to be vectorized by
+  * the compiler and one with AVX2/FMA intrinsics (x86 only). The kernel is
+  * selected once at runtime depending on the CPU.
+  */
+
+#include <vector>
+
+#include <cfloat>
+#include <cmath>
+#include <cstddef>
+
+#if defined(__x86_64__) || defined(__i386__)
+ #define BATCH_HEADING_AVX2
+ #include <immintrin.h>
+#endif
+
+// ---------------------------------------------------------------------------
+
+/** Samples as structure of arrays. */
+struct sample_soa_t {
+
+  std::vector<float> fAx, fAy, fAz;
+  std::vector<float> fMx, fMy, fMz;
+
+  void Add(const vector_t *a,const vector_t *m)
+   {
+    fAx.push_back( a->x ); fAy.push_back( a->y ); fAz.push_back( a->z );
+    fMx.push_back( m->x ); fMy.push_back( m->y ); fMz.push_back( m->z );
+  }
+
+  void Clear()
+   {
+    fAx.clear(); fAy.clear(); fAz.clear();
+    fMx.clear(); fMy.clear(); fMz.clear();
+  }
+
+  size_t Size() const { return fAx.size(); }
+
+};
+
+/** Calibration of the MAG readings: m' = m * fScale + fOffset. */
+struct batch_calib_t {
+
+  float fScale[3];
+  float fOffset[3];
+
+};
+
+/** Kernel: heading[i] in degrees (0...359) of the samples first ... first+n-1. */
+typedef void (*batch_kernel_t)(const batch_calib_t *calib,
+                               const sample_soa_t *s,size_t first,size_t n,
+                               int *heading);
+
+// ---------------------------------------------------------------------------
+
+// atan(t) for 0 <= t <= 1 in degrees: t * P(t^2)
+static const float kAtanC1  =  0.99997726f * 180.0f / M_PI;
+static const float kAtanC3  = -0.33262347f * 180.0f / M_PI;
+static const float kAtanC5  =  0.19354346f * 180.0f / M_PI;
+static const float kAtanC7  = -0.11643287f * 180.0f / M_PI;
+static const float kAtanC9  =  0.05265332f * 180.0f / M_PI;
+static const float kAtanC11 = -0.01172120f * 180.0f / M_PI;
+
+// ---------------------------------------------------------------------------
+
+/** Precompute scale and offset from the min/max readings (as in analyzedat.cc:
+  * m' = (m - min) / (max - min) * 2 - 1).
+  */
+void HeadingBatchInit(batch_calib_t *calib,
+                      const vector_t *m_min,const vector_t *m_max)
+ {
+  calib->fScale[0] = 2.0f / (m_max->x - m_min->x);
+  calib->fScale[1] = 2.0f / (m_max->y - m_min->y);
+  calib->fScale[2] = 2.0f / (m_max->z - m_min->z);
+
+  calib->fOffset[0] = -m_min->x * calib->fScale[0] - 1.0f;
+  calib->fOffset[1] = -m_min->y * calib->fScale[1] - 1.0f;
+  calib->fOffset[2] = -m_min->z * calib->fScale[2] - 1.0f;
+}
+
+// ---------------------------------------------------------------------------
+
+/** Portable kernel, no branches in the loop to allow auto-vectorization. */
+static void HeadingBatchScalar(const batch_calib_t *calib,
+                               const sample_soa_t *s,size_t first,size_t n,
+                               int *heading)
+ {
+  const float *Ax = &s->fAx[first], *Ay = &s->fAy[first], *Az = &s->fAz[first];
+  const float *Mx = &s->fMx[first], *My = &s->fMy[first], *Mz = &s->fMz[first];
+
+  for ( size_t i=0; i<n; ++i ) {
+
+    float ax = Ax[i], ay = Ay[i], az = Az[i];
+
+    float mx = Mx[i] * calib->fScale[0] + calib->fOffset[0];
+    float my = My[i] * calib->fScale[1] + calib->fOffset[1];
+    float mz = Mz[i] * calib->fScale[2] + calib->fOffset[2];
+
+    // E = m x a, N = a x E
+    float ex = my * az - mz * ay;
+    float ey = mz * ax - mx * az;
+    float ez = mx * ay - my * ax;
+
+    float ny = az * ex - ax * ez;
+
+    float y = -ey * sqrtf( ax*ax + ay*ay + az*az );
+    float x = -ny;
+
+    float abs_y = fabsf( y ), abs_x = fabsf( x );
+    float t_min = fminf( abs_x, abs_y );
+    float t_max = fmaxf( fmaxf( abs_x, abs_y ), FLT_MIN );
+
+    float t = t_min / t_max;
+    float t2 = t * t;
+
+    float h = t * (kAtanC1 + t2 * (kAtanC3 + t2 * (kAtanC5 + t2 * (kAtanC7
+                  + t2 * (kAtanC9 + t2 * kAtanC11)))));
+
+    h = abs_y > abs_x ? 90.0f - h : h;
+    h = x < 0.0f ? 180.0f - h : h;
+    h = copysignf( h, y );
+
+    // round() as in GetHeading3D(), then 0...359
+    int r = (int)(h + copysignf( 0.5f, h ));
+
+    heading[i] = r < 0 ? r + 360 : r;
+  }
+}
+
+// ---------------------------------------------------------------------------
+
+#ifdef BATCH_HEADING_AVX2
+
+/** AVX2/FMA kernel, 8 samples per iteration, the rest is done by
+  * HeadingBatchScalar().
+  */
+__attribute__((target("avx2,fma")))
+static void HeadingBatchAVX2(const batch_calib_t *calib,
+                             const sample_soa_t *s,size_t first,size_t n,
+                             int *heading)
+ {
+  const float *Ax = &s->fAx[first], *Ay = &s->fAy[first], *Az = &s->fAz[first];
+  const float *Mx = &s->fMx[first], *My = &s->fMy[first], *Mz = &s->fMz[first];
+
+  const __m256 scale_x = _mm256_set1_ps( calib->fScale[0] );
+  const __m256 scale_y = _mm256_set1_ps( calib->fScale[1] );
+  const __m256 scale_z = _mm256_set1_ps( calib->fScale[2] );
+  const __m256 offset_x = _mm256_set1_ps( calib->fOffset[0] );
+  const __m256 offset_y = _mm256_set1_ps( calib->fOffset[1] );
+  const __m256 offset_z = _mm256_set1_ps( calib->fOffset[2] );
+
+  const __m256 sign_mask = _mm256_set1_ps( -0.0f );
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 tiny = _mm256_set1_ps( FLT_MIN );
+  const __m256 half = _mm256_set1_ps( 0.5f );
+  const __m256 deg90 = _mm256_set1_ps( 90.0f );
+  const __m256 deg180 = _mm256_set1_ps( 180.0f );
+  const __m256i deg360 = _mm256_set1_epi32( 360 );
+
+  size_t i = 0;
+
+  for ( ; i+8<=n; i+=8 ) {
+
+    __m256 ax = _mm256_loadu_ps( Ax + i );
+    __m256 ay = _mm256_loadu_ps( Ay + i );
+    __m256 az = _mm256_loadu_ps( Az + i );
+
+    __m256 mx = _mm256_fmadd_ps( _mm256_loadu_ps( Mx + i ), scale_x, offset_x );
+    __m256 my = _mm256_fmadd_ps( _mm256_loadu_ps( My + i ), scale_y, offset_y );
+    __m256 mz = _mm256_fmadd_ps( _mm256_loadu_ps( Mz + i ), scale_z, offset_z );
+
+    // E = m x a, N = a x E
+    __m256 ex = _mm256_fmsub_ps( my, az, _mm256_mul_ps( mz, ay ) );
+    __m256 ey = _mm256_fmsub_ps( mz, ax, _mm256_mul_ps( mx, az ) );
+    __m256 ez = _mm256_fmsub_ps( mx, ay, _mm256_mul_ps( my, ax ) );
+
+    __m256 ny = _mm256_fmsub_ps( az, ex, _mm256_mul_ps( ax, ez ) );
+
+    __m256 abs_a = _mm256_sqrt_ps( _mm256_fmadd_ps( ax, ax,
+                     _mm256_fmadd_ps( ay, ay, _mm256_mul_ps( az, az ) ) ) );
+
+    __m256 y = _mm256_xor_ps( _mm256_mul_ps( ey, abs_a ), sign_mask );
+    __m256 x = _mm256_xor_ps( ny, sign_mask );
+
+    __m256 abs_y = _mm256_andnot_ps( sign_mask, y );
+    __m256 abs_x = _mm256_andnot_ps( sign_mask, x );
+
+    __m256 t_min = _mm256_min_ps( abs_x, abs_y );
+    __m256 t_max = _mm256_max_ps( _mm256_max_ps( abs_x, abs_y ), tiny );
+
+    __m256 t = _mm256_div_ps( t_min, t_max );
+    __m256 t2 = _mm256_mul_ps( t, t );
+
+    __m256 p = _mm256_set1_ps( kAtanC11 );
+    p = _mm256_fmadd_ps( p, t2, _mm256_set1_ps( kAtanC9 ) );
+    p = _mm256_fmadd_ps( p, t2, _mm256_set1_ps( kAtanC7 ) );
+    p = _mm256_fmadd_ps( p, t2, _mm256_set1_ps( kAtanC5 ) );
+    p = _mm256_fmadd_ps( p, t2, _mm256_set1_ps( kAtanC3 ) );
+    p = _mm256_fmadd_ps( p, t2, _mm256_set1_ps( kAtanC1 ) );
+
+    __m256 h = _mm256_mul_ps( t, p );
+
+    h = _mm256_blendv_ps( h, _mm256_sub_ps( deg90, h ),
+                          _mm256_cmp_ps( abs_y, abs_x, _CMP_GT_OQ ) );
+    h = _mm256_blendv_ps( h, _mm256_sub_ps( deg180, h ),
+                          _mm256_cmp_ps( x, zero, _CMP_LT_OQ ) );
+    h = _mm256_or_ps( h, _mm256_and_ps( y, sign_mask ) );
+
+    // round() as in GetHeading3D(), then 0...359
+    __m256i r = _mm256_cvttps_epi32( _mm256_add_ps( h,
+                  _mm256_or_ps( half, _mm256_and_ps( h, sign_mask ) ) ) );
+
+    r = _mm256_add_epi32( r, _mm256_and_si256( deg360,
+                               _mm256_cmpgt_epi32( _mm256_setzero_si256(), r ) ) );
+
+    _mm256_storeu_si256( (__m256i *)(heading + i), r );
+  }
+
+  if ( i < n ) HeadingBatchScalar( calib, s, first + i, n - i, heading + i );
+}
+
+#endif // BATCH_HEADING_AVX2
+
+// ---------------------------------------------------------------------------
+
+static batch_kernel_t gBatchKernel = NULL;
+static const char    *gBatchKernelName = NULL;
+
+/** Select the fastest kernel the CPU supports. */
+static void HeadingBatchSelect()
+ {
+  gBatchKernel = HeadingBatchScalar;
+  gBatchKernelName = "scalar";
+
+#ifdef BATCH_HEADING_AVX2
+  __builtin_cpu_init();
+
+  if ( __builtin_cpu_supports( "avx2" ) && __builtin_cpu_supports( "fma" ) ) {
+    gBatchKernel = HeadingBatchAVX2;
+    gBatchKernelName = "avx2";
+  }
+#endif // BATCH_HEADING_AVX2
+}
+
+// ---------------------------------------------------------------------------
+
+/** Calculate the headings of all samples in 's', 'heading' must have room
+  * for s->Size() values.
+  */
+void GetHeading3DBatch(const batch_calib_t *calib,const sample_soa_t *s,
+                       int *heading)
+ {
+  if ( !gBatchKernel ) HeadingBatchSelect();
+
+  if ( s->Size() ) gBatchKernel( calib, s, 0, s->Size(), heading );
+}
+
+// ---------------------------------------------------------------------------
+
+const char *GetHeading3DBatchName()
+ {
+  if ( !gBatchKernel ) HeadingBatchSelect();
+
+  return gBatchKernelName;
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
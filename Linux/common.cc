@@ -12,6 +12,9 @@
   * Common code parts for C++ analysis stuff...
   */
 
+// binary frames of lsm303read.c (UseBinaryFormat)
+#include "../LSM303/binframe.c"
+
 // ---------------------------------------------------------------------------
 
 // Returns a heading (in degrees) given an acceleration vector a due to gravity, a magnetic vector m, and a facing vector p.
@@ -91,5 +94,26 @@ bool ReadNMEAFormat(const char *line,vector_t *a,vector_t *m)
   return status;
 }
 
+// ---------------------------------------------------------------------------
+
+// feed one byte received from the sensor (or echoed by the controller) into
+// the decoder of binary frames, true if 'a' and 'm' hold a new reading
+bool ReadBinaryFormat(bin_decoder_t *decoder,unsigned char data,
+                      vector_t *a,vector_t *m,int *sequence = NULL)
+ {
+  if ( !decoder || !a || !m ) return false;
+
+  bin_frame_t frame;
+
+  if ( !BinFrameDecode( decoder, data, &frame ) ) return false;
+
+  a->x = frame.fValue[0]; a->y = frame.fValue[1]; a->z = frame.fValue[2];
+  m->x = frame.fValue[3]; m->y = frame.fValue[4]; m->z = frame.fValue[5];
+
+  if ( sequence ) *sequence = frame.fSequence;
+
+  return true;
+}
+
 // ---------------------------------------------------------------------------
 // ---------------------------------------------------------------------------
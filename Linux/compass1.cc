@@ -11,7 +11,6 @@
 #include <iostream>
 #include <iomanip>
 #include <string>
-#include <list>
 
 #include <cstdio>
 #include <cstdlib>
@@ -40,6 +39,10 @@ using std::setw;
 
 #include "common.cc"
 
+// same code as in the controller
+#include "../fixheading.c"
+#include "../headingfilter.c"
+
 enum {
 
   kModeMask = 0xff,
@@ -159,6 +162,12 @@ int main(int argc, char** argv)
   int gps_data_ptr = 0;
   bool gps_msg_start = false, gps_msg_complete = false;
 
+  // binary frames, sent instead of $ACRAW sentences (UseBinaryFormat)
+  bin_decoder_t bin_decoder;
+  BinFrameInit( &bin_decoder );
+  bool bin_msg_complete = false;
+  int bin_sequence = 0, bin_sequence_last = -1;
+
   vector_t p = {0, -1, 0}; // X: to the right, Y: backward, Z: down
 
   vector_t vMin = {  99999,  99999,  99999 };
@@ -167,8 +176,8 @@ int main(int argc, char** argv)
   vector_t m_min = gProgramParameter.fMinMAG;
   vector_t m_max = gProgramParameter.fMaxMAG;
 
-  int last_average = 0; // last average
-  std::list<int> headings;
+  heading_filter_t headings;
+  HeadingFilterInit( &headings, 10 );
 
   char choice;
   bool leave = false;
@@ -247,8 +256,13 @@ int main(int argc, char** argv)
 //	  cout << data;
 //	}
 
+	bin_msg_complete = ReadBinaryFormat( &bin_decoder, data, &a, &m, &bin_sequence );
+
 	switch ( data ) {
 
+	  case 0x00: gps_msg_start = false;  // end of a binary frame
+	             break;
+
 	  case '$':  gps_msg_start = true;
 	             gps_data_ptr = 0;
 	             gps_data[gps_data_ptr++] = data;
@@ -269,20 +283,38 @@ int main(int argc, char** argv)
 
     }  // if ( !leave ) ...
 
-    if ( gps_msg_complete ) {
+    if ( gps_msg_complete || bin_msg_complete ) {
 
 //      if ( gProgramParameter.fOperationMode & kDebug ) {
 //        cout << gps_data;
 //      }
 
-      gps_msg_complete = false;
+      bool msg_ok = false;
 
-      if ( gProgramParameter.fOperationMode == kCalibrate || gProgramParameter.fOperationMode & kDebug )
-        cout << "ACMSG: " << gps_data << endl;
+      if ( bin_msg_complete ) {
 
-      bool msg_ok = false;
+        if ( gProgramParameter.fOperationMode == kCalibrate || gProgramParameter.fOperationMode & kDebug )
+          cout << "ACBIN: " << bin_sequence << " " << a.x << " " << a.y << " " << a.z
+               << " " << m.x << " " << m.y << " " << m.z << endl;
+
+        if ( bin_sequence_last >= 0 && bin_sequence != ((bin_sequence_last + 1) & 0xff) )
+          cerr << "Lost " << ((bin_sequence - bin_sequence_last - 1) & 0xff)
+               << " binary frame(s)!" << endl;
+
+        bin_sequence_last = bin_sequence;
+        bin_msg_complete = false;
+
+        msg_ok = true;
+      }
+      else {
 
-      msg_ok = ReadNMEAFormat( gps_data, &a, &m );
+        gps_msg_complete = false;
+
+        if ( gProgramParameter.fOperationMode == kCalibrate || gProgramParameter.fOperationMode & kDebug )
+          cout << "ACMSG: " << gps_data << endl;
+
+        msg_ok = ReadNMEAFormat( gps_data, &a, &m );
+      }
 
       if ( (gProgramParameter.fOperationMode & kDebug) && !msg_ok ) {
         cout << "!!!" << endl;
@@ -312,33 +344,9 @@ int main(int argc, char** argv)
              if ( gProgramParameter.fDisplayOn )
                cout << "3D-Heading= " << setw(3) << heading3D;
 
-	     headings.push_back( heading3D );
-
-	     if ( headings.size() == 10 ) {
-
-	       int average = 0;
-
-	       for ( std::list<int>::iterator it = headings.begin();
-	                                      it != headings.end(); ++it ) {
-
-		 if ( last_average > 270 && *it < 90 )
-		   average += *it + 360;
-		 else if ( last_average < 90 && *it > 270 )
-		   average += *it - 360;
-		 else
-	           average += *it;
-	       }
-
-	       average /= 10;
-
-	       if ( average >= 360 )
-	         average -= 360;
-	       else if ( average < 0 )
-	         average += 360;
-
-	       last_average = average;
+	     int average = HeadingFilterAdd( &headings, heading3D );
 
-	       headings.pop_front();
+	     if ( headings.fCount == headings.fWindow ) {
 
 	       if ( gProgramParameter.fDisplayOn )
 	         cout << " \t** " << setw(3) << average << " ** \t"
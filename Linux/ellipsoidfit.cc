@@ -0,0 +1,289 @@
+//
+// File   : ellipsoidfit.cc
+//
+// Purpose: Fit of an ellipsoid to the readings of the MAG sensor, hard and
+//          soft iron calibration (../fixheading.h, mag_calib_t)
+//
+// $Id$
+//
+
+
+/** @file ellipsoidfit.cc
+  * Fit of an ellipsoid to the readings of the MAG sensor.
+  *
+  * Without iron nearby the readings lie on a sphere around the origin. Hard
+  * iron shifts its center, soft iron (and different gains of the axes)
+  * distorts it into an ellipsoid. The quadric
+  *
+  *   a x^2 + b y^2 + c z^2 + 2d xy + 2e xz + 2f yz + 2g x + 2h y + 2i z = 1
+  *
+  * is fitted by linear least squares. The 9 x 9 normal equations are summed
+  * up sample by sample (Add()), thus the data is read once and the memory
+  * does not grow with the number of samples; millions of samples are done
+  * in milliseconds. Solve() then returns the center c and the symmetric
+  * matrix W which maps the ellipsoid onto the unit sphere, m' = W (m - c),
+  * the configuration record in EEPROM (fMAG_calib).
+  *
+  * A sensor on the rotator only turns around the vertical axis, its
+  * readings lie on a ring and the ellipsoid is not determined. For such
+  * data the ellipse in the x/y plane is fitted (same sums), z is shifted by
+  * its mean and scaled like the plane.
+  *
+  * Included by magcalib.cc and headingtest.cc, needs ../fixheading.h.
+  *
+  * @author H.-J. Mathes <dc2ip@darc.de>
+  */
+
+// ---------------------------------------------------------------------------
+
+class EllipsoidFit {
+
+ public:
+
+  /** Readings are divided by this, keeps the normal equations conditioned. */
+  static const double kScale;
+
+  EllipsoidFit() { Clear(); }
+
+  void Clear()
+   {
+    memset( fSum, 0, sizeof(fSum) );
+    memset( fRhs, 0, sizeof(fRhs) );
+    fSamples = 0;
+   }
+
+  /** Add one reading to the normal equations. */
+  void Add(const vector_t &m)
+   {
+    double x = m.x / kScale, y = m.y / kScale, z = m.z / kScale;
+    double r[kNParameters] = { x*x, y*y, z*z, 2*x*y, 2*x*z, 2*y*z, 2*x, 2*y, 2*z };
+
+    for ( int i=0; i<kNParameters; ++i ) {
+      fRhs[i] += r[i];
+      for ( int j=i; j<kNParameters; ++j )
+        fSum[i][j] += r[i] * r[j];
+    }
+
+    fSamples++;
+   }
+
+  unsigned long GetSamples() const { return fSamples; }
+
+  /** Solve the normal equations, the ellipsoid or (plane) the ellipse in
+    * the x/y plane. Returns false if the data does not determine it.
+    */
+  bool Solve(mag_calib_t *mag,bool plane) const
+   {
+    // parameters a,b,c,d,e,f,g,h,i (index into the sums) of the fit
+    static const int cEllipsoid[] = { 0, 1, 2, 3, 4, 5, 6, 7, 8 };
+    static const int cEllipse[]   = { 0, 1, 3, 6, 7 };
+
+    const int *index = plane ? cEllipse : cEllipsoid;
+    int n = plane ? 5 : kNParameters;
+
+    double v[kNParameters] = { 0 };
+    double sub[kNParameters][kNParameters+1];
+
+    if ( fSamples < (unsigned long)n ) return false;
+
+    for ( int i=0; i<n; ++i ) {
+      for ( int j=0; j<n; ++j ) {
+        int k = index[i], l = index[j];
+        sub[i][j] = k <= l ? fSum[k][l] : fSum[l][k];
+      }
+      sub[i][n] = fRhs[index[i]];
+    }
+
+    if ( !SolveLinear( sub, n ) ) return false;
+
+    for ( int i=0; i<n; ++i ) v[index[i]] = sub[i][n];
+
+    double a[3][3] = { { v[0], v[3], v[4] },
+                       { v[3], v[1], v[5] },
+                       { v[4], v[5], v[2] } };
+    double g[3] = { v[6], v[7], v[8] };
+    double c[3] = { 0., 0., 0. };
+
+    // center c = -A^-1 g
+    if ( plane ) {
+      double det = a[0][0] * a[1][1] - a[0][1] * a[1][0];
+      if ( det <= 0. ) return false;
+      c[0] = -( a[1][1] * g[0] - a[0][1] * g[1]) / det;
+      c[1] = -(-a[1][0] * g[0] + a[0][0] * g[1]) / det;
+      c[2] = fRhs[8] / 2. / fSamples;
+    }
+    else {
+      double inv[3][3];
+      double det = Invert( a, inv );
+      if ( det == 0. ) return false;
+      for ( int i=0; i<3; ++i )
+        c[i] = -(inv[i][0] * g[0] + inv[i][1] * g[1] + inv[i][2] * g[2]);
+    }
+
+    // (m - c)^T A (m - c) = 1 + c^T A c
+    double k = 1.;
+    for ( int i=0; i<3; ++i )
+      for ( int j=0; j<3; ++j )
+        k += c[i] * a[i][j] * c[j];
+
+    if ( k <= 0. ) return false;
+
+    for ( int i=0; i<3; ++i )
+      for ( int j=0; j<3; ++j )
+        a[i][j] /= k;
+
+    // z like the plane, the geometric mean of its axes
+    if ( plane ) {
+      double det = a[0][0] * a[1][1] - a[0][1] * a[1][0];
+      a[2][2] = sqrt( det );
+    }
+
+    // W = sqrt(A) = V sqrt(L) V^T
+    double l[3], e[3][3];
+    Eigen( a, l, e );
+
+    for ( int i=0; i<3; ++i )
+      if ( l[i] <= 0. ) return false;
+
+    mag->fMagic = MAG_CALIB_MAGIC;
+
+    for ( int i=0; i<3; ++i ) {
+      mag->fOffset[i] = c[i] * kScale;
+      for ( int j=0; j<3; ++j ) {
+        double w = 0.;
+        for ( int n=0; n<3; ++n )
+          w += e[i][n] * sqrt( l[n] ) * e[j][n];
+        mag->fMatrix[i][j] = w / kScale;
+      }
+    }
+
+    return true;
+   }
+
+  /** Deviation of the corrected reading from the unit sphere, |m'| - 1. */
+  static double Residual(const mag_calib_t &mag,const vector_t &m)
+   {
+    double d[3] = { m.x - mag.fOffset[0], m.y - mag.fOffset[1], m.z - mag.fOffset[2] };
+    double sum = 0.;
+
+    for ( int i=0; i<3; ++i ) {
+      double w = mag.fMatrix[i][0] * d[0] + mag.fMatrix[i][1] * d[1]
+               + mag.fMatrix[i][2] * d[2];
+      sum += w * w;
+    }
+
+    return sqrt( sum ) - 1.;
+   }
+
+ private:
+
+  enum { kNParameters = 9 };
+
+  // Gauss-Jordan with partial pivoting on the augmented matrix
+  static bool SolveLinear(double m[][kNParameters+1],int n)
+   {
+    double scale = 0.;
+    for ( int i=0; i<n; ++i )
+      if ( fabs( m[i][i] ) > scale ) scale = fabs( m[i][i] );
+
+    for ( int col=0; col<n; ++col ) {
+
+      int pivot = col;
+      for ( int row=col+1; row<n; ++row )
+        if ( fabs( m[row][col] ) > fabs( m[pivot][col] ) ) pivot = row;
+
+      // rank deficient, e.g. only a ring of readings
+      if ( fabs( m[pivot][col] ) <= 1e-12 * scale ) return false;
+
+      if ( pivot != col )
+        for ( int j=0; j<=n; ++j ) {
+          double t = m[col][j]; m[col][j] = m[pivot][j]; m[pivot][j] = t;
+        }
+
+      for ( int row=0; row<n; ++row ) {
+        if ( row == col ) continue;
+        double f = m[row][col] / m[col][col];
+        for ( int j=col; j<=n; ++j ) m[row][j] -= f * m[col][j];
+      }
+    }
+
+    for ( int i=0; i<n; ++i ) m[i][n] /= m[i][i];
+
+    return true;
+   }
+
+  // inverse by the cofactors, returns the determinant
+  static double Invert(const double a[3][3],double inv[3][3])
+   {
+    for ( int i=0; i<3; ++i )
+      for ( int j=0; j<3; ++j )
+        inv[j][i] = a[(i+1)%3][(j+1)%3] * a[(i+2)%3][(j+2)%3]
+                  - a[(i+1)%3][(j+2)%3] * a[(i+2)%3][(j+1)%3];
+
+    double det = a[0][0] * inv[0][0] + a[0][1] * inv[1][0] + a[0][2] * inv[2][0];
+
+    if ( det != 0. )
+      for ( int i=0; i<3; ++i )
+        for ( int j=0; j<3; ++j )
+          inv[i][j] /= det;
+
+    return det;
+   }
+
+  // eigenvalues l and eigenvectors (columns of e) of the symmetric a, Jacobi
+  static void Eigen(const double a[3][3],double l[3],double e[3][3])
+   {
+    double m[3][3];
+
+    for ( int i=0; i<3; ++i )
+      for ( int j=0; j<3; ++j ) {
+        m[i][j] = a[i][j];
+        e[i][j] = i == j ? 1. : 0.;
+      }
+
+    for ( int sweep=0; sweep<50; ++sweep ) {
+
+      double off = fabs( m[0][1] ) + fabs( m[0][2] ) + fabs( m[1][2] );
+      if ( off < 1e-15 * (fabs( m[0][0] ) + fabs( m[1][1] ) + fabs( m[2][2] )) )
+        break;
+
+      for ( int p=0; p<2; ++p )
+        for ( int q=p+1; q<3; ++q ) {
+
+          if ( m[p][q] == 0. ) continue;
+
+          double theta = (m[q][q] - m[p][p]) / (2. * m[p][q]);
+          double t = (theta >= 0. ? 1. : -1.) / (fabs( theta ) + sqrt( theta * theta + 1. ));
+          double cs = 1. / sqrt( t * t + 1. ), sn = t * cs;
+
+          for ( int k=0; k<3; ++k ) {   // m = m J
+            double mp = m[k][p], mq = m[k][q];
+            m[k][p] = cs * mp - sn * mq;
+            m[k][q] = sn * mp + cs * mq;
+          }
+          for ( int k=0; k<3; ++k ) {   // m = J^T m
+            double mp = m[p][k], mq = m[q][k];
+            m[p][k] = cs * mp - sn * mq;
+            m[q][k] = sn * mp + cs * mq;
+          }
+          for ( int k=0; k<3; ++k ) {   // e = e J
+            double ep = e[k][p], eq = e[k][q];
+            e[k][p] = cs * ep - sn * eq;
+            e[k][q] = sn * ep + cs * eq;
+          }
+        }
+    }
+
+    for ( int i=0; i<3; ++i ) l[i] = m[i][i];
+   }
+
+  double        fSum[kNParameters][kNParameters];  // upper triangle
+  double        fRhs[kNParameters];
+  unsigned long fSamples;
+
+};
+
+const double EllipsoidFit::kScale = 1024.;
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
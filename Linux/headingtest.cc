@@ -0,0 +1,595 @@
+//
+// File   : headingtest.cc
+//
+// Purpose: Compare the integer heading calculation (../fixheading.c) and
+//          the batch kernels (batchheading.cc) with the float version on
+//          recorded data, lag and noise of the heading filters
+//
+// $Id$
+//
+
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <ctime>
+#include <unistd.h>   // getopt()
+
+/** @file headingtest.cc
+  * Compare the integer heading calculation (../fixheading.c) and the
+  * batch kernels of batchheading.cc with the float version GetHeading3D()
+  * on every frame of a recorded data file. The test fails if any heading
+  * differs by more than one degree or if a frame does not survive the
+  * binary transmission format (../LSM303/binframe.c).
+  *
+  * The moving average and the tracker of ../headingfilter.c are compared
+  * by their lag and noise against a centered (thus not lagging) average of
+  * the headings. The recording has no relay states, the motion for the
+  * tracker is taken from this reference, the tracker has to lag less.
+  * @author H.-J. Mathes <dc2ip@darc.de>
+  */
+
+using namespace std;
+
+#include "../LSM303/vector.c"
+#include "common.cc"
+#include "../fixheading.c"
+#include "../headingfilter.c"
+#include "batchheading.cc"
+#include "ellipsoidfit.cc"
+
+// ---------------------------------------------------------------------------
+
+static void Usage(const char *argv0)
+ {
+  cout << "Usage: " << argv0 << " [-v] [-b <samples>] -i <input_file>" << endl;
+  cout << endl;
+  cout << "where" << endl;
+  cout << "\t-i <input_file>  : name of input file (NMEA format)" << endl;
+  cout << "\t-v               : print every frame with a difference" << endl;
+  cout << "\t-b <samples>     : benchmark float and batch kernels" << endl;
+  cout << "\t-h,-?            : display this help page" << endl;
+  cout << endl;
+}
+
+// ---------------------------------------------------------------------------
+
+// at home (mockup, 2012-06-05, on bread-board)
+vector_t gMinDefault_MAG = { -474, -257, -257 };
+vector_t gMaxDefault_MAG = {   36,  238,  238 };
+
+struct Frame {
+
+  vector_t fA;
+  vector_t fM;
+
+};
+
+// returns the maximum difference in degrees
+static int CompareHeadings(const vector<Frame> &frames,
+                           const mag_calib_t &mag,bool verbose)
+ {
+  vector_t p = {0, -1, 0}; // X: to the right, Y: backward, Z: down
+
+  fix_calib_t calib;
+  FixHeadingInit( &calib, &mag );
+
+  int max_diff = 0;
+  unsigned int n_diff = 0;
+
+  for ( size_t i=0; i<frames.size(); ++i ) {
+
+    vector_t a = frames[i].fA;
+    vector_t m = frames[i].fM;
+
+    i_vector_t ia = { (int16_t)a.x, (int16_t)a.y, (int16_t)a.z };
+    i_vector_t im = { (int16_t)m.x, (int16_t)m.y, (int16_t)m.z };
+
+    // shift and correct, as in compass.c
+    float d[3] = { m.x - mag.fOffset[0], m.y - mag.fOffset[1], m.z - mag.fOffset[2] };
+    float *pm = &m.x;
+
+    for ( int k=0; k<3; ++k )
+      pm[k] = mag.fMatrix[k][0] * d[0] + mag.fMatrix[k][1] * d[1]
+            + mag.fMatrix[k][2] * d[2];
+
+    int heading_float = GetHeading3D( &a, &m, &p );
+    int heading_fix = FixGetHeading3D( &calib, &ia, &im );
+
+    int diff = abs( heading_fix - heading_float );
+    if ( diff > 180 ) diff = 360 - diff;
+
+    if ( diff ) {
+      n_diff++;
+      if ( verbose )
+        cout << "  frame " << i << ": float= " << heading_float
+             << " fix= " << heading_fix << endl;
+    }
+
+    if ( diff > max_diff ) max_diff = diff;
+  }
+
+  cout << "  " << frames.size() << " frames, " << n_diff
+       << " differ, maximum difference " << max_diff << " degree(s)" << endl;
+
+  return max_diff;
+}
+
+// ---------------------------------------------------------------------------
+
+// compare one batch kernel with GetHeading3D(),
+// returns the maximum difference in degrees
+static int CompareBatch(const char *name,batch_kernel_t kernel,
+                        const vector<Frame> &frames,
+                        const vector_t &m_min,const vector_t &m_max,
+                        bool verbose)
+ {
+  vector_t p = {0, -1, 0}; // X: to the right, Y: backward, Z: down
+
+  batch_calib_t calib;
+  HeadingBatchInit( &calib, &m_min, &m_max );
+
+  sample_soa_t samples;
+  for ( size_t i=0; i<frames.size(); ++i )
+    samples.Add( &frames[i].fA, &frames[i].fM );
+
+  vector<int> heading_batch( frames.size() );
+  kernel( &calib, &samples, 0, samples.Size(), &heading_batch[0] );
+
+  int max_diff = 0;
+  unsigned int n_diff = 0;
+
+  for ( size_t i=0; i<frames.size(); ++i ) {
+
+    vector_t a = frames[i].fA;
+    vector_t m = frames[i].fM;
+
+    m.x = (m.x - m_min.x) / (m_max.x - m_min.x) * 2 - 1.0;
+    m.y = (m.y - m_min.y) / (m_max.y - m_min.y) * 2 - 1.0;
+    m.z = (m.z - m_min.z) / (m_max.z - m_min.z) * 2 - 1.0;
+
+    int heading_float = GetHeading3D( &a, &m, &p );
+
+    int diff = abs( heading_batch[i] - heading_float );
+    if ( diff > 180 ) diff = 360 - diff;
+
+    if ( diff ) {
+      n_diff++;
+      if ( verbose )
+        cout << "  frame " << i << ": float= " << heading_float
+             << " " << name << "= " << heading_batch[i] << endl;
+    }
+
+    if ( diff > max_diff ) max_diff = diff;
+  }
+
+  cout << "  " << name << ": " << frames.size() << " frames, " << n_diff
+       << " differ, maximum difference " << max_diff << " degree(s)" << endl;
+
+  return max_diff;
+}
+
+// ---------------------------------------------------------------------------
+
+static int CompareAll(const vector<Frame> &frames,
+                      const vector_t &m_min,const vector_t &m_max,bool verbose)
+ {
+  mag_calib_t mag;
+  MagCalibInit( &mag, &m_min, &m_max );
+
+  cout << "  min= " << m_min.x << " " << m_min.y << " " << m_min.z
+       << "  max= " << m_max.x << " " << m_max.y << " " << m_max.z << endl;
+
+  int max_diff = CompareHeadings( frames, mag, verbose );
+
+  int diff = CompareBatch( "scalar", HeadingBatchScalar,
+                           frames, m_min, m_max, verbose );
+  if ( diff > max_diff ) max_diff = diff;
+
+#ifdef BATCH_HEADING_AVX2
+  if ( !strcmp( GetHeading3DBatchName(), "avx2" ) ) {
+    diff = CompareBatch( "avx2", HeadingBatchAVX2, frames, m_min, m_max, verbose );
+    if ( diff > max_diff ) max_diff = diff;
+  }
+  else
+    cout << "  avx2: not supported by this CPU" << endl;
+#endif // BATCH_HEADING_AVX2
+
+  return max_diff;
+}
+
+// ---------------------------------------------------------------------------
+
+// send all frames as binary frames (../LSM303/binframe.c) through
+// ReadBinaryFormat(), once unchanged and once with one corrupted byte each,
+// returns the number of errors
+static unsigned int CheckBinaryFrames(const vector<Frame> &frames)
+ {
+  bin_decoder_t decoder;
+  BinFrameInit( &decoder );
+
+  unsigned int n_errors = 0;
+
+  for ( size_t i=0; i<frames.size(); ++i ) {
+
+    const vector_t &a = frames[i].fA, &m = frames[i].fM;
+
+    bin_frame_t frame = { (uint8_t)i, { (int16_t)a.x, (int16_t)a.y, (int16_t)a.z,
+                                         (int16_t)m.x, (int16_t)m.y, (int16_t)m.z } };
+
+    uint8_t buffer[BINFRAME_SIZE];
+    uint8_t length = BinFrameEncode( &frame, buffer );
+
+    for ( int corrupt=0; corrupt<2; ++corrupt ) {
+
+      if ( corrupt ) buffer[1 + i % (length-2)] ^= 1 << (i % 8);
+
+      vector_t ra = { 0, 0, 0 }, rm = { 0, 0, 0 };
+      int sequence = -1, n_frames = 0;
+
+      for ( uint8_t j=0; j<length; ++j )
+        n_frames += ReadBinaryFormat( &decoder, buffer[j], &ra, &rm, &sequence );
+
+      bool ok = corrupt ? n_frames == 0
+                        : n_frames == 1 && sequence == (int)(i & 0xff)
+                          && ra.x == a.x && ra.y == a.y && ra.z == a.z
+                          && rm.x == m.x && rm.y == m.y && rm.z == m.z;
+
+      if ( !ok ) n_errors++;
+    }
+  }
+
+  cout << "  binary frames: " << frames.size() << " frames, "
+       << n_errors << " error(s)" << endl;
+
+  return n_errors;
+}
+
+// ---------------------------------------------------------------------------
+
+/** Samples on each side of the centered reference average. */
+static const int kReferenceHalfWidth = 5;
+
+/** Rate [deg/sample] of the reference above which the rotator turns. */
+static const double kReferenceRate = 0.3;
+
+// 'heading' shifted by 'lag' samples of the reference, unwrapped to 'near'
+static double Unwrap(double heading,double near)
+ {
+  return heading + 360. * floor( (near - heading) / 360. + 0.5 );
+ }
+
+// lag [samples] of 'filtered' where it matches the shifted reference best,
+// the RMS of the difference there ('noise'), over the samples 'use'
+static double FilterLag(const vector<double> &reference,const vector<int> &filtered,
+                        const vector<bool> &use,double *noise)
+ {
+  double best_lag = 0., best_rms = 1e30;
+
+  for ( int k=0; k<=100; ++k ) {
+
+    double lag = 0.1 * k, sum = 0.;
+    size_t n = 0;
+
+    for ( size_t i=0; i<filtered.size(); ++i ) {
+
+      double t = i - lag;
+      if ( !use[i] || t < 0. ) continue;
+
+      size_t j = (size_t)t;
+      double f = t - j;
+      double r = reference[j] + (j+1 < reference.size() ? f * (reference[j+1] - reference[j]) : 0.);
+      double d = filtered[i] - Unwrap( r, filtered[i] );
+
+      sum += d * d;
+      n++;
+    }
+
+    double rms = n ? sqrt( sum / n ) : 1e30;
+
+    if ( rms < best_rms ) {
+      best_rms = rms;
+      best_lag = lag;
+    }
+  }
+
+  *noise = best_rms;
+
+  return best_lag;
+ }
+
+// RMS [deg] of the difference of 'filtered' to the reference, samples 'use'
+static double FilterNoise(const vector<double> &reference,const vector<int> &filtered,
+                          const vector<bool> &use)
+ {
+  double sum = 0.;
+  size_t n = 0;
+
+  for ( size_t i=0; i<filtered.size(); ++i ) {
+    if ( !use[i] ) continue;
+    double d = filtered[i] - Unwrap( reference[i], filtered[i] );
+    sum += d * d;
+    n++;
+  }
+
+  return n ? sqrt( sum / n ) : 0.;
+ }
+
+// lag and noise of the moving average and of the tracker (before the
+// 5 degree steps of compass.c), returns false if the tracker lags more
+static bool CompareFilters(const vector<Frame> &frames,
+                           const vector_t &m_min,const vector_t &m_max)
+ {
+  mag_calib_t mag;
+  MagCalibInit( &mag, &m_min, &m_max );
+
+  fix_calib_t calib;
+  FixHeadingInit( &calib, &mag );
+
+  size_t n = frames.size();
+  vector<int> raw( n );
+
+  for ( size_t i=0; i<n; ++i ) {
+    const vector_t &a = frames[i].fA, &m = frames[i].fM;
+    i_vector_t ia = { (int16_t)a.x, (int16_t)a.y, (int16_t)a.z };
+    i_vector_t im = { (int16_t)m.x, (int16_t)m.y, (int16_t)m.z };
+    raw[i] = FixGetHeading3D( &calib, &ia, &im );
+  }
+
+  // centered average of the unwrapped headings and the motion from it
+  vector<double> unwrapped( n ), reference( n );
+  vector<uint8_t> motion( n );
+  vector<bool> turning( n ), stopped( n );
+
+  unwrapped[0] = raw[0];
+  for ( size_t i=1; i<n; ++i ) unwrapped[i] = Unwrap( raw[i], unwrapped[i-1] );
+
+  const int h = kReferenceHalfWidth;
+
+  for ( size_t i=0; i<n; ++i ) {
+
+    size_t lo = i >= (size_t)h ? i - h : 0, hi = min( n - 1, i + h );
+    double sum = 0.;
+
+    for ( size_t j=lo; j<=hi; ++j ) sum += unwrapped[j];
+
+    reference[i] = sum / (hi - lo + 1);
+  }
+
+  for ( size_t i=0; i<n; ++i ) {
+
+    size_t lo = i >= (size_t)h ? i - h : 0, hi = min( n - 1, i + h );
+    double rate = (reference[hi] - reference[lo]) / max( (size_t)1, hi - lo );
+
+    motion[i] = rate > kReferenceRate ? kHeadingCW
+                : rate < -kReferenceRate ? kHeadingCCW : kHeadingStopped;
+
+    // the edges of the reference are not centered
+    bool inner = i >= (size_t)(2*h) && i + 2*h < n;
+
+    turning[i] = inner && motion[i] != kHeadingStopped;
+    stopped[i] = inner && motion[i] == kHeadingStopped;
+  }
+
+  heading_filter_t filter;
+  heading_tracker_t tracker;
+
+  HeadingFilterInit( &filter, HEADING_FILTER_DEFAULT );
+  HeadingTrackerInit( &tracker );
+
+  vector<int> average( n ), tracked( n );
+
+  for ( size_t i=0; i<n; ++i ) {
+    average[i] = HeadingFilterAdd( &filter, raw[i] );
+    tracked[i] = HeadingTrackerAdd( &tracker, raw[i], motion[i] );
+  }
+
+  double noise_average, noise_tracked;
+  double lag_average = FilterLag( reference, average, turning, &noise_average );
+  double lag_tracked = FilterLag( reference, tracked, turning, &noise_tracked );
+
+  size_t n_turning = 0, n_stopped = 0;
+  for ( size_t i=0; i<n; ++i ) {
+    n_turning += turning[i];
+    n_stopped += stopped[i];
+  }
+
+  cout << "  " << n_turning << " frames turning, " << n_stopped << " stopped (100 ms each)" << endl;
+
+  // e.g. a fixed position, no lag to compare
+  if ( !n_turning ) {
+    printf( "  average(%d): noise %.2f deg stopped\n", HEADING_FILTER_DEFAULT,
+            FilterNoise( reference, average, stopped ) );
+    printf( "  tracker:    noise %.2f deg stopped\n",
+            FilterNoise( reference, tracked, stopped ) );
+    return true;
+  }
+
+  printf( "  average(%d): lag %4.0f ms, noise %.2f deg turning, %.2f deg stopped\n",
+          HEADING_FILTER_DEFAULT, 100. * lag_average, noise_average,
+          FilterNoise( reference, average, stopped ) );
+  printf( "  tracker:    lag %4.0f ms, noise %.2f deg turning, %.2f deg stopped\n",
+          100. * lag_tracked, noise_tracked, FilterNoise( reference, tracked, stopped ) );
+  printf( "  raw:        lag %4.0f ms, noise %.2f deg turning\n",
+          100. * FilterLag( reference, raw, turning, &noise_average ), noise_average );
+
+  return lag_tracked < lag_average;
+ }
+
+// ---------------------------------------------------------------------------
+
+static double Seconds()
+ {
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+// time GetHeading3D() and the batch kernels on 'n' samples (repeated frames)
+static void Benchmark(const vector<Frame> &frames,
+                      const vector_t &m_min,const vector_t &m_max,size_t n)
+ {
+  vector_t p = {0, -1, 0};
+
+  sample_soa_t samples;
+  for ( size_t i=0; i<n; ++i )
+    samples.Add( &frames[i % frames.size()].fA, &frames[i % frames.size()].fM );
+
+  vector<int> heading( n );
+  long sum = 0;
+
+  double t0 = Seconds();
+
+  for ( size_t i=0; i<n; ++i ) {
+
+    vector_t a = frames[i % frames.size()].fA;
+    vector_t m = frames[i % frames.size()].fM;
+
+    m.x = (m.x - m_min.x) / (m_max.x - m_min.x) * 2 - 1.0;
+    m.y = (m.y - m_min.y) / (m_max.y - m_min.y) * 2 - 1.0;
+    m.z = (m.z - m_min.z) / (m_max.z - m_min.z) * 2 - 1.0;
+
+    sum += GetHeading3D( &a, &m, &p );
+  }
+
+  double t_float = Seconds() - t0;
+
+  cout << "  GetHeading3D(): " << 1e9 * t_float / n << " ns/sample" << endl;
+
+  batch_calib_t calib;
+  HeadingBatchInit( &calib, &m_min, &m_max );
+
+  t0 = Seconds();
+  HeadingBatchScalar( &calib, &samples, 0, n, &heading[0] );
+  double t_batch = Seconds() - t0;
+
+  cout << "  scalar: " << 1e9 * t_batch / n << " ns/sample" << endl;
+
+#ifdef BATCH_HEADING_AVX2
+  if ( !strcmp( GetHeading3DBatchName(), "avx2" ) ) {
+    t0 = Seconds();
+    HeadingBatchAVX2( &calib, &samples, 0, n, &heading[0] );
+    t_batch = Seconds() - t0;
+
+    cout << "  avx2: " << 1e9 * t_batch / n << " ns/sample" << endl;
+  }
+#endif // BATCH_HEADING_AVX2
+
+  for ( size_t i=0; i<n; ++i ) sum -= heading[i];
+
+  // keeps the compiler from dropping the float loop, should be small
+  cout << "  sum of differences: " << sum << endl;
+}
+
+// ---------------------------------------------------------------------------
+
+int main(int argc,char **argv)
+ {
+  string input_filename("360-turn-nmea.dat");
+  bool verbose = false;
+  size_t n_benchmark = 0;
+
+  int getopt_status;
+
+  while ( (getopt_status = getopt( argc, argv, "b:hi:v?" )) != EOF ) {
+
+    switch ( getopt_status ) {
+
+      case 'i': input_filename = optarg;
+                break;
+
+      case 'v': verbose = true;
+                break;
+
+      case 'b': n_benchmark = strtoul( optarg, NULL, 0 );
+                break;
+
+      case 'h':
+      case '?':
+      default:  Usage(argv[0]);
+                exit( EXIT_FAILURE );
+    }
+  }
+
+  FILE *file = fopen( input_filename.c_str(), "r" );
+  if ( !file ) {
+    cerr << argv[0] << ": error opening file " << input_filename << "!" << endl;
+    exit( EXIT_FAILURE );
+  }
+
+  vector<Frame> frames;
+
+  vector_t m_min = {  99999,  99999,  99999 };
+  vector_t m_max = { -99999, -99999, -99999 };
+
+  Frame frame;
+  EllipsoidFit fit;
+
+  while ( ReadNMEAFormat( file, &frame.fA, &frame.fM ) ) {
+
+    frames.push_back( frame );
+    fit.Add( frame.fM );
+
+    if ( frame.fM.x < m_min.x ) m_min.x = frame.fM.x;
+    if ( frame.fM.x > m_max.x ) m_max.x = frame.fM.x;
+    if ( frame.fM.y < m_min.y ) m_min.y = frame.fM.y;
+    if ( frame.fM.y > m_max.y ) m_max.y = frame.fM.y;
+    if ( frame.fM.z < m_min.z ) m_min.z = frame.fM.z;
+    if ( frame.fM.z > m_max.z ) m_max.z = frame.fM.z;
+  }
+
+  fclose( file );
+
+  if ( frames.empty() ) {
+    cerr << argv[0] << ": no frames found in " << input_filename << "!" << endl;
+    exit( EXIT_FAILURE );
+  }
+
+  cout << input_filename << ": default calibration" << endl;
+  int max_diff = CompareAll( frames, gMinDefault_MAG, gMaxDefault_MAG, verbose );
+
+  cout << input_filename << ": calibration from data" << endl;
+  int diff = CompareAll( frames, m_min, m_max, verbose );
+  if ( diff > max_diff ) max_diff = diff;
+
+  // the ellipsoid, or the ellipse for the data of a rotator (magcalib.cc)
+  mag_calib_t mag;
+  bool plane = false, fitted = fit.Solve( &mag, false );
+
+  if ( !fitted ) fitted = plane = fit.Solve( &mag, true );
+
+  if ( fitted ) {
+    cout << input_filename << ": fitted calibration ("
+         << (plane ? "ellipse" : "ellipsoid") << ")" << endl;
+    diff = CompareHeadings( frames, mag, verbose );
+    if ( diff > max_diff ) max_diff = diff;
+  }
+
+  cout << input_filename << ": transmission" << endl;
+  unsigned int n_errors = CheckBinaryFrames( frames );
+
+  cout << input_filename << ": heading filters" << endl;
+  if ( !CompareFilters( frames, gMinDefault_MAG, gMaxDefault_MAG ) ) n_errors++;
+
+  if ( n_benchmark ) {
+    cout << input_filename << ": benchmark, " << n_benchmark << " samples" << endl;
+    Benchmark( frames, m_min, m_max, n_benchmark );
+  }
+
+  if ( max_diff > 1 || n_errors ) {
+    cout << "FAILED" << endl;
+    exit( EXIT_FAILURE );
+  }
+
+  cout << "OK" << endl;
+
+  exit( EXIT_SUCCESS );
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
@@ -0,0 +1,44 @@
+/*
+ * File   : avr/eeprom.h
+ *
+ * Purpose: Virtual hardware for the host build of the controller firmware,
+ *          replaces the avr-libc header of the same name.
+ *
+ */
+
+#ifndef _hostsim_avr_eeprom_h_
+#define _hostsim_avr_eeprom_h_
+
+/** @file avr/eeprom.h
+  * EEMEM variables are ordinary variables on the host, initialized with
+  * the same values which go into the .eep image. The access functions are
+  * implemented in rotorsim.c, where also the write cycles are counted.
+  */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define EEMEM
+
+extern uint8_t eeprom_read_byte(const uint8_t *addr);
+extern uint16_t eeprom_read_word(const uint16_t *addr);
+extern uint32_t eeprom_read_dword(const uint32_t *addr);
+extern float eeprom_read_float(const float *addr);
+extern void eeprom_read_block(void *dst,const void *src,size_t n);
+
+extern void eeprom_write_byte(uint8_t *addr,uint8_t value);
+extern void eeprom_write_word(uint16_t *addr,uint16_t value);
+extern void eeprom_write_dword(uint32_t *addr,uint32_t value);
+extern void eeprom_write_float(float *addr,float value);
+extern void eeprom_write_block(const void *src,void *dst,size_t n);
+
+extern void eeprom_update_byte(uint8_t *addr,uint8_t value);
+extern void eeprom_update_word(uint16_t *addr,uint16_t value);
+extern void eeprom_update_dword(uint32_t *addr,uint32_t value);
+extern void eeprom_update_float(float *addr,float value);
+extern void eeprom_update_block(const void *src,void *dst,size_t n);
+
+#define eeprom_is_ready()    (1)
+#define eeprom_busy_wait()   do {} while (0)
+
+#endif /* _hostsim_avr_eeprom_h_ */
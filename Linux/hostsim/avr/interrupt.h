@@ -0,0 +1,30 @@
+/*
+ * File   : avr/interrupt.h
+ *
+ * Purpose: Virtual hardware for the host build of the controller firmware,
+ *          replaces the avr-libc header of the same name.
+ *
+ */
+
+#ifndef _hostsim_avr_interrupt_h_
+#define _hostsim_avr_interrupt_h_
+
+/** @file avr/interrupt.h
+  * Interrupt vectors become ordinary functions which are called by the
+  * simulation backend whenever the simulated clock passes an event.
+  */
+
+#include "hostsim.h"
+
+#define ISR(vector)       void vector(void)
+
+#define TIMER0_OVF_vect   SimTimer0OvfVect
+#define TWI_vect          SimTwiVect
+
+extern void SimTimer0OvfVect(void);
+extern void SimTwiVect(void);
+
+#define sei()             SimSei()
+#define cli()             SimCli()
+
+#endif /* _hostsim_avr_interrupt_h_ */
@@ -0,0 +1,83 @@
+/*
+ * File   : avr/io.h
+ *
+ * Purpose: Virtual hardware for the host build of the controller firmware,
+ *          replaces the avr-libc header of the same name.
+ *
+ */
+
+#ifndef _hostsim_avr_io_h_
+#define _hostsim_avr_io_h_
+
+/** @file avr/io.h
+  * I/O registers of the ATmega32 as plain variables. Only those registers
+  * which are used by the firmware are provided, they are read and written
+  * by the simulation backend in rotorsim.c.
+  */
+
+#include <stdint.h>
+
+#include "hostsim.h"
+
+extern volatile uint8_t PORTA, PINA, DDRA;
+extern volatile uint8_t PORTB, PINB, DDRB;
+extern volatile uint8_t PORTC, PINC, DDRC;
+extern volatile uint8_t PORTD, PIND, DDRD;
+
+extern volatile uint8_t TCNT0, TCCR0, TIMSK;
+
+/* TWI: a write of TWCR with TWINT set is executed by rotorsim.c, the end
+   of an operation is only signalled by TWI_vect (TWINT reads as 0) */
+extern volatile uint8_t TWBR, TWSR, TWDR, TWCR;
+
+#define PA0 0
+#define PA1 1
+#define PA2 2
+#define PA3 3
+#define PA4 4
+#define PA5 5
+#define PA6 6
+#define PA7 7
+
+#define PB0 0
+#define PB1 1
+#define PB2 2
+#define PB3 3
+#define PB4 4
+#define PB5 5
+#define PB6 6
+#define PB7 7
+
+#define PC0 0
+#define PC1 1
+#define PC2 2
+#define PC3 3
+#define PC4 4
+#define PC5 5
+#define PC6 6
+#define PC7 7
+
+#define PD0 0
+#define PD1 1
+#define PD2 2
+#define PD3 3
+#define PD4 4
+#define PD5 5
+#define PD6 6
+#define PD7 7
+
+#define CS00 0
+#define CS01 1
+#define CS02 2
+
+#define TOIE0 0
+
+#define TWIE  0
+#define TWEN  2
+#define TWWC  3
+#define TWSTO 4
+#define TWSTA 5
+#define TWEA  6
+#define TWINT 7
+
+#endif /* _hostsim_avr_io_h_ */
@@ -0,0 +1,37 @@
+/*
+ * File   : avr/pgmspace.h
+ *
+ * Purpose: Virtual hardware for the host build of the controller firmware,
+ *          replaces the avr-libc header of the same name.
+ *
+ */
+
+#ifndef _hostsim_avr_pgmspace_h_
+#define _hostsim_avr_pgmspace_h_
+
+/** @file avr/pgmspace.h
+  * There is only one address space on the host, PROGMEM data is read
+  * directly.
+  */
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+
+#define PSTR(s)              (s)
+
+static inline uint8_t pgm_read_byte(const void *addr)
+ { return *(const uint8_t *)addr; }
+static inline uint16_t pgm_read_word(const void *addr)
+ { uint16_t w; memcpy( &w, addr, sizeof(w) ); return w; }
+static inline uint32_t pgm_read_dword(const void *addr)
+ { uint32_t d; memcpy( &d, addr, sizeof(d) ); return d; }
+static inline float pgm_read_float(const void *addr)
+ { float f; memcpy( &f, addr, sizeof(f) ); return f; }
+
+#define memcpy_P(d,s,n)      memcpy(d,s,n)
+#define strcpy_P(d,s)        strcpy(d,s)
+#define strlen_P(s)          strlen(s)
+
+#endif /* _hostsim_avr_pgmspace_h_ */
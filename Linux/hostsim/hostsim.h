@@ -0,0 +1,35 @@
+/*
+ * File   : hostsim.h
+ *
+ * Purpose: Interface between the virtual hardware headers and the
+ *          simulation backend in rotorsim.c.
+ *
+ */
+
+#ifndef _hostsim_h_
+#define _hostsim_h_
+
+/** @file hostsim.h
+  * Interface between the virtual hardware headers and the simulation
+  * backend in rotorsim.c.
+  */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Enable interrupts globally (sei()). */
+extern void SimSei(void);
+/** Disable interrupts globally (cli()). */
+extern void SimCli(void);
+
+/** Let the simulated clock run for the given time, timer interrupts are
+  * serviced meanwhile.
+  */
+extern void SimDelayUs(double us);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _hostsim_h_ */
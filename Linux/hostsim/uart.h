@@ -0,0 +1,43 @@
+/*
+ * File   : uart.h
+ *
+ * Purpose: Virtual hardware for the host build of the controller firmware,
+ *          replaces the header of P.Fleury's UART library.
+ *
+ */
+
+#ifndef _hostsim_uart_h_
+#define _hostsim_uart_h_
+
+/** @file uart.h
+  * Same interface as P.Fleury's interrupt driven UART library. The RX side
+  * is fed from a replay file at the simulated baud rate, the TX side is
+  * drained at the same rate, see rotorsim.c.
+  */
+
+#include <avr/pgmspace.h>
+
+#ifndef UART_RX_BUFFER_SIZE
+#define UART_RX_BUFFER_SIZE 32
+#endif
+#ifndef UART_TX_BUFFER_SIZE
+#define UART_TX_BUFFER_SIZE 32
+#endif
+
+#define UART_BAUD_SELECT(baudRate,xtalCpu) \
+          (((xtalCpu) + 8UL * (baudRate)) / (16UL * (baudRate)) -1UL)
+
+#define UART_FRAME_ERROR      0x0800
+#define UART_OVERRUN_ERROR    0x0400
+#define UART_BUFFER_OVERFLOW  0x0200
+#define UART_NO_DATA          0x0100
+
+extern void uart_init(unsigned int baudrate);
+extern unsigned int uart_getc(void);
+extern void uart_putc(unsigned char data);
+extern void uart_puts(const char *s);
+extern void uart_puts_p(const char *s);
+
+#define uart_puts_P(__s)      uart_puts_p(PSTR(__s))
+
+#endif /* _hostsim_uart_h_ */
@@ -0,0 +1,28 @@
+/*
+ * File   : util/crc16.h
+ *
+ * Purpose: Virtual hardware for the host build of the controller firmware,
+ *          replaces the avr-libc header of the same name.
+ *
+ */
+
+#ifndef _hostsim_util_crc16_h_
+#define _hostsim_util_crc16_h_
+
+/** @file util/crc16.h
+  * The C equivalent of the inline assembler of avr-libc, also used by the
+  * host tools which read or write EEPROM images.
+  */
+
+#include <stdint.h>
+
+static inline uint16_t _crc_ccitt_update(uint16_t crc,uint8_t data)
+ {
+  data ^= crc & 0xff;
+  data ^= data << 4;
+
+  return ((((uint16_t)data << 8) | (crc >> 8)) ^ (uint8_t)(data >> 4)
+          ^ ((uint16_t)data << 3));
+}
+
+#endif /* _hostsim_util_crc16_h_ */
@@ -0,0 +1,21 @@
+/*
+ * File   : util/delay.h
+ *
+ * Purpose: Virtual hardware for the host build of the controller firmware,
+ *          replaces the avr-libc header of the same name.
+ *
+ */
+
+#ifndef _hostsim_util_delay_h_
+#define _hostsim_util_delay_h_
+
+/** @file util/delay.h
+  * Busy waits advance the simulated clock instead of burning CPU time.
+  */
+
+#include "hostsim.h"
+
+#define _delay_ms(ms)     SimDelayUs( (double)(ms) * 1000.0 )
+#define _delay_us(us)     SimDelayUs( (double)(us) )
+
+#endif /* _hostsim_util_delay_h_ */
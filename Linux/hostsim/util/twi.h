@@ -0,0 +1,34 @@
+/*
+ * File   : util/twi.h
+ *
+ * Purpose: Virtual hardware for the host build of the controller firmware,
+ *          replaces the avr-libc header of the same name.
+ *
+ */
+
+#ifndef _hostsim_util_twi_h_
+#define _hostsim_util_twi_h_
+
+/** @file util/twi.h
+  * Status codes of the TWI in master transmitter mode, as set in TWSR by
+  * the simulation backend in rotorsim.c.
+  */
+
+#include <avr/io.h>
+
+#define TW_START          0x08
+#define TW_REP_START      0x10
+#define TW_MT_SLA_ACK     0x18
+#define TW_MT_SLA_NACK    0x20
+#define TW_MT_DATA_ACK    0x28
+#define TW_MT_DATA_NACK   0x30
+#define TW_MT_ARB_LOST    0x38
+#define TW_BUS_ERROR      0x00
+
+#define TW_STATUS_MASK    0xf8
+#define TW_STATUS         (TWSR & TW_STATUS_MASK)
+
+#define TW_READ           1
+#define TW_WRITE          0
+
+#endif /* _hostsim_util_twi_h_ */
@@ -0,0 +1,490 @@
+//
+// File   : logreader.cc
+//
+// Purpose: Fast reader for logged data of the LSM303DLH sensor
+//
+// $Id$
+//
+
+
+/** @file logreader.cc
+  * Fast reader for logged data of the LSM303DLH sensor.
+  *
+  * Regular files are mapped into memory, streams are read through a line
+  * buffer. The lines are parsed in place by hand written integer parsers,
+  * nothing is copied and no sscanf() is involved. Both formats of lsm303read.c are detected automatically:
+  *
+  * @li NMEA:  "$ACRAW,acx,acy,acz,mx,my,mz*CHECKSUM" (checksum verified)
+  * @li tags:  "ADATA acx acy acz" followed by "MDATA mx my mz"
+  *
+  * Lines which cannot be parsed are counted, but skipped.
+  */
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// ---------------------------------------------------------------------------
+
+/** Result of parsing a single line. */
+enum ELineStatus {
+
+  kLineSample = 0,      // complete data
+  kLineIgnored,         // empty line or status message ($ACOK, READY, ...)
+  kLineMalformed,       // garbage, incomplete line, value out of range
+  kLineChecksum,        // NMEA sentence with wrong checksum
+
+};
+
+// ---------------------------------------------------------------------------
+
+/** Parse a (signed) decimal integer which must fit into int16_t.
+  *
+  * @return pointer behind the last digit or NULL
+  */
+static inline const char *ParseInt16(const char *p,const char *end,int16_t *value)
+ {
+  bool negative = false;
+
+  if ( p < end && *p == '-' ) {
+    negative = true;
+    p++;
+  }
+
+  if ( p == end || *p < '0' || *p > '9' ) return NULL;
+
+  int32_t v = 0;
+
+  while ( p < end && *p >= '0' && *p <= '9' ) {
+    v = 10 * v + (*p++ - '0');
+    if ( v > 32768 ) return NULL;
+  }
+
+  if ( negative ) v = -v;
+  if ( v > 32767 ) return NULL;
+
+  *value = (int16_t)v;
+
+  return p;
+}
+
+// ---------------------------------------------------------------------------
+
+static inline int HexDigit(char c)
+ {
+  if ( c >= '0' && c <= '9' ) return c - '0';
+  if ( c >= 'A' && c <= 'F' ) return c - 'A' + 10;
+  if ( c >= 'a' && c <= 'f' ) return c - 'a' + 10;
+  return -1;
+}
+
+// ---------------------------------------------------------------------------
+
+static inline bool IsBlank(const char *p,const char *end)
+ {
+  while ( p < end ) {
+    if ( *p != ' ' && *p != '\t' && *p != '\r' ) return false;
+    p++;
+  }
+
+  return true;
+}
+
+// ---------------------------------------------------------------------------
+
+/** Parse a "$ACRAW,acx,acy,acz,mx,my,mz*CHECKSUM" sentence, the line may
+  * contain leading garbage (minicom logs).
+  *
+  * Older versions of lsm303read.c send the checksum nibbles swapped, thus
+  * both orders are accepted, see also compass.c.
+  */
+static ELineStatus ParseNMEALine(const char *line,const char *end,int16_t value[6])
+ {
+  const char *p = (const char *)memchr( line, '$', end - line );
+
+  if ( !p ) return IsBlank( line, end ) ? kLineIgnored : kLineMalformed;
+
+  p++;
+
+  if ( end - p < 6 || memcmp( p, "ACRAW,", 6 ) ) {
+    // $ACOK, $ACERR
+    if ( end - p >= 4 && !memcmp( p, "AC", 2 ) ) return kLineIgnored;
+    return kLineMalformed;
+  }
+
+  const char *start = p;
+  p += 6;
+
+  for ( int i=0; i<6; ++i ) {
+
+    if ( !(p = ParseInt16( p, end, &value[i] )) ) return kLineMalformed;
+
+    if ( p == end || *p != (i < 5 ? ',' : '*') ) return kLineMalformed;
+    p++;
+  }
+
+  if ( end - p < 2 ) return kLineMalformed;
+
+  int hi = HexDigit( p[0] ), lo = HexDigit( p[1] );
+  if ( hi < 0 || lo < 0 ) return kLineMalformed;
+
+  if ( !IsBlank( p + 2, end ) ) return kLineMalformed;
+
+  uint8_t checksum = 0;
+  for ( const char *c = start; *c != '*'; ++c ) checksum ^= *c;
+
+  uint8_t checksum_rx = (hi << 4) | lo;
+
+  if ( checksum_rx != checksum
+       && checksum_rx != (uint8_t)((checksum << 4) | (checksum >> 4)) )
+    return kLineChecksum;
+
+  return kLineSample;
+}
+
+// ---------------------------------------------------------------------------
+
+/** Parse a "ADATA x y z" or "MDATA x y z" line.
+  *
+  * @param tag set to 'A' or 'M'
+  */
+static ELineStatus ParseTagLine(const char *line,const char *end,
+                                char *tag,int16_t value[3])
+ {
+  const char *p = line;
+
+  if ( IsBlank( p, end ) ) return kLineIgnored;
+
+  if ( end - p < 6 || (p[0] != 'A' && p[0] != 'M') || memcmp( p+1, "DATA ", 5 ) ) {
+    // status messages of lsm303read.c
+    if ( (end - p >= 5 && !memcmp( p, "READY", 5 ))
+         || (end - p >= 5 && !memcmp( p, "ERROR", 5 )) ) return kLineIgnored;
+    return kLineMalformed;
+  }
+
+  *tag = p[0];
+  p += 6;
+
+  for ( int i=0; i<3; ++i ) {
+
+    while ( p < end && *p == ' ' ) p++;
+
+    if ( !(p = ParseInt16( p, end, &value[i] )) ) return kLineMalformed;
+  }
+
+  return IsBlank( p, end ) ? kLineSample : kLineMalformed;
+}
+
+// ---------------------------------------------------------------------------
+
+/** Reader for a log file.
+  *
+  * Regular files are mapped into memory, anything else (stdin "-", pipes,
+  * FIFOs, serial devices) is read through a fixed size line buffer, thus
+  * also endless streams like 'tail -f lsm303-nmea.dat | ...' can be read.
+  */
+class LogReader {
+
+ public:
+
+  enum EFormat {
+
+    kFormatUnknown = 0,
+    kFormatNMEA,
+    kFormatTag,
+
+  };
+
+  /** Size of the line buffer for streams, longer lines are malformed. */
+  static const size_t kBufferSize = 64 * 1024;
+
+  LogReader()
+   : fFd(-1), fMapped(false), fEOF(false), fBuffer(NULL),
+     fData(NULL), fDataEnd(NULL), fPos(NULL), fFormat(kFormatUnknown)
+   { ClearCounters(); }
+
+  ~LogReader() { Close(); }
+
+  /** Open the file ("-" is stdin) and detect its format. */
+  bool Open(const char *filename)
+   {
+    Close();
+
+    if ( !strcmp( filename, "-" ) )
+      fFd = STDIN_FILENO;
+    else
+      fFd = open( filename, O_RDONLY );
+
+    if ( fFd < 0 ) return false;
+
+    struct stat st;
+    if ( fstat( fFd, &st ) < 0 ) {
+      Close();
+      return false;
+    }
+
+    void *data = MAP_FAILED;
+
+    if ( S_ISREG(st.st_mode) && st.st_size > 0 )
+      data = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fFd, 0 );
+
+    if ( data != MAP_FAILED ) {
+
+      madvise( data, st.st_size, MADV_SEQUENTIAL );
+
+      fMapped = true;
+      fEOF = true;
+      fData = (const char *)data;
+      fDataEnd = fData + st.st_size;
+    }
+    else {
+      fBuffer = new char[kBufferSize];
+      fData = fDataEnd = fBuffer;
+    }
+
+    fPos = fData;
+
+    fFormat = DetectFormat();
+
+    return true;
+  }
+
+  void Close()
+   {
+    if ( fMapped ) munmap( (void *)fData, fDataEnd - fData );
+    if ( fFd > STDIN_FILENO ) close( fFd );
+
+    delete [] fBuffer;
+
+    fFd = -1;
+    fMapped = fEOF = false;
+    fBuffer = NULL;
+    fData = fDataEnd = fPos = NULL;
+    fFormat = kFormatUnknown;
+  }
+
+  /** Start again at the beginning, the counters are cleared.
+    *
+    * @return false for streams, they can only be read once
+    */
+  bool Rewind()
+   {
+    if ( !fMapped ) return false;
+
+    fPos = fData;
+    ClearCounters();
+
+    return true;
+  }
+
+  /** Read the next complete sample, returns false at the end of file. */
+  bool Read(vector_t *a,vector_t *m)
+   {
+    const char *line, *end;
+
+    while ( NextLine( &line, &end ) ) {
+
+      ELineStatus status;
+      int16_t v[6];
+
+      if ( fFormat == kFormatNMEA ) {
+
+        status = ParseNMEALine( line, end, v );
+
+        if ( status == kLineSample ) {
+          a->x = v[0]; a->y = v[1]; a->z = v[2];
+          m->x = v[3]; m->y = v[4]; m->z = v[5];
+          fSamples++;
+          return true;
+        }
+      }
+      else if ( fFormat == kFormatTag ) {
+
+        char tag = 0;
+
+        status = ParseTagLine( line, end, &tag, v );
+
+        if ( status == kLineSample ) {
+
+          if ( tag == 'A' ) {
+            a->x = v[0]; a->y = v[1]; a->z = v[2];
+            fHaveA = true;
+          }
+          else {
+            m->x = v[0]; m->y = v[1]; m->z = v[2];
+            fHaveM = true;
+          }
+
+          if ( fHaveA && fHaveM ) {
+            fHaveA = fHaveM = false;
+            fSamples++;
+            return true;
+          }
+        }
+      }
+      else
+        return false;
+
+      if ( status == kLineMalformed ) fMalformed++;
+      if ( status == kLineChecksum ) fChecksumErrors++;
+    }
+
+    return false;
+  }
+
+  /** True if the next Read() will not have to wait for more input,
+    * i.e. a complete line is already buffered.
+    */
+  bool IsLineBuffered() const
+   {
+    return fPos < fDataEnd && memchr( fPos, '\n', fDataEnd - fPos );
+  }
+
+  bool IsMapped() const { return fMapped; }
+
+  EFormat GetFormat() const { return fFormat; }
+
+  const char *GetFormatName() const
+   {
+    switch ( fFormat ) {
+      case kFormatNMEA: return "NMEA ($ACRAW)";
+      case kFormatTag:  return "tags (ADATA/MDATA)";
+      default:          return "unknown";
+    }
+  }
+
+  unsigned long GetLines() const { return fLines; }
+  unsigned long GetSamples() const { return fSamples; }
+  unsigned long GetMalformed() const { return fMalformed; }
+  unsigned long GetChecksumErrors() const { return fChecksumErrors; }
+
+ private:
+
+  void ClearCounters()
+   {
+    fLines = fSamples = fMalformed = fChecksumErrors = 0;
+    fHaveA = fHaveM = false;
+  }
+
+  // move the unread rest to the front of the buffer and append new data,
+  // blocks until at least one byte was read (or EOF)
+  bool Fill()
+   {
+    if ( fMapped || fEOF ) return false;
+
+    size_t rest = fDataEnd - fPos;
+
+    if ( fPos > fBuffer ) {
+      memmove( fBuffer, fPos, rest );
+      fPos = fData = fBuffer;
+      fDataEnd = fBuffer + rest;
+    }
+
+    if ( rest == kBufferSize ) return false;
+
+    ssize_t n;
+
+    do {
+      n = read( fFd, fBuffer + rest, kBufferSize - rest );
+    } while ( n < 0 && errno == EINTR );
+
+    if ( n <= 0 ) {
+      fEOF = true;
+      return false;
+    }
+
+    fDataEnd += n;
+
+    return true;
+  }
+
+  // search the end of the line starting at 'line', refill the buffer if
+  // needed, 'line' must not lie before fPos (it might get moved)
+  const char *FindEndOfLine(const char **line)
+   {
+    size_t offset = *line - fPos;
+
+    for (;;) {
+
+      *line = fPos + offset;
+
+      if ( *line < fDataEnd ) {
+        const char *eol = (const char *)memchr( *line, '\n', fDataEnd - *line );
+        if ( eol ) return eol;
+      }
+
+      if ( !Fill() ) break;
+    }
+
+    // end of file or buffer full: the rest is the last (maybe truncated) line
+    return *line < fDataEnd ? fDataEnd : NULL;
+  }
+
+  bool NextLine(const char **line,const char **end)
+   {
+    *line = fPos;
+
+    const char *eol = FindEndOfLine( line );
+
+    if ( !eol ) return false;
+
+    *end = eol;
+
+    fPos = eol < fDataEnd ? eol + 1 : eol;
+    fLines++;
+
+    return true;
+  }
+
+  // the first line which parses in either format decides, nothing is
+  // consumed, for streams the lines remain in the buffer
+  EFormat DetectFormat()
+   {
+    const char *line = fPos;
+
+    for ( int n=0; n<1000; ++n ) {
+
+      const char *eol = FindEndOfLine( &line );
+
+      if ( !eol ) break;
+
+      int16_t v[6];
+      char tag;
+
+      if ( ParseNMEALine( line, eol, v ) == kLineSample ) return kFormatNMEA;
+      if ( ParseTagLine( line, eol, &tag, v ) == kLineSample ) return kFormatTag;
+
+      if ( eol == fDataEnd ) break;
+
+      line = eol + 1;
+    }
+
+    return kFormatUnknown;
+  }
+
+  int             fFd;
+  bool            fMapped;
+  bool            fEOF;
+  char           *fBuffer;
+
+  const char     *fData;
+  const char     *fDataEnd;
+  const char     *fPos;
+  EFormat         fFormat;
+
+  unsigned long   fLines;
+  unsigned long   fSamples;
+  unsigned long   fMalformed;
+  unsigned long   fChecksumErrors;
+
+  bool            fHaveA;
+  bool            fHaveM;
+
+};
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
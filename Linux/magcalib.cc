@@ -0,0 +1,353 @@
+//
+// File   : magcalib.cc
+//
+// Purpose: Hard and soft iron calibration of the MAG sensor from recorded
+//          data, written into an EEPROM image for avrdude
+//
+// $Id$
+//
+
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <cmath>
+#include <cstddef>   // offsetof
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include <unistd.h>   // getopt()
+
+/** @file magcalib.cc
+  * Hard and soft iron calibration of the MAG sensor from recorded data.
+  *
+  * The readings of a data file (NMEA or tags, see logreader.cc) are fitted
+  * by an ellipsoid (ellipsoidfit.cc), its center and the matrix which maps
+  * it onto the unit sphere are the calibration (mag_calib_t of
+  * ../fixheading.h). The calibration is written into the configuration
+  * record (config_t of ../config.h) of an EEPROM image (Intel HEX), which
+  * is programmed by 'avrdude -U eeprom:w:<file>:i'. CompassInit() then
+  * uses it instead of the min/max readings.
+  *
+  * The image is read back from the controller ('avrdude -U
+  * eeprom:r:<file>:i'), which writes its first record when it starts. Of
+  * the valid records (version, CRC) in the image the newest one gets the
+  * calibration and a new CRC, all other bytes are kept.
+  *
+  * @author H.-J. Mathes <dc2ip@darc.de>
+  */
+
+using namespace std;
+
+#include "../LSM303/vector.c"
+#include "../fixheading.c"
+#include "../config.h"
+#include "hostsim/util/crc16.h"
+#include "logreader.cc"
+#include "ellipsoidfit.cc"
+
+// ---------------------------------------------------------------------------
+
+static void Usage(const char *argv0)
+ {
+  cout << "Usage: " << argv0 << " [options] -i <input_file>" << endl;
+  cout << endl;
+  cout << "where" << endl;
+  cout << "\t-i <input_file>  : recorded data of the sensor, '-' is stdin" << endl;
+  cout << "\t-e <eep_file>    : EEPROM image read from the controller" << endl;
+  cout << "\t-o <eep_file>    : write the EEPROM image with the calibration (Intel HEX)" << endl;
+  cout << "\t-p               : fit the x/y plane only (sensor turned by the rotator)" << endl;
+  cout << "\t-h,-?            : display this help page" << endl;
+  cout << endl;
+}
+
+// ---------------------------------------------------------------------------
+
+/** Size of the EEPROM of the ATmega32. */
+static const size_t kEEPROMSize = 1024;
+
+/** Size of the calibration, packed as on the AVR. */
+static const size_t kRecordSize = sizeof(uint32_t) + 12 * sizeof(float);
+
+/** Size of the configuration record, the same on the AVR (checked in
+  * ../config.h).
+  */
+static const size_t kConfigSize = sizeof(config_t);
+
+// the record as bytes, little endian (as the host)
+static void PackRecord(const mag_calib_t &mag,uint8_t *record)
+ {
+  memcpy( record, &mag.fMagic, sizeof(uint32_t) );
+  memcpy( record + sizeof(uint32_t), mag.fOffset, sizeof(mag.fOffset) );
+  memcpy( record + sizeof(uint32_t) + sizeof(mag.fOffset), mag.fMatrix,
+          sizeof(mag.fMatrix) );
+}
+
+// ---------------------------------------------------------------------------
+
+/** EEPROM image, < 0 for the bytes not in the file. */
+typedef vector<int> eeprom_image_t;
+
+static bool ReadIntelHex(const char *filename,eeprom_image_t &image)
+ {
+  FILE *file = fopen( filename, "r" );
+  if ( !file ) return false;
+
+  char line[600];
+  bool ok = true, eof = false;
+
+  while ( !eof && fgets( line, sizeof(line), file ) ) {
+
+    if ( line[0] != ':' ) continue;
+
+    unsigned int len, addr, type;
+    if ( sscanf( line+1, "%2x%4x%2x", &len, &addr, &type ) != 3
+         || strlen( line ) < 11 + 2 * len ) {
+      ok = false;
+      break;
+    }
+
+    unsigned int sum = len + (addr >> 8) + (addr & 0xff) + type, byte;
+
+    for ( unsigned int i=0; i<=len; ++i ) {  // data and checksum
+      sscanf( line + 9 + 2 * i, "%2x", &byte );
+      sum += byte;
+      if ( i < len && type == 0 ) {
+        if ( addr + i >= kEEPROMSize ) {
+          ok = false;
+          break;
+        }
+        image[addr+i] = byte;
+      }
+    }
+
+    if ( (sum & 0xff) != 0 ) ok = false;
+    if ( type == 1 ) eof = true;
+    if ( !ok ) break;
+  }
+
+  fclose( file );
+
+  return ok;
+}
+
+// records of 16 bytes for the runs of bytes in the image
+static bool WriteIntelHex(const char *filename,const eeprom_image_t &image)
+ {
+  FILE *file = fopen( filename, "w" );
+  if ( !file ) return false;
+
+  for ( size_t addr=0; addr<image.size(); ) {
+
+    if ( image[addr] < 0 ) {
+      addr++;
+      continue;
+    }
+
+    size_t len = 0;
+    while ( len < 16 && addr + len < image.size() && image[addr+len] >= 0 ) len++;
+
+    unsigned int sum = len + (addr >> 8) + (addr & 0xff);
+
+    fprintf( file, ":%02X%04X00", (unsigned int)len, (unsigned int)addr );
+    for ( size_t i=0; i<len; ++i ) {
+      fprintf( file, "%02X", image[addr+i] );
+      sum += image[addr+i];
+    }
+    fprintf( file, "%02X\n", (-sum) & 0xff );
+
+    addr += len;
+  }
+
+  fprintf( file, ":00000001FF\n" );
+
+  return fclose( file ) == 0;
+}
+
+// CRC of the configuration record at 'addr' as ConfigCRC() of ../config.c
+static uint16_t ConfigCRC(const eeprom_image_t &image,size_t addr)
+ {
+  uint16_t crc = 0xffff;
+
+  for ( size_t i=0; i<offsetof(config_t,fCRC); ++i )
+    crc = _crc_ccitt_update( crc, image[addr+i] );
+
+  return crc;
+}
+
+// address of the newest valid configuration record (as ConfigRead() of
+// ../config.c), -1 if there is none
+static long FindRecord(const eeprom_image_t &image)
+ {
+  long found = -1;
+  uint8_t sequence = 0;
+
+  for ( size_t addr=0; addr+kConfigSize<=image.size(); ++addr ) {
+
+    bool complete = true;
+    for ( size_t i=0; i<kConfigSize; ++i )
+      if ( image[addr+i] < 0 ) complete = false;
+
+    if ( !complete || image[addr+offsetof(config_t,fVersion)] != CONFIG_VERSION )
+      continue;
+
+    size_t crc = addr + offsetof(config_t,fCRC);
+    if ( ConfigCRC( image, addr ) != (image[crc] | (image[crc+1] << 8)) )
+      continue;
+
+    uint8_t s = image[addr+offsetof(config_t,fSequence)];
+    if ( found < 0 || (int8_t)(s - sequence) > 0 ) {
+      found = addr;
+      sequence = s;
+    }
+  }
+
+  return found;
+}
+
+// ---------------------------------------------------------------------------
+
+int main(int argc,char **argv)
+ {
+  string input_filename = "-";
+  const char *eep_filename = NULL;
+  const char *output_filename = NULL;
+  bool plane = false;
+  int getopt_status;
+
+  while ( (getopt_status = getopt( argc, argv, "e:i:o:ph?" )) != EOF ) {
+
+    switch ( getopt_status ) {
+
+      case 'e': eep_filename = optarg;
+                break;
+
+      case 'i': input_filename = optarg;
+                break;
+
+      case 'o': output_filename = optarg;
+                break;
+
+      case 'p': plane = true;
+                break;
+
+      case 'h':
+      case '?':
+      default:  Usage(argv[0]);
+                exit( EXIT_FAILURE );
+    }
+  }
+
+  LogReader reader;
+
+  if ( !reader.Open( input_filename.c_str() ) ) {
+    cerr << argv[0] << ": error opening file " << input_filename << "!" << endl;
+    exit( EXIT_FAILURE );
+  }
+
+  if ( reader.GetFormat() == LogReader::kFormatUnknown ) {
+    cerr << argv[0] << ": unknown data format!" << endl;
+    exit( EXIT_FAILURE );
+  }
+
+  // --- the fit, one pass over the data
+
+  EllipsoidFit fit;
+  vector_t a, m;
+
+  clock_t start = clock();
+
+  while ( reader.Read( &a, &m ) ) fit.Add( m );
+
+  mag_calib_t mag;
+  bool ok = fit.Solve( &mag, plane );
+
+  double msec = 1000. * (clock() - start) / CLOCKS_PER_SEC;
+
+  printf( "%s: %lu samples (%lu malformed), read and %s fitted in %.1f ms\n",
+          input_filename.c_str(), fit.GetSamples(), reader.GetMalformed(),
+          plane ? "ellipse" : "ellipsoid", msec );
+
+  if ( !ok ) {
+    cerr << argv[0] << ": the data does not determine the "
+         << (plane ? "ellipse" : "ellipsoid")
+         << (plane ? "!" : ", turn the sensor in all directions or use -p!") << endl;
+    exit( EXIT_FAILURE );
+  }
+
+  printf( "  offset  %9.3f %9.3f %9.3f\n",
+          mag.fOffset[0], mag.fOffset[1], mag.fOffset[2] );
+  for ( int i=0; i<3; ++i )
+    printf( "  %s  %9.6f %9.6f %9.6f\n", i ? "      " : "matrix",
+            mag.fMatrix[i][0], mag.fMatrix[i][1], mag.fMatrix[i][2] );
+
+  // --- deviation from the unit sphere (circle), second pass over files
+
+  if ( reader.Rewind() ) {
+
+    double sum = 0., max = 0.;
+    unsigned long n = 0;
+
+    while ( reader.Read( &a, &m ) ) {
+      if ( plane ) m.z = mag.fOffset[2];
+      double r = EllipsoidFit::Residual( mag, m );
+      sum += r * r;
+      if ( fabs( r ) > max ) max = fabs( r );
+      n++;
+    }
+
+    if ( n )
+      printf( "  radius  rms %.4f, max %.4f off the unit %s\n",
+              sqrt( sum / n ), max, plane ? "circle" : "sphere" );
+  }
+
+  // --- the EEPROM image
+
+  if ( !output_filename ) exit( EXIT_SUCCESS );
+
+  eeprom_image_t image( kEEPROMSize, -1 );
+
+  if ( !eep_filename ) {
+    cerr << argv[0] << ": the EEPROM image of the controller is needed, use -e!" << endl;
+    exit( EXIT_FAILURE );
+  }
+
+  if ( !ReadIntelHex( eep_filename, image ) ) {
+    cerr << argv[0] << ": error reading EEPROM image " << eep_filename << "!" << endl;
+    exit( EXIT_FAILURE );
+  }
+
+  long address = FindRecord( image );
+
+  if ( address < 0 ) {
+    cerr << argv[0] << ": no valid configuration record in " << eep_filename
+         << ", read it back after the controller has started once!" << endl;
+    exit( EXIT_FAILURE );
+  }
+
+  uint8_t record[kRecordSize];
+  PackRecord( mag, record );
+
+  size_t offset = address + offsetof(config_t,fMAG_calib);
+  for ( size_t i=0; i<kRecordSize; ++i ) image[offset+i] = record[i];
+
+  uint16_t crc = ConfigCRC( image, address );
+  image[address+offsetof(config_t,fCRC)] = crc & 0xff;
+  image[address+offsetof(config_t,fCRC)+1] = crc >> 8;
+
+  if ( !WriteIntelHex( output_filename, image ) ) {
+    cerr << argv[0] << ": error writing " << output_filename << "!" << endl;
+    exit( EXIT_FAILURE );
+  }
+
+  printf( "%s: record at 0x%03lx, program with avrdude -U eeprom:w:%s:i\n",
+          output_filename, address, output_filename );
+
+  exit( EXIT_SUCCESS );
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
@@ -0,0 +1,594 @@
+
+//
+// File   : passplan.cc
+//
+// Purpose: Plan of the moves of the rotator for predicted passes, as few
+//          turns as possible within a bound of the pointing error.
+//
+// $Id$
+//
+
+
+#include <vector>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include <unistd.h>   // getopt()
+
+#include "../config.h"   // ERelayDelay, CONFIG_RELAY_DELAYS, GOTO_SETTLE_SAMPLES
+
+/** @file passplan.cc
+  * Plan of the moves of the rotator for predicted passes (satellite, moon),
+  * as few turns as possible while the pointing error stays within a bound.
+  *
+  * The input file has one line "time azimuth" per point (time in s, e.g.
+  * UNIX time, further columns as the elevation are ignored), passes are
+  * separated by empty lines, '#' starts a comment. For each pass the moves
+  * "time azimuth" are written, at 'time' the command 'Mazi' has to be sent
+  * to the controller (GS-232).
+  *
+  * The controller is modeled as the firmware works:
+  *
+  * @li the heading is quantized to 5 deg (5 * (heading / 5)), a turn by
+  *     PresetGoto() ends when this heading equals the target, thus the
+  *     rotator then points somewhere into the 5 deg above the target, the
+  *     pointing error includes this half step
+  * @li a turn starts with the next sensor sample and the relay sequence
+  *     of RotatorExec() (power, brake, motor), after the stop the relays
+  *     are switched back and PresetGoto() waits until the heading has
+  *     settled, only then the next turn can start; a hold time keeps the
+  *     power on, the next turn then starts faster
+  * @li the rotator turns with the measured speed, the stop ahead by the
+  *     learned run-out is assumed to hit the target
+  * @li the angle of the rotator is limited by its stops (limit and range
+  *     as in the EEPROM), of two angles of an azimuth in the overlap the
+  *     nearer one is taken (GetTargetAngle())
+  *
+  * The track is sampled with the period of the sensor. When the error is
+  * about to exceed the bound, the rotator turns to the position of the
+  * grid which keeps the error in bound for the longest time, it starts as
+  * late as possible. Each turn thus covers the longest part of the track,
+  * the number of turns is minimal for a monotonic track. Thousands of
+  * passes are planned per second (-n to measure it).
+  *
+  * @author H.-J. Mathes <dc2ip@darc.de>
+  */
+
+using namespace std;
+
+// ---------------------------------------------------------------------------
+
+static struct ProgramParameters {
+
+  const char     *fInputFile;
+  double          fSpeed;           // [deg/s], measured
+  double          fBound;           // [deg] of the pointing error
+  int             fRelayDelay[kNRelayDelays];
+  int             fLimit;           // [deg] heading of the CCW stop
+  int             fRange;           // [deg] from the CCW stop
+  double          fStart;           // [deg] azimuth before the pass, < 0 = at the first point
+  double          fPeriod;          // [s] of the sensor
+  int             fResolution;      // [deg] of the heading
+  int             fRepeat;
+  int             fVerbose;
+
+} gProgramParameter = {
+
+  "-",                         /* fInputFile */
+  6.,                          /* fSpeed */
+  10.,                         /* fBound */
+  CONFIG_RELAY_DELAYS,         /* fRelayDelay */
+  270,                         /* fLimit, LIMIT_ANGLE */
+  359,                         /* fRange, MAX_ANGLE */
+  -1.,                         /* fStart */
+  0.1,                         /* fPeriod */
+  5,                           /* fResolution */
+  1,                           /* fRepeat */
+  1,                           /* fVerbose */
+};
+
+/** Time [s] of one tick of the timer interrupt. */
+static const double kTick = 0.01;
+
+// ---------------------------------------------------------------------------
+
+/** One turn of the plan. */
+struct Move {
+
+  double  fTime;         // [s] to send 'M'
+  int     fAzimuth;      // [deg]
+  double  fAngle;        // [deg] from the CCW stop, middle of the grid cell
+  double  fTurn;         // [s] the motor starts
+  double  fArrival;      // [s]
+};
+
+/** A pass as read from the input file. */
+struct Pass {
+
+  vector<double>  fTime;
+  vector<double>  fAzimuth;
+};
+
+// ---------------------------------------------------------------------------
+
+/** Planner of the moves for one pass after the other, the buffers are
+  * reused.
+  */
+class PassPlanner {
+
+ public:
+
+  PassPlanner(const ProgramParameters &param)
+   : fParam(param), fMaxError(0.), fStartTime(0.)
+   {
+    const int *delay = param.fRelayDelay;
+
+    // PresetGoto() decides with the next sample, then the relay sequence
+    // until the motor is on, each step takes one tick more
+    fStartDelay = param.fPeriod
+                  + (delay[kDelayPowerOn] + delay[kDelayBrakeRelease] + 2) * kTick;
+    fHoldStartDelay = param.fPeriod + (delay[kDelayBrakeRelease] + 1) * kTick;
+
+    // relays back and the heading settled until the next turn
+    fStopDelay = (delay[kDelayRotatorOff] + delay[kDelayBrakeLock]
+                  + delay[kDelayPowerOff] + 3) * kTick
+                 + GOTO_SETTLE_SAMPLES * param.fPeriod;
+    fHoldTime = 0.1 * delay[kDelayHoldPower];
+
+    fHalfStep = 0.5 * param.fResolution;
+   }
+
+  /** Plan the moves of 'pass', false if it is empty. */
+  bool Plan(const Pass &pass);
+
+  const vector<Move> &Moves() const { return fMoves; }
+
+  /** Largest pointing error [deg] of the last plan. */
+  double MaxError() const { return fMaxError; }
+
+  /** Number of samples of the last pass. */
+  size_t Samples() const { return fAngle.size(); }
+
+ private:
+
+  const ProgramParameters &fParam;
+
+  double  fStartDelay, fHoldStartDelay;   // [s] until the motor turns
+  double  fStopDelay;                     // [s] after a turn until the next
+  double  fHoldTime;                      // [s] with power on after a stop
+  double  fHalfStep;                      // [deg] of the quantized heading
+
+  vector<double>  fUnwrapped; // [deg] of the points, unwrapped
+  vector<double>  fAngle;     // [deg] of the track from the CCW stop
+  vector<Move>    fMoves;
+  double          fMaxError;
+  double          fStartTime; // [s] of the first sample
+
+  double Time(size_t i) const { return fStartTime + i * fParam.fPeriod; }
+
+  // middle of the grid cell in which the rotator stops at 'angle'
+  double Rest(double angle) const
+   {
+    return fParam.fResolution * floor( angle / fParam.fResolution ) + fHalfStep;
+   }
+
+  // pointing error [deg] at 'angle', one turn is the same azimuth
+  double Error(size_t i,double angle) const
+   {
+    double diff = fabs( fAngle[i] - angle );
+
+    if ( diff > 180. ) diff = fabs( remainder( diff, 360. ) );
+
+    return diff + fHalfStep;
+   }
+
+  // first sample from 'i' on where the error at rest 'angle' is too large
+  size_t Violation(size_t i,double angle) const
+   {
+    for ( ; i<fAngle.size(); ++i )
+      if ( Error( i, angle ) > fParam.fBound ) break;
+
+    return i;
+   }
+
+  void   Sample(const Pass &pass);
+  int    TargetAngle(int azimuth,double angle) const;
+  void   Evaluate(double angle);
+};
+
+// ---------------------------------------------------------------------------
+
+// the track sampled with the period of the sensor, unwrapped and as angle
+// of the rotator, one turn lower or higher if it then fits into the range
+void PassPlanner::Sample(const Pass &pass)
+ {
+  const vector<double> &t = pass.fTime;
+  const vector<double> &az = pass.fAzimuth;
+  size_t m = t.size();
+
+  fUnwrapped.resize( m );
+  fUnwrapped[0] = fmod( az[0] - fParam.fLimit + 720., 360. );
+
+  for ( size_t j=1; j<m; ++j )
+    fUnwrapped[j] = fUnwrapped[j-1] + fmod( az[j] - az[j-1] + 540., 360. ) - 180.;
+
+  fStartTime = t[0];
+
+  size_t n = (size_t)((t[m-1] - t[0]) / fParam.fPeriod) + 1;
+
+  fAngle.resize( n );
+
+  double lo = 1e300, hi = -1e300;
+
+  for ( size_t i=0, j=0; i<n; ++i ) {
+
+    double time = Time( i );
+
+    while ( j + 2 < m && t[j+1] <= time ) ++j;
+
+    if ( m == 1 || time >= t[m-1] )
+      fAngle[i] = fUnwrapped[m-1];
+    else
+      fAngle[i] = fUnwrapped[j] + (fUnwrapped[j+1] - fUnwrapped[j])
+                                  * (time - t[j]) / (t[j+1] - t[j]);
+
+    lo = min( lo, fAngle[i] );
+    hi = max( hi, fAngle[i] );
+  }
+
+  double shift = 0., outside = max( 0., -lo ) + max( 0., hi - fParam.fRange );
+
+  for ( int k=-1; k<=1; k+=2 ) {
+
+    double out = max( 0., -(lo + 360. * k) ) + max( 0., hi + 360. * k - fParam.fRange );
+
+    if ( out < outside ) {
+      outside = out;
+      shift = 360. * k;
+    }
+  }
+
+  if ( shift != 0. )
+    for ( size_t i=0; i<n; ++i ) fAngle[i] += shift;
+ }
+
+// ---------------------------------------------------------------------------
+
+// as GetTargetAngle() in ../rotorstate.c
+int PassPlanner::TargetAngle(int azimuth,double angle) const
+ {
+  int target = ((azimuth - fParam.fLimit) % 360 + 360) % 360;
+
+  while ( target + 360 <= fParam.fRange
+          && fabs( target + 360 - angle ) < fabs( target - angle ) )
+    target += 360;
+
+  return target;
+ }
+
+// ---------------------------------------------------------------------------
+
+bool PassPlanner::Plan(const Pass &pass)
+ {
+  fMoves.clear();
+  fMaxError = 0.;
+
+  if ( pass.fTime.empty() ) return false;
+
+  Sample( pass );
+
+  const int step = fParam.fResolution;
+  const int top = step * (fParam.fRange / step);
+
+  // without a start azimuth the rotator has been turned to the first point,
+  // at the angle from which the track fits best into the range
+  double start = fParam.fStart < 0. ? min( max( fAngle[0], 0. ), (double)fParam.fRange )
+                 : TargetAngle( (int)lround( fParam.fStart ), fAngle[0] );
+  double angle = Rest( start );
+
+  double free = -1e300;          // [s] the next turn may start
+  double stop = -1e300;          // [s] of the last stop
+
+  size_t i = 0;
+
+  while ( (i = Violation( i, angle )) < fAngle.size() ) {
+
+    // candidates: the grid around the track at the violation, at the
+    // angle which the controller takes, beyond a stop a turn back
+    double track = fAngle[i];
+    int first = step * (int)floor( (track - fParam.fBound) / step );
+    int last = step * (int)ceil( (track + fParam.fBound) / step );
+
+    Move best = { 0., -1, angle, 0., 0. };
+    size_t best_hold = i;
+
+    for ( int g=first; g<=last; g+=step ) {
+
+      int azimuth = ((g + fParam.fLimit) % 360 + 360) % 360;
+      int cell = TargetAngle( azimuth, angle );
+      double target = cell + fHalfStep;
+
+      if ( target == angle || cell > top ) continue;
+
+      double turn = fabs( target - angle ) / fParam.fSpeed;
+
+      // as late as possible, thus arriving at the violation
+      double delay = fStartDelay;
+
+      if ( Time( i ) - turn - fHoldStartDelay - stop < fHoldTime )
+        delay = fHoldStartDelay;
+
+      double time = max( free, Time( i ) - turn - delay );
+
+      delay = time - stop < fHoldTime ? fHoldStartDelay : fStartDelay;
+
+      double arrival = time + delay + turn;
+      double from = ceil( (arrival - fStartTime) / fParam.fPeriod );
+      size_t hold = Violation( max( i, (size_t)max( 0., from ) ), target );
+
+      if (    hold > best_hold
+           || (hold == best_hold && best.fAzimuth >= 0
+               && fabs( target - angle ) < fabs( best.fAngle - angle )) ) {
+        best_hold = hold;
+        best.fTime = time;
+        best.fAzimuth = azimuth;
+        best.fAngle = target;
+        best.fTurn = time + delay;
+        best.fArrival = arrival;
+      }
+    }
+
+    // no candidate gains time (e.g. the track is faster than the rotator),
+    // the error is reported by Evaluate()
+    if ( best.fAzimuth < 0 || best_hold == i ) {
+      ++i;
+      if ( best.fAzimuth < 0 ) continue;
+    }
+    else
+      i = best_hold;
+
+    fMoves.push_back( best );
+
+    angle = best.fAngle;
+    stop = best.fArrival;
+    free = stop + fStopDelay;
+  }
+
+  Evaluate( Rest( start ) );
+
+  return true;
+ }
+
+// ---------------------------------------------------------------------------
+
+// largest error along the plan, the rotator turns between the moves
+void PassPlanner::Evaluate(double angle)
+ {
+  size_t m = 0;
+  double from = angle;
+
+  for ( size_t i=0; i<fAngle.size(); ++i ) {
+
+    double time = Time( i );
+
+    while ( m < fMoves.size() && fMoves[m].fArrival <= time ) {
+      from = angle = fMoves[m].fAngle;
+      ++m;
+    }
+
+    double position = angle;
+
+    if ( m < fMoves.size() && time > fMoves[m].fTurn ) {
+      const Move &move = fMoves[m];
+      position = from + (move.fAngle - from) * (time - move.fTurn)
+                        / (move.fArrival - move.fTurn);
+    }
+
+    fMaxError = max( fMaxError, Error( i, position ) );
+  }
+ }
+
+// ---------------------------------------------------------------------------
+
+/** Read all passes from 'file', false on an error. */
+static bool ReadPasses(FILE *file,vector<Pass> &passes)
+ {
+  char line[256];
+  Pass pass;
+  unsigned long nline = 0;
+
+  while ( fgets( line, sizeof(line), file ) ) {
+
+    nline++;
+
+    char *comment = strchr( line, '#' );
+    if ( comment ) *comment = '\0';
+
+    double time, azimuth;
+    int n = sscanf( line, "%lf %lf", &time, &azimuth );
+
+    if ( n == EOF ) {
+      // an empty line ends the pass, not a comment line
+      if ( !comment && !pass.fTime.empty() ) {
+        passes.push_back( pass );
+        pass = Pass();
+      }
+      continue;
+    }
+
+    if ( n != 2 ) {
+      fprintf( stderr, "passplan: invalid line %lu\n", nline );
+      return false;
+    }
+
+    if ( !pass.fTime.empty() && time <= pass.fTime.back() ) {
+      fprintf( stderr, "passplan: time not increasing in line %lu\n", nline );
+      return false;
+    }
+
+    pass.fTime.push_back( time );
+    pass.fAzimuth.push_back( azimuth );
+  }
+
+  if ( !pass.fTime.empty() ) passes.push_back( pass );
+
+  return true;
+ }
+
+// ---------------------------------------------------------------------------
+
+static void Usage(const char *argv0)
+ {
+  const ProgramParameters &p = gProgramParameter;
+
+  printf( "Usage: %s [options] [-i <input_file>]\n\n", argv0 );
+  printf( "where\n" );
+  printf( "\t-i <input_file>  : lines \"time azimuth\", empty line between passes (default: stdin)\n" );
+  printf( "\t-s <deg/s>       : measured speed of the rotator (default: %.1f)\n", p.fSpeed );
+  printf( "\t-e <deg>         : bound of the pointing error (default: %.1f)\n", p.fBound );
+  printf( "\t-d <d0,...,d6>   : relay delays as 'Yk' of the controller (default: %d,%d,%d,%d,%d,%d,%d)\n",
+          p.fRelayDelay[0], p.fRelayDelay[1], p.fRelayDelay[2], p.fRelayDelay[3],
+          p.fRelayDelay[4], p.fRelayDelay[5], p.fRelayDelay[6] );
+  printf( "\t-l <deg>         : heading of the CCW stop (default: %d)\n", p.fLimit );
+  printf( "\t-w <deg>         : range of the rotator (default: %d)\n", p.fRange );
+  printf( "\t-a <deg>         : azimuth before the pass (default: at the first point)\n" );
+  printf( "\t-p <msec>        : period of the sensor (default: %.0f)\n", p.fPeriod * 1000. );
+  printf( "\t-r <deg>         : resolution of the heading (default: %d)\n", p.fResolution );
+  printf( "\t-n <count>       : plan all passes <count> times and report the rate\n" );
+  printf( "\t-q               : quiet, no moves, only the summary of each pass\n" );
+  printf( "\t-h,-?            : display this help page\n" );
+  printf( "\n" );
+ }
+
+// ---------------------------------------------------------------------------
+
+int main(int argc,char **argv)
+ {
+  ProgramParameters &p = gProgramParameter;
+  int getopt_status;
+
+  while ( (getopt_status = getopt( argc, argv, "a:d:e:i:l:n:p:qr:s:w:h?" )) != EOF ) {
+
+    switch ( getopt_status ) {
+
+      case 'a': p.fStart = fmod( atof( optarg ) + 360., 360. );
+                break;
+
+      case 'd': if ( sscanf( optarg, "%d,%d,%d,%d,%d,%d,%d",
+                             &p.fRelayDelay[0], &p.fRelayDelay[1], &p.fRelayDelay[2],
+                             &p.fRelayDelay[3], &p.fRelayDelay[4], &p.fRelayDelay[5],
+                             &p.fRelayDelay[6] ) < kDelayHoldPower ) {
+                  fprintf( stderr, "%s: invalid relay delays '%s'\n", argv[0], optarg );
+                  exit( EXIT_FAILURE );
+                }
+                break;
+
+      case 'e': p.fBound = atof( optarg );
+                break;
+
+      case 'i': p.fInputFile = optarg;
+                break;
+
+      case 'l': p.fLimit = atoi( optarg );
+                break;
+
+      case 'n': p.fRepeat = atoi( optarg );
+                break;
+
+      case 'p': p.fPeriod = atof( optarg ) / 1000.;
+                break;
+
+      case 'q': p.fVerbose = 0;
+                break;
+
+      case 'r': p.fResolution = atoi( optarg );
+                break;
+
+      case 's': p.fSpeed = atof( optarg );
+                break;
+
+      case 'w': p.fRange = atoi( optarg );
+                break;
+
+      case 'h':
+      case '?':
+      default:  Usage( argv[0] );
+                exit( EXIT_FAILURE );
+    }
+  }
+
+  if (    p.fSpeed <= 0. || p.fPeriod <= 0. || p.fResolution <= 0 || p.fRepeat <= 0
+       || p.fLimit < 0 || p.fLimit > 359 || p.fRange < 180 || p.fRange > 720 ) {
+    fprintf( stderr, "%s: invalid parameters!\n", argv[0] );
+    exit( EXIT_FAILURE );
+  }
+
+  // the rotator cannot point better than half a step of the heading
+  if ( p.fBound <= 0.5 * p.fResolution ) {
+    fprintf( stderr, "%s: bound must be larger than %.1f deg!\n", argv[0],
+             0.5 * p.fResolution );
+    exit( EXIT_FAILURE );
+  }
+
+  FILE *input = strcmp( p.fInputFile, "-" ) == 0 ? stdin : fopen( p.fInputFile, "r" );
+
+  if ( !input ) {
+    fprintf( stderr, "%s: error opening file %s!\n", argv[0], p.fInputFile );
+    exit( EXIT_FAILURE );
+  }
+
+  vector<Pass> passes;
+
+  if ( !ReadPasses( input, passes ) ) exit( EXIT_FAILURE );
+
+  if ( input != stdin ) fclose( input );
+
+  PassPlanner planner( p );
+
+  struct timespec t0, t1;
+  clock_gettime( CLOCK_MONOTONIC, &t0 );
+
+  unsigned long moves = 0;
+
+  for ( int n=0; n<p.fRepeat; ++n )
+    for ( size_t k=0; k<passes.size(); ++k ) {
+      planner.Plan( passes[k] );
+      moves += planner.Moves().size();
+    }
+
+  clock_gettime( CLOCK_MONOTONIC, &t1 );
+
+  // the plans of the last round
+  for ( size_t k=0; k<passes.size(); ++k ) {
+
+    planner.Plan( passes[k] );
+
+    const vector<Move> &plan = planner.Moves();
+
+    printf( "# pass %lu: %lu points, %lu moves, max. error %.1f deg\n",
+            (unsigned long)k + 1, (unsigned long)passes[k].fTime.size(),
+            (unsigned long)plan.size(), planner.MaxError() );
+
+    if ( !p.fVerbose ) continue;
+
+    for ( size_t m=0; m<plan.size(); ++m )
+      printf( "%.1f %03d\n", plan[m].fTime, plan[m].fAzimuth );
+
+    printf( "\n" );
+  }
+
+  double sec = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+  unsigned long planned = (unsigned long)p.fRepeat * passes.size();
+
+  if ( p.fRepeat > 1 )
+    fprintf( stderr, "passplan: %lu passes, %lu moves planned in %.3f s (%.0f passes/s)\n",
+             planned, moves, sec, sec > 0. ? planned / sec : 0. );
+
+  return EXIT_SUCCESS;
+ }
+
+// ---------------------------------------------------------------------------
@@ -0,0 +1,878 @@
+
+//
+// File   : rotorctld.cc
+//
+// Purpose: Daemon for the rotator controller (GS-232 on the serial port)
+//          which serves the protocol of hamlib's rotctld via TCP.
+//
+// $Id$
+//
+
+
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+
+#include <cerrno>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>   // getopt()
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+
+/** @file rotorctld.cc
+  * Daemon for the rotator controller which serves the protocol of hamlib's
+  * rotctld on localhost, thus tracking and logging programs can share the
+  * rotator (e.g. 'rotctl -m 2 -r localhost:4533', gpredict, ...).
+  *
+  * The daemon owns the serial port and runs a single epoll event loop:
+  *
+  * @li the controller is asked with 'Tnn' to send a frame on each change
+  *     of the position and a keepalive every nn seconds, there is no query
+  *     traffic while these frames arrive; 'p' is answered from this cache
+  * @li without frames (older firmware answers 'Tnn' with "?>", '-k 0')
+  *     the position is polled with 'C2' once per poll period, no matter
+  *     how many clients ask for it
+  * @li 'P' (set_pos) only stores the target, at most one 'Mnnn' is sent per
+  *     poll period (the latest target) and a target which was just sent,
+  *     or which is already reached, is not sent again
+  * @li 'S' (stop) is sent at once
+  *
+  * The controller shares its RX line with the sensor, a command sent during
+  * one of its sentences is lost without an answer (../gs232.c). A 'C2'
+  * without answer is repeated after kQueryTimeout, an 'Mnnn' after which
+  * the rotator neither moved nor reached the target is sent again up to
+  * kMoveRetries times, and 'S' is sent twice. The ticks are moved by a
+  * random time before such a repetition, they may be in step with the
+  * sentences.
+  *
+  * Supported commands: p, P, S, _, q and their long forms \\get_pos,
+  * \\set_pos, \\stop, \\get_info and \\dump_state.
+  *
+  * @author H.-J. Mathes <dc2ip@darc.de>
+  */
+
+using namespace std;
+
+// ---------------------------------------------------------------------------
+
+static struct ProgramParameters {
+
+  string          fSerialPort;
+  int             fBaudRate;
+  int             fTcpPort;
+  int             fPollPeriod;      // [ms]
+  int             fKeepalive;       // [s] of the frames, 0 = polling only
+  int             fVerbose;
+
+} gProgramParameter = {
+
+  "/dev/ttyUSB0", /* fSerialPort */
+  9600,           /* fBaudRate */
+  4533,           /* fTcpPort, as rotctld */
+  250,            /* fPollPeriod */
+  5,              /* fKeepalive */
+  0,              /* fVerbose */
+};
+
+/** A 'Tnn' without reply for this time [ms] is given up. */
+static const double kReplyTimeout = 1000.;
+
+/** A 'C2' without reply for this time [ms] is repeated (the reply takes
+  * 12 ms at 9600 baud).
+  */
+static const double kQueryTimeout = 300.;
+
+/** An 'Mnnn' is lost if the rotator did not move within this time [ms]
+  * (relay delays and the settling of the heading) ...
+  */
+static const double kMoveTimeout = 3000.;
+
+/** ... and then sent again up to this number of times. */
+static const int kMoveRetries = 3;
+
+/** The cached position is not reported if older than this [ms]. */
+static const double kStaleTime = 3000.;
+
+/** Subscription to the unsolicited frames ('Tnn') of the controller. */
+enum EPushState {
+  kPushOff,              // not (yet) subscribed, polling
+  kPushRequested,        // 'Tnn' sent, polling until the first frame
+  kPushActive,           // frames arrive, no polling
+  kPushUnsupported,      // 'Tnn' was answered with "?>"
+};
+
+/** A target which was sent is not sent again within this time [ms]. */
+static const double kResendTime = 5000.;
+
+/** A target within this distance [deg] of the position is reached. */
+static const int kTolerance = 5;
+
+static volatile sig_atomic_t gStop = 0;
+
+// ---------------------------------------------------------------------------
+
+/** Monotonic time [ms]. */
+static double Now()
+ {
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+
+  return ts.tv_sec * 1000. + ts.tv_nsec / 1000000.;
+}
+
+// ---------------------------------------------------------------------------
+
+/** Serial link to the controller with the cached position and the
+  * coalesced targets.
+  */
+class RotorLink {
+
+ public:
+
+  RotorLink()
+   : fFd(-1), fAzimuth(0), fUpdated(-1.), fQueryTime(-1.),
+     fTarget(0), fTargetPending(false), fTargetSent(-1), fTargetTime(-1.),
+     fTargetFrom(-1), fTargetRetries(0),
+     fPush(kPushOff), fState('?'), fSubscribeTime(-1.),
+     fQueries(0), fReplies(0), fTimeouts(0), fErrors(0), fRetries(0),
+     fSubscriptions(0), fFrames(0), fBadFrames(0),
+     fSetRequests(0), fMoves(0), fCoalesced(0), fStops(0),
+     fBytesIn(0), fBytesOut(0) {}
+
+  ~RotorLink() { if ( fFd >= 0 ) close( fFd ); }
+
+  /** Open the serial port in raw mode, non-blocking. */
+  bool Open(const char *device,int baudrate)
+   {
+    speed_t speed;
+
+    switch ( baudrate ) {
+      case   4800: speed = B4800; break;
+      case   9600: speed = B9600; break;
+      case  19200: speed = B19200; break;
+      case  38400: speed = B38400; break;
+      case  57600: speed = B57600; break;
+      case 115200: speed = B115200; break;
+      default:     return false;
+    }
+
+    if ( (fFd = open( device, O_RDWR | O_NOCTTY | O_NONBLOCK )) < 0 )
+      return false;
+
+    struct termios tio;
+
+    if ( tcgetattr( fFd, &tio ) == 0 ) {
+
+      cfmakeraw( &tio );
+      cfsetispeed( &tio, speed );
+      cfsetospeed( &tio, speed );
+      tio.c_cflag |= CLOCAL | CREAD;
+
+      tcsetattr( fFd, TCSANOW, &tio );
+      tcflush( fFd, TCIOFLUSH );
+    }
+
+    return true;
+  }
+
+  int GetFd() const { return fFd; }
+
+  /** Number of commands lost so far, they are repeated with the next Tick(). */
+  unsigned long GetLost() const { return fTimeouts + fRetries; }
+
+  /** Data are waiting to be written. */
+  bool WantsWrite() const { return !fOutput.empty(); }
+
+  /** Read and parse the replies of the controller. */
+  bool OnReadable()
+   {
+    char buffer[256];
+    ssize_t n;
+
+    while ( (n = read( fFd, buffer, sizeof(buffer) )) > 0 ) {
+
+      fBytesIn += n;
+
+      for ( ssize_t i=0; i<n; ++i ) {
+
+        if ( buffer[i] == '\r' || buffer[i] == '\n' ) {
+          if ( !fLine.empty() ) ParseLine( fLine );
+          fLine.clear();
+        }
+        else if ( fLine.size() < 80 )
+          fLine += buffer[i];
+      }
+    }
+
+    return n == 0 ? false : (errno == EAGAIN || errno == EINTR);
+  }
+
+  /** Write as much of the pending output as possible. */
+  void OnWritable()
+   {
+    while ( !fOutput.empty() ) {
+
+      ssize_t n = write( fFd, fOutput.data(), fOutput.size() );
+
+      if ( n <= 0 ) break;
+
+      fBytesOut += n;
+      fOutput.erase( 0, n );
+    }
+  }
+
+  /** Called once per poll period: send the latest target, (re)subscribe
+    * to the frames and send the next position query if there are none.
+    */
+  void Tick()
+   {
+    double now = Now();
+
+    if ( fTargetPending ) {
+
+      char cmd[8];
+      snprintf( cmd, sizeof(cmd), "M%03d\r", fTarget );
+      Send( cmd );
+
+      fTargetSent = fTarget;
+      fTargetTime = now;
+      fTargetPending = false;
+      fMoves++;
+
+      // where the rotator was, to see whether it moves
+      if ( !GetPosition( &fTargetFrom ) ) fTargetFrom = -1;
+    }
+    else
+      CheckMove( now );                // sent again with the next Tick()
+
+    if ( gProgramParameter.fKeepalive > 0 && fPush != kPushUnsupported ) {
+
+      // no frame for two keepalive periods: controller reset or line lost
+      if ( fPush == kPushActive && now - fUpdated > PushTimeout() ) {
+        fPush = kPushOff;
+        if ( gProgramParameter.fVerbose )
+          cout << "serial: frames lost, polling" << endl;
+      }
+
+      // the controller answers 'C2' but sends no frames: 'Tnn' was lost
+      if ( fPush == kPushOff
+           || (fPush == kPushRequested
+               && (now - fSubscribeTime > PushTimeout()
+                   || fUpdated - fSubscribeTime > kReplyTimeout)) ) {
+
+        char cmd[8];
+        snprintf( cmd, sizeof(cmd), "T%d\r", gProgramParameter.fKeepalive );
+        Send( cmd );
+
+        fPush = kPushRequested;
+        fSubscribeTime = now;
+        fSubscriptions++;
+      }
+    }
+
+    if ( fPush == kPushActive ) return;
+
+    // lost, e.g. in a collision with a sentence of the sensor: again
+    if ( fQueryTime >= 0. && now - fQueryTime > kQueryTimeout ) {
+      fQueryTime = -1.;
+      fTimeouts++;
+      return;                          // with the next Tick()
+    }
+
+    if ( fQueryTime < 0. ) {
+      Send( "C2\r" );
+      fQueryTime = now;
+      fQueries++;
+    }
+  }
+
+  /** Cached azimuth, false if there is no recent one. */
+  bool GetPosition(int *azimuth) const
+   {
+    double stale_time = kStaleTime;
+
+    if ( fPush == kPushActive && PushTimeout() > stale_time )
+      stale_time = PushTimeout();
+
+    if ( fUpdated < 0. || Now() - fUpdated > stale_time ) return false;
+
+    *azimuth = fAzimuth;
+
+    return true;
+  }
+
+  /** Request to turn to 'azimuth' [deg], sent with the next Tick(). */
+  void SetPosition(double azimuth)
+   {
+    int target = (int)lround( azimuth ) % 360;
+    if ( target < 0 ) target += 360;
+
+    fSetRequests++;
+
+    // the same target again: still turning or already there
+    int position;
+
+    if ( !fTargetPending && target == fTargetSent
+         && ( Now() - fTargetTime < kResendTime
+              || (GetPosition( &position ) && Distance( position, target ) <= kTolerance) ) ) {
+      fCoalesced++;
+      return;
+    }
+
+    // a target not yet sent is replaced
+    if ( fTargetPending ) fCoalesced++;
+
+    fTarget = target;
+    fTargetPending = true;
+    fTargetRetries = 0;
+  }
+
+  /** Stop the rotator at once. */
+  void Stop()
+   {
+    fTargetPending = false;
+    fTargetSent = -1;
+    fStops++;
+
+    // twice, one of them may collide with a sentence of the sensor
+    Send( "S\r" );
+    Send( "S\r" );
+  }
+
+  /** End the frames of the controller, e.g. before exit. */
+  void Unsubscribe()
+   {
+    if ( fPush != kPushRequested && fPush != kPushActive ) return;
+
+    Send( "T0\r" );
+    fPush = kPushOff;
+  }
+
+  void PrintStatistics(ostream &out) const
+   {
+    out << "serial: " << fBytesOut << " bytes sent, " << fBytesIn << " received, "
+        << fQueries << " queries, " << fReplies << " replies, "
+        << fTimeouts << " timeouts, " << fErrors << " errors" << endl;
+    out << "frames: " << fSubscriptions << " subscriptions, " << fFrames << " frames, "
+        << fBadFrames << " bad" << (fPush == kPushUnsupported ? ", not supported" : "")
+        << endl;
+    out << "set_pos: " << fSetRequests << " requests, " << fMoves << " sent, "
+        << fRetries << " repeated, " << fCoalesced << " coalesced, "
+        << fStops << " stops" << endl;
+  }
+
+ private:
+
+  static int Distance(int a,int b)
+   {
+    int d = abs( a - b ) % 360;
+    return d > 180 ? 360 - d : d;
+  }
+
+  // the last 'Mnnn' is sent again if the rotator neither moved nor reached
+  // the target since, it was probably lost
+  void CheckMove(double now)
+   {
+    int position;
+
+    if (    fTargetPending || fTargetSent < 0 || fTargetRetries >= kMoveRetries
+         || now - fTargetTime < kMoveTimeout || !GetPosition( &position ) )
+      return;
+
+    // no position when it was sent: from now on
+    if ( fTargetFrom < 0 ) {
+      fTargetFrom = position;
+      fTargetTime = now;
+      return;
+    }
+
+    bool moving = fPush == kPushActive && fState != 'S';
+
+    if (    moving || Distance( position, fTargetSent ) <= kTolerance
+         || position != fTargetFrom ) {
+      fTargetRetries = kMoveRetries;       // arrived or on the way
+      return;
+    }
+
+    if ( gProgramParameter.fVerbose )
+      cout << "serial: M" << fTargetSent << " without effect, again" << endl;
+
+    fTarget = fTargetSent;
+    fTargetPending = true;
+    fTargetRetries++;
+    fRetries++;
+  }
+
+  // [ms] without a frame after which the subscription is renewed
+  static double PushTimeout()
+   {
+    return 2000. * gProgramParameter.fKeepalive + kReplyTimeout;
+  }
+
+  // "$RCHDG,hhh,s*cs", checksum is the XOR between '$' and '*'
+  bool ParseFrame(const string &line)
+   {
+    int azimuth;
+    char state;
+    unsigned int checksum;
+
+    size_t star = line.find( '*' );
+
+    if ( star == string::npos
+         || sscanf( line.c_str(), "$RCHDG,%d,%c*%x", &azimuth, &state, &checksum ) != 3 )
+      return false;
+
+    unsigned int sum = 0;
+
+    for ( size_t i=1; i<star; ++i ) sum ^= (unsigned char)line[i];
+
+    if ( sum != checksum ) return false;
+
+    fAzimuth = azimuth;
+    fState = state;
+    fUpdated = Now();
+    fFrames++;
+
+    if ( fPush != kPushActive && gProgramParameter.fVerbose )
+      cout << "serial: frames every " << gProgramParameter.fKeepalive << " s" << endl;
+
+    fPush = kPushActive;
+
+    return true;
+  }
+
+  void Send(const char *cmd)
+   {
+    if ( gProgramParameter.fVerbose > 1 )
+      cout << "serial > " << cmd << endl;
+
+    fOutput += cmd;
+
+    OnWritable();
+  }
+
+  // "+0nnn+0eee" (GS-232A) or "AZ=nnn  EL=eee" (GS-232B), "?>" is an error,
+  // "$RCHDG,..." is a frame
+  void ParseLine(const string &line)
+   {
+    int azimuth;
+
+    if ( gProgramParameter.fVerbose > 1 )
+      cout << "serial < " << line << endl;
+
+    if ( line[0] == '$' ) {
+      if ( !ParseFrame( line ) ) fBadFrames++;
+    }
+    else if ( sscanf( line.c_str(), "+%d", &azimuth ) == 1
+         || sscanf( line.c_str(), "AZ=%d", &azimuth ) == 1 ) {
+
+      fAzimuth = azimuth;
+      fUpdated = Now();
+      fQueryTime = -1.;
+      fReplies++;
+    }
+    else if ( line == "?>" ) {
+
+      fErrors++;
+
+      // no answer to 'C2' else, thus this is the one to 'Tnn'
+      if ( fPush == kPushRequested && Now() - fSubscribeTime < kReplyTimeout ) {
+        fPush = kPushUnsupported;
+        if ( gProgramParameter.fVerbose )
+          cout << "serial: no frames from the controller, polling" << endl;
+      }
+    }
+  }
+
+  int             fFd;
+  string          fLine;
+  string          fOutput;
+
+  int             fAzimuth;
+  double          fUpdated;        // [ms], < 0 = never
+  double          fQueryTime;      // [ms] of the open 'C2', < 0 = none
+
+  int             fTarget;
+  bool            fTargetPending;
+  int             fTargetSent;     // < 0 = none or stopped
+  double          fTargetTime;
+  int             fTargetFrom;     // position when it was sent, < 0 = unknown
+  int             fTargetRetries;
+
+  EPushState      fPush;
+  char            fState;          // of the last frame: R, L, B, S
+  double          fSubscribeTime;  // [ms] of the last 'Tnn'
+
+  unsigned long   fQueries, fReplies, fTimeouts, fErrors, fRetries;
+  unsigned long   fSubscriptions, fFrames, fBadFrames;
+  unsigned long   fSetRequests, fMoves, fCoalesced, fStops;
+  unsigned long   fBytesIn, fBytesOut;
+};
+
+// ---------------------------------------------------------------------------
+
+/** Connection of one client. */
+struct Client {
+
+  string          fInput;
+  string          fOutput;
+
+};
+
+static unsigned long gPositionRequests = 0;
+static unsigned long gConnections = 0;
+
+// execute one command line of a client, returns false to close the connection
+static bool ClientCommand(RotorLink &link,const string &line,string &reply)
+ {
+  istringstream in( line );
+  string cmd;
+
+  if ( !(in >> cmd) ) return true;
+
+  if ( cmd == "\\get_pos" ) cmd = "p";
+  else if ( cmd == "\\set_pos" ) cmd = "P";
+  else if ( cmd == "\\stop" ) cmd = "S";
+  else if ( cmd == "\\get_info" ) cmd = "_";
+  else if ( cmd == "\\quit" ) cmd = "q";
+
+  char text[64];
+
+  if ( cmd == "p" ) {
+
+    int azimuth;
+
+    gPositionRequests++;
+
+    if ( link.GetPosition( &azimuth ) ) {
+      snprintf( text, sizeof(text), "%f\n%f\n", (double)azimuth, 0. );
+      reply += text;
+    }
+    else
+      reply += "RPRT -5\n";            // -RIG_ETIMEOUT
+  }
+  else if ( cmd == "P" ) {
+
+    double azimuth, elevation;
+
+    if ( in >> azimuth >> elevation ) {
+      link.SetPosition( azimuth );
+      reply += "RPRT 0\n";
+    }
+    else
+      reply += "RPRT -1\n";            // -RIG_EINVAL
+  }
+  else if ( cmd == "S" ) {
+
+    link.Stop();
+    reply += "RPRT 0\n";
+  }
+  else if ( cmd == "_" )
+    reply += "RotorControl (GS-232)\n";
+  else if ( cmd == "\\dump_state" ) {
+
+    // protocol version, model, min./max. azimuth and elevation
+    reply += "1\n2\n0.000000\n360.000000\n0.000000\n0.000000\n";
+  }
+  else if ( cmd == "q" || cmd == "Q" )
+    return false;
+  else
+    reply += "RPRT -4\n";              // -RIG_ENIMPL
+
+  return true;
+}
+
+// ---------------------------------------------------------------------------
+
+static void Usage(const char *argv0)
+ {
+  cout << "Usage: " << argv0 << " [options] -d <serial_port>" << endl;
+  cout << endl;
+  cout << "where" << endl;
+  cout << "\t-d <serial_port> : controller with GS-232 (default: "
+       << gProgramParameter.fSerialPort << ")" << endl;
+  cout << "\t-s <baud>        : baud rate (default: " << gProgramParameter.fBaudRate << ")" << endl;
+  cout << "\t-t <port>        : TCP port on localhost (default: "
+       << gProgramParameter.fTcpPort << ")" << endl;
+  cout << "\t-r <msec>        : poll period of the position (default: "
+       << gProgramParameter.fPollPeriod << ")" << endl;
+  cout << "\t-k <sec>         : keepalive of the position frames, 0: polling (default: "
+       << gProgramParameter.fKeepalive << ")" << endl;
+  cout << "\t-v               : more verbose output (-v -v: serial data)" << endl;
+  cout << "\t-h,-?            : display this help page" << endl;
+  cout << endl;
+}
+
+// ---------------------------------------------------------------------------
+
+static void SignalHandler(int)
+ {
+  gStop = 1;
+}
+
+static void EpollSet(int epfd,int op,int fd,uint32_t events)
+ {
+  struct epoll_event ev;
+
+  memset( &ev, 0, sizeof(ev) );
+  ev.events = events;
+  ev.data.fd = fd;
+
+  epoll_ctl( epfd, op, fd, &ev );
+}
+
+// ---------------------------------------------------------------------------
+
+int main(int argc,char **argv)
+ {
+  int getopt_status;
+
+  while ( (getopt_status = getopt( argc, argv, "d:k:r:s:t:vh?" )) != EOF ) {
+
+    switch ( getopt_status ) {
+
+      case 'd': gProgramParameter.fSerialPort = optarg;
+                break;
+
+      case 'k': gProgramParameter.fKeepalive = atoi( optarg );
+                break;
+
+      case 'r': gProgramParameter.fPollPeriod = atoi( optarg );
+                break;
+
+      case 's': gProgramParameter.fBaudRate = atoi( optarg );
+                break;
+
+      case 't': gProgramParameter.fTcpPort = atoi( optarg );
+                break;
+
+      case 'v': gProgramParameter.fVerbose++;
+                break;
+
+      case 'h':
+      case '?':
+      default:  Usage( argv[0] );
+                exit( EXIT_FAILURE );
+    }
+  }
+
+  if ( gProgramParameter.fPollPeriod < 20 ) gProgramParameter.fPollPeriod = 20;
+
+  // range of the controller's 'Tnn'
+  if ( gProgramParameter.fKeepalive < 0 ) gProgramParameter.fKeepalive = 0;
+  if ( gProgramParameter.fKeepalive > 99 ) gProgramParameter.fKeepalive = 99;
+
+  // --- program setup
+
+  RotorLink link;
+
+  if ( !link.Open( gProgramParameter.fSerialPort.c_str(), gProgramParameter.fBaudRate ) ) {
+    cerr << argv[0] << ": error opening " << gProgramParameter.fSerialPort
+         << " at " << gProgramParameter.fBaudRate << " baud!" << endl;
+    exit( EXIT_FAILURE );
+  }
+
+  int listen_fd = socket( AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0 );
+  int on = 1;
+
+  setsockopt( listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on) );
+
+  struct sockaddr_in addr;
+
+  memset( &addr, 0, sizeof(addr) );
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+  addr.sin_port = htons( gProgramParameter.fTcpPort );
+
+  if ( bind( listen_fd, (struct sockaddr *)&addr, sizeof(addr) ) < 0
+       || listen( listen_fd, 8 ) < 0 ) {
+    cerr << argv[0] << ": cannot listen on port " << gProgramParameter.fTcpPort
+         << ": " << strerror( errno ) << endl;
+    exit( EXIT_FAILURE );
+  }
+
+  int timer_fd = timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK );
+
+  struct itimerspec period;
+
+  period.it_interval.tv_sec = gProgramParameter.fPollPeriod / 1000;
+  period.it_interval.tv_nsec = (gProgramParameter.fPollPeriod % 1000) * 1000000L;
+  period.it_value = period.it_interval;
+
+  timerfd_settime( timer_fd, 0, &period, NULL );
+
+  int epfd = epoll_create1( 0 );
+
+  EpollSet( epfd, EPOLL_CTL_ADD, listen_fd, EPOLLIN );
+  EpollSet( epfd, EPOLL_CTL_ADD, timer_fd, EPOLLIN );
+  EpollSet( epfd, EPOLL_CTL_ADD, link.GetFd(), EPOLLIN );
+
+  bool serial_out = false;      // EPOLLOUT requested for the serial port
+
+  struct sigaction sa;
+
+  memset( &sa, 0, sizeof(sa) );
+  sa.sa_handler = SignalHandler;
+  sigaction( SIGINT, &sa, NULL );
+  sigaction( SIGTERM, &sa, NULL );
+  signal( SIGPIPE, SIG_IGN );
+
+  if ( gProgramParameter.fVerbose )
+    cout << argv[0] << ": " << gProgramParameter.fSerialPort << ", listening on localhost:"
+         << gProgramParameter.fTcpPort << endl;
+
+  map<int,Client> clients;
+
+  unsigned long lost = 0;       // commands of the link, to see a new one
+
+  srand( time( NULL ) );
+
+  // --- the event loop
+
+  while ( !gStop ) {
+
+    struct epoll_event events[16];
+
+    int n = epoll_wait( epfd, events, 16, -1 );
+
+    if ( n < 0 ) {
+      if ( errno == EINTR ) continue;
+      cerr << argv[0] << ": epoll_wait(): " << strerror( errno ) << endl;
+      break;
+    }
+
+    for ( int i=0; i<n; ++i ) {
+
+      int fd = events[i].data.fd;
+
+      if ( fd == listen_fd ) {
+
+        int client_fd;
+
+        while ( (client_fd = accept4( listen_fd, NULL, NULL, SOCK_NONBLOCK )) >= 0 ) {
+          clients[client_fd] = Client();
+          EpollSet( epfd, EPOLL_CTL_ADD, client_fd, EPOLLIN );
+          gConnections++;
+        }
+      }
+      else if ( fd == timer_fd ) {
+
+        uint64_t expirations;
+
+        if ( read( timer_fd, &expirations, sizeof(expirations) ) > 0 )
+          link.Tick();
+
+        // a lost command, the poll period may be in step with the sentences
+        // of the sensor: move the next ticks by a random part of the period
+        if ( link.GetLost() != lost ) {
+
+          long shift = 1 + rand() % gProgramParameter.fPollPeriod;
+
+          lost = link.GetLost();
+
+          period.it_value.tv_sec = shift / 1000;
+          period.it_value.tv_nsec = (shift % 1000) * 1000000L;
+          timerfd_settime( timer_fd, 0, &period, NULL );
+        }
+      }
+      else if ( fd == link.GetFd() ) {
+
+        if ( events[i].events & EPOLLOUT ) link.OnWritable();
+
+        if ( (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+             && !link.OnReadable() ) {
+          cerr << argv[0] << ": " << gProgramParameter.fSerialPort << " closed!" << endl;
+          gStop = 1;
+        }
+      }
+      else {
+
+        Client &client = clients[fd];
+        bool keep = true;
+
+        if ( events[i].events & EPOLLIN ) {
+
+          char buffer[512];
+          ssize_t nread = read( fd, buffer, sizeof(buffer) );
+
+          if ( nread <= 0 && !(nread < 0 && errno == EAGAIN) )
+            keep = false;
+          else if ( nread > 0 ) {
+
+            client.fInput.append( buffer, nread );
+
+            size_t pos;
+
+            while ( keep && (pos = client.fInput.find( '\n' )) != string::npos ) {
+              keep = ClientCommand( link, client.fInput.substr( 0, pos ), client.fOutput );
+              client.fInput.erase( 0, pos + 1 );
+            }
+
+            // no line end in sight, not a client of ours
+            if ( client.fInput.size() > 256 ) keep = false;
+          }
+        }
+
+        if ( keep && !client.fOutput.empty() ) {
+
+          ssize_t nwritten = write( fd, client.fOutput.data(), client.fOutput.size() );
+
+          if ( nwritten > 0 )
+            client.fOutput.erase( 0, nwritten );
+          else if ( nwritten < 0 && errno != EAGAIN )
+            keep = false;
+
+          EpollSet( epfd, EPOLL_CTL_MOD, fd,
+                    client.fOutput.empty() ? EPOLLIN : EPOLLIN | EPOLLOUT );
+        }
+
+        if ( !keep || (events[i].events & (EPOLLHUP | EPOLLERR)) ) {
+          epoll_ctl( epfd, EPOLL_CTL_DEL, fd, NULL );
+          close( fd );
+          clients.erase( fd );
+        }
+      }
+    }
+
+    // the serial port is slow, wait until it accepts the rest
+    if ( link.WantsWrite() != serial_out ) {
+      serial_out = link.WantsWrite();
+      EpollSet( epfd, EPOLL_CTL_MOD, link.GetFd(), serial_out ? EPOLLIN | EPOLLOUT : EPOLLIN );
+    }
+  }
+
+  // the controller would otherwise keep sending frames
+  link.Unsubscribe();
+
+  // --- summary
+
+  if ( gProgramParameter.fVerbose ) {
+    cout << argv[0] << ": " << gConnections << " connections, "
+         << gPositionRequests << " position requests" << endl;
+    link.PrintStatistics( cout );
+  }
+
+  for ( map<int,Client>::iterator it=clients.begin(); it!=clients.end(); ++it )
+    close( it->first );
+
+  close( epfd );
+  close( timer_fd );
+  close( listen_fd );
+
+  return EXIT_SUCCESS;
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
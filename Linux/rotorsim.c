@@ -0,0 +1,1426 @@
+//
+// File   : rotorsim.c
+//
+// Purpose: Host build of the rotator controller firmware, running on
+//          virtual hardware with a simulated (accelerated) clock.
+//
+// $Id$
+//
+
+#define _GNU_SOURCE  // posix_openpt(), cfmakeraw()
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>   // getopt()
+
+/** @file rotorsim.c
+  * Host build of the rotator controller firmware.
+  *
+  * The firmware sources (rotorcontrol.c, rotorstate.c, compass.c, ...) are
+  * compiled natively against the headers in hostsim/, which replace the
+  * AVR registers, the TIMER0_OVF and TWI interrupts and P.Fleury's UART
+  * library by the backend implemented here:
+  *
+  * @li the simulated clock only advances when the firmware is waiting
+  *     (uart_getc() without data, _delay_ms(), blocking UART TX),
+  *     thus a replay runs as fast as the host allows
+  * @li the 10 ms timer interrupt is called whenever the clock passes the
+  *     next overflow of timer 0, the period is derived from TCNT0/TCCR0
+  * @li UART RX is fed from a recorded file (Linux/ *.dat) at the configured
+  *     baud rate and frame period, into a ring buffer of UART_RX_BUFFER_SIZE
+  *     which overflows in the same way as on the target; with
+  *     COMPASS_BINARY_FORMAT the $ACRAW lines are sent as binary frames
+  * @li the TWI executes each write of TWCR with TWINT set, after the time
+  *     for one byte at the configured SCL clock TWI_vect is called with
+  *     the status in TWSR; transactions to the display are decoded and
+  *     logged
+  * @li button presses can be scripted from the command line
+  * @li with GS232_SERVER, GS-232 commands from the command line or from a
+  *     pseudo terminal (-t, e.g. for rotctl) are sent on the RX line in
+  *     the gaps between the sensor sentences, the data sent by the firmware
+  *     are also written to the pseudo terminal; with -j they are sent when
+  *     due as by a real host, which cannot see the gaps, and collide with
+  *     a sentence on the line (wired-AND of the bytes)
+  * @li instead of a recorded file, the sensor data can be derived from a
+  *     model of the rotator (-m), which is driven by the relays and turns
+  *     between the mechanical stops at fLimitAngle and fRotorRange of the
+  *     configuration (-w, e.g. 450 deg with overlap), thus the closed loop of
+  *     PresetGoto() can be tested
+  *
+  * @author H.-J. Mathes <dc2ip@darc.de>
+  */
+
+#include "global.h"
+
+#include <avr/interrupt.h>
+#include <util/twi.h>
+#include <uart.h>
+
+#include "i2cdisplay.h"
+
+#ifdef COMPASS_BINARY_FORMAT
+#include "binframe.h"
+#endif // COMPASS_BINARY_FORMAT
+
+/** main() of the firmware, renamed when compiling rotorcontrol.c. */
+extern int FirmwareMain(void);
+
+// ---------------------------------------------------------------------------
+
+/* --- the virtual registers --- */
+
+volatile uint8_t PORTA, PINA = 0xff, DDRA;
+volatile uint8_t PORTB, PINB = 0xff, DDRB;
+volatile uint8_t PORTC, PINC = 0xff, DDRC;
+volatile uint8_t PORTD, PIND = 0xff, DDRD;
+
+volatile uint8_t TCNT0, TCCR0, TIMSK;
+
+volatile uint8_t TWBR, TWSR = 0xf8, TWDR, TWCR;
+
+/* --- simulation parameters --- */
+
+static struct SimParameters {
+
+  const char     *fInputFile;
+  const char     *fOutputFile;
+  double          fFramePeriod;     // [us]
+  double          fLinger;          // [us]
+  double          fSpeed;           // 0 = as fast as possible
+  long            fBaudRate;
+  int             fVerbose;
+  double          fModelSpeed;      // [deg/s], < 0 = data from fInputFile
+  double          fModelStart;      // [deg]
+  double          fModelEnd;        // [us]
+  double          fModelRunOut;     // [s] time constant after the motor stops
+  int             fModelRange;      // [deg], 0 = EEPROM default
+  double          fModelShift[2];   // [counts] of the sensor vs the EEPROM
+  double          fDisplayOff[2];   // [us] the display does not answer
+  int             fCollide;         // host commands do not wait for a gap
+
+} gSim = {
+
+  "-",       /* fInputFile */
+  NULL,      /* fOutputFile */
+  100000.,   /* fFramePeriod */
+  1000000.,  /* fLinger */
+  0.,        /* fSpeed */
+  9600,      /* fBaudRate */
+  1,         /* fVerbose */
+  -1.,       /* fModelSpeed */
+  0.,        /* fModelStart */
+  60000000., /* fModelEnd */
+  0.,        /* fModelRunOut */
+  0,         /* fModelRange */
+  { 0., 0. }, /* fModelShift */
+  { 0., 0. }, /* fDisplayOff */
+  0           /* fCollide */
+};
+
+/** Time [us] spent in one pass of the main loop, apart from waiting. */
+#define SIM_LOOP_US       20.0
+
+/* --- simulation state --- */
+
+static double   gNow = 0.;           // simulated time [us]
+static double   gNextTick = -1.;     // next timer 0 overflow, < 0 = stopped
+static uint8_t  gIntEnabled = 0;
+static uint8_t  gIntPending = 0;     // SIM_IRQ_... bits
+static uint8_t  gInIsr = 0;
+
+static double   gTwiDone = -1.;      // end of the current TWI operation, < 0 = none
+static uint8_t  gTwiStatus;          // TWSR at gTwiDone
+
+static struct timespec gWallStart;
+
+static struct SimStatistics {
+
+  unsigned long fTicks;
+  unsigned long fRxBytes;
+  unsigned long fRxLines;
+  unsigned long fRxOverflows;
+  unsigned long fRxCollisions;     // host commands sent during a sentence
+  unsigned long fTxBytes;
+  unsigned long fI2cTransactions;
+  unsigned long fI2cBytes;
+  unsigned long fI2cErrors;
+  unsigned long fI2cInits;
+  unsigned long fEepromWrites;
+  unsigned long fHeadingSamples;    // model stopped, heading settled
+  double        fHeadingError2;
+  double        fHeadingErrorMax;
+  unsigned long fRelaySwitches;
+
+} gStat;
+
+/** Interrupt sources, in the order of their priority. */
+#define SIM_IRQ_TIMER0    0x01
+#define SIM_IRQ_TWI       0x02
+
+static void SimService(void);
+static void SimTwiCheck(void);
+static void SimDisplayTimer(void);
+static void SimModelAdvance(void);
+static void SimExit(void);
+
+// ---------------------------------------------------------------------------
+
+static void SimLog(const char *what,const char *fmt,int value)
+ {
+  printf( "%10.3f  %-8s ", gNow / 1000000., what );
+  printf( fmt, value );
+  printf( "\n" );
+}
+
+// ---------------------------------------------------------------------------
+
+/* --- button script --- */
+
+#define SIM_MAX_BUTTON_EVENTS   32
+
+static struct ButtonEvent {
+
+  double   fStart;     // [us]
+  double   fStop;      // [us]
+  uint8_t  fMask;
+
+} gButtons[SIM_MAX_BUTTON_EVENTS];
+
+static int gNButtons = 0;
+
+static int SimAddButton(const char *spec)
+ {
+  static const struct { const char *fName; uint8_t fMask; } cButtonNames[] = {
+    { "CW", BUTTON_CW }, { "CCW", BUTTON_CCW }, { "STOP", BUTTON_STOP },
+    { "PCW", BUTTON_PRESET_CW }, { "PCCW", BUTTON_PRESET_CCW },
+  };
+
+  char name[8];
+  double start, duration;
+
+  if ( gNButtons == SIM_MAX_BUTTON_EVENTS ) return -1;
+
+  if ( sscanf( spec, "%lf:%7[A-Z]:%lf", &start, name, &duration ) != 3 )
+    return -1;
+
+  for ( unsigned int i=0; i<sizeof(cButtonNames)/sizeof(cButtonNames[0]); ++i ) {
+
+    if ( strcmp( name, cButtonNames[i].fName ) ) continue;
+
+    gButtons[gNButtons].fStart = start * 1000.;
+    gButtons[gNButtons].fStop = (start + duration) * 1000.;
+    gButtons[gNButtons].fMask = cButtonNames[i].fMask;
+    gNButtons++;
+
+    return 0;
+  }
+
+  return -1;
+}
+
+// buttons are active low, pull-ups on
+static void SimUpdateButtons(void)
+ {
+  uint8_t pressed = 0;
+
+  for ( int i=0; i<gNButtons; ++i ) {
+    if ( gNow >= gButtons[i].fStart && gNow < gButtons[i].fStop )
+      pressed |= gButtons[i].fMask;
+  }
+
+  PINA = 0xff & ~pressed;
+}
+
+// ---------------------------------------------------------------------------
+
+/* --- GS-232 commands of the tracking software --- */
+
+#define SIM_MAX_HOST_COMMANDS   256
+
+static struct HostCommand {
+
+  double   fTime;      // [us]
+  char     fText[16];
+  uint8_t  fSent;
+
+} gHostCommands[SIM_MAX_HOST_COMMANDS];
+
+static int gNHostCommands = 0;
+static int gPty = -1;
+
+static int SimAddHostCommand(const char *spec)
+ {
+  struct HostCommand *cmd = &gHostCommands[gNHostCommands];
+  double start;
+
+  if ( gNHostCommands == SIM_MAX_HOST_COMMANDS ) return -1;
+
+  if ( sscanf( spec, "%lf:%14s", &start, cmd->fText ) != 2 ) return -1;
+
+  cmd->fTime = start * 1000.;
+  cmd->fSent = 0;
+  strcat( cmd->fText, "\r" );
+
+  gNHostCommands++;
+
+  return 0;
+}
+
+static int SimOpenPty(void)
+ {
+  if ( (gPty = posix_openpt( O_RDWR | O_NOCTTY )) < 0 ) return -1;
+
+  if ( grantpt( gPty ) || unlockpt( gPty ) ) return -1;
+
+  // raw mode: no echo, CR is not translated
+  struct termios tio;
+
+  tcgetattr( gPty, &tio );
+  cfmakeraw( &tio );
+  tcsetattr( gPty, TCSANOW, &tio );
+
+  fcntl( gPty, F_SETFL, fcntl( gPty, F_GETFL ) | O_NONBLOCK );
+
+  fprintf( stderr, "rotorsim: GS-232 on %s\n", ptsname( gPty ) );
+
+  return 0;
+}
+
+// the byte is lost if nobody reads the pty, as on a real wire
+static void SimPtyWrite(uint8_t data)
+ {
+  if ( write( gPty, &data, 1 ) != 1 ) return;
+}
+
+// data of the tracking software due at 't', copied to 'line'
+static size_t SimHostData(double t,char *line,size_t size,double *due)
+ {
+  struct HostCommand *next = NULL;
+
+  for ( int i=0; i<gNHostCommands; ++i ) {
+    if ( !gHostCommands[i].fSent && gHostCommands[i].fTime <= t
+         && (!next || gHostCommands[i].fTime < next->fTime) )
+      next = &gHostCommands[i];
+  }
+
+  if ( next ) {
+    next->fSent = 1;
+    *due = next->fTime;
+    strncpy( line, next->fText, size );
+    return strlen( line );
+  }
+
+  if ( gPty >= 0 ) {
+    ssize_t n = read( gPty, line, size );
+    *due = gNow;
+    if ( n > 0 ) return n;
+  }
+
+  return 0;
+}
+
+// ---------------------------------------------------------------------------
+
+/* --- relays and LEDs --- */
+
+static void SimCheckPorts(void)
+ {
+  static uint8_t relay_old = 0, led_old = 0;
+
+  // with the relays before this tick
+  if ( gSim.fModelSpeed >= 0. ) SimModelAdvance();
+
+  uint8_t relay = RELAY_PORT & (RELAY_POWER | RELAY_STOP | RELAY_CW | RELAY_CCW);
+  uint8_t led = LED_PORT & (LED_LEFT | LED_RIGHT | LED_CALIBRATE | LED_OVERLOAD);
+
+  if ( relay != relay_old ) {
+
+    gStat.fRelaySwitches++;
+
+    if ( gSim.fVerbose > 1 ) {
+      char s[32];
+      snprintf( s, sizeof(s), "%s %s %s %s",
+                relay & RELAY_POWER ? "POWER" : "-----",
+                relay & RELAY_STOP  ? "BRAKE" : "-----",
+                relay & RELAY_CCW   ? "CCW"   : "---",
+                relay & RELAY_CW    ? "CW"    : "--" );
+      printf( "%10.3f  %-8s %s\n", gNow / 1000000., "relay", s );
+    }
+
+    relay_old = relay;
+  }
+
+  if ( led != led_old ) {
+
+    if ( gSim.fVerbose > 1 )
+      SimLog( "led", "0x%02x", led );
+
+    led_old = led;
+  }
+}
+
+// ---------------------------------------------------------------------------
+
+/* --- timer 0 --- */
+
+static double SimTimer0Period(void)
+ {
+  static const uint16_t cPrescaler[8] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+
+  uint16_t prescaler = cPrescaler[TCCR0 & 0x07];
+
+  if ( !prescaler ) return -1.;
+
+  return (256 - TCNT0) * (double)prescaler * 1000000. / F_CPU;
+}
+
+// call the pending interrupt routines, if the firmware allows
+static void SimFireInterrupts(void)
+ {
+  while ( gIntPending && gIntEnabled && !gInIsr ) {
+
+    gInIsr = 1;
+
+    if ( gIntPending & SIM_IRQ_TIMER0 ) {
+
+      gIntPending &= ~SIM_IRQ_TIMER0;
+
+      SimUpdateButtons();
+
+      SimTimer0OvfVect();
+
+      gInIsr = 0;
+      gStat.fTicks++;
+
+      SimCheckPorts();
+    }
+    else {
+
+      gIntPending &= ~SIM_IRQ_TWI;
+
+      SimTwiVect();
+
+      gInIsr = 0;
+    }
+
+    // the routines may have started the next TWI operation
+    SimTwiCheck();
+  }
+}
+
+static void SimTimer0Overflow(void)
+ {
+  if ( !(TIMSK & (1<<TOIE0)) ) return;
+
+  gIntPending |= SIM_IRQ_TIMER0;
+
+  SimFireInterrupts();
+}
+
+void SimSei(void)
+ {
+  gIntEnabled = 1;
+
+  SimFireInterrupts();
+}
+
+void SimCli(void)
+ {
+  gIntEnabled = 0;
+}
+
+// ---------------------------------------------------------------------------
+
+/* --- the clock --- */
+
+static void SimPace(void)
+ {
+  if ( gSim.fSpeed <= 0. ) return;
+
+  struct timespec now;
+  clock_gettime( CLOCK_MONOTONIC, &now );
+
+  double wall = (now.tv_sec - gWallStart.tv_sec) * 1000000.
+              + (now.tv_nsec - gWallStart.tv_nsec) / 1000.;
+  double ahead = gNow / gSim.fSpeed - wall;
+
+  if ( ahead > 1000. ) usleep( (useconds_t)ahead );
+}
+
+static void SimTwiComplete(void);
+
+static void SimAdvanceTo(double t)
+ {
+  if ( t <= gNow ) return;
+
+  if ( gNextTick < 0. && (TCCR0 & 0x07) )
+    gNextTick = gNow + SimTimer0Period();
+
+  while ( 1 ) {
+
+    // next event: end of a TWI operation or overflow of timer 0
+    uint8_t twi = gTwiDone >= 0. && (gNextTick < 0. || gTwiDone < gNextTick);
+    double next = twi ? gTwiDone : gNextTick;
+
+    if ( next < 0. || next > t ) break;
+
+    gNow = next;
+
+    SimService();
+
+    if ( twi ) {
+      SimTwiComplete();
+      continue;
+    }
+
+    SimTimer0Overflow();
+
+    double period = SimTimer0Period();
+    gNextTick = period > 0. ? gNow + period : -1.;
+  }
+
+  gNow = t;
+
+  SimService();
+  SimPace();
+}
+
+void SimDelayUs(double us)
+ {
+  SimAdvanceTo( gNow + us );
+}
+
+// ---------------------------------------------------------------------------
+
+/* --- rotator model --- */
+
+/** Time constant [s] of the motor, for start and run-out. */
+#define SIM_MODEL_TAU     0.3
+
+/** The configuration programmed before the start, the stops of the model
+  * and the calibration of its sensor.
+  */
+static config_t gModelConfig;
+
+static double   gModelPosition = -1.;  // [deg] from the CCW stop, < 0 = not yet set
+static double   gModelRate = 0.;       // [deg/s]
+static double   gModelTime = 0.;       // [us] of gModelPosition
+
+// turn the model from gModelTime to now with the current relays
+static void SimModelAdvance(void)
+ {
+  if ( gModelPosition < 0. ) {
+    gModelPosition = fmod( gSim.fModelStart - gModelConfig.fLimitAngle + 720., 360. );
+    if ( gSim.fModelStart >= 360. ) gModelPosition += 360.;   // overlap
+    gModelTime = gNow;
+  }
+
+  double dt = (gNow - gModelTime) / 1000000.;
+  uint8_t relay = RELAY_PORT;
+
+  gModelTime = gNow;
+
+  // the brake holds the rotator unless power is on and it is released,
+  // the mast may still turn on (wind, load) with the run-out time constant
+  uint8_t released = (relay & RELAY_POWER) && (relay & RELAY_STOP);
+
+  double drive = !released ? 0.
+               : relay & RELAY_CW ? gSim.fModelSpeed
+               : relay & RELAY_CCW ? -gSim.fModelSpeed : 0.;
+
+  double tau = drive != 0. ? SIM_MODEL_TAU : gSim.fModelRunOut;
+
+  if ( released && tau < SIM_MODEL_TAU ) tau = SIM_MODEL_TAU;
+
+  if ( tau > 0. )
+    gModelRate += (drive - gModelRate) * (1. - exp( -dt / tau ));
+  else
+    gModelRate = drive;
+
+  gModelPosition += gModelRate * dt;
+
+  // mechanical stops
+  if ( gModelPosition < 0. ) {
+    gModelPosition = 0.;
+    gModelRate = 0.;
+  }
+  else if ( gModelPosition > gModelConfig.fRotorRange - 0.1 ) {
+    gModelPosition = gModelConfig.fRotorRange - 0.1;
+    gModelRate = 0.;
+  }
+}
+
+static double SimModelAzimuth(void)
+ {
+  return fmod( gModelPosition + gModelConfig.fLimitAngle, 360. );
+}
+
+// error of the heading of the firmware while the model is stopped, the
+// firmware takes data after some 5 s, a stop settles within 1 s
+static void SimModelHeadingError(void)
+ {
+  static double moving = 0.;   // [us] last time the model was moving
+
+  if ( gModelRate != 0. ) moving = gNow;
+
+  if ( gNow < 5000000. || gNow - moving < 1000000. ) return;
+
+  double error = fmod( GetCurrentHeading() - SimModelAzimuth() + 540., 360. ) - 180.;
+
+  gStat.fHeadingSamples++;
+  gStat.fHeadingError2 += error * error;
+  if ( fabs( error ) > gStat.fHeadingErrorMax ) gStat.fHeadingErrorMax = fabs( error );
+}
+
+// $ACRAW sentence of a level sensor at the model azimuth, the inverse of
+// GetHeading3D(): heading = atan2(-mx,-my) of the corrected magnetic vector
+// m' = W (m - c), thus m = c + W^-1 m'; the sensor keeps the calibration
+// programmed before the start, shifted by -c (e.g. a changed mast)
+static size_t SimModelSentence(char *line,size_t size)
+ {
+  static mag_calib_t mag;
+  static double inv[3][3];
+
+  if ( !mag.fMagic ) {
+
+    mag = gModelConfig.fMAG_calib;
+
+    if ( mag.fMagic != MAG_CALIB_MAGIC )
+      MagCalibInit( &mag, &gModelConfig.fMAG_min, &gModelConfig.fMAG_max );
+
+    mag.fOffset[0] += gSim.fModelShift[0];
+    mag.fOffset[1] += gSim.fModelShift[1];
+
+    float (*w)[3] = mag.fMatrix;
+
+    // inverse by the cofactors
+    for ( int i=0; i<3; ++i )
+      for ( int j=0; j<3; ++j )
+        inv[j][i] = w[(i+1)%3][(j+1)%3] * w[(i+2)%3][(j+2)%3]
+                  - w[(i+1)%3][(j+2)%3] * w[(i+2)%3][(j+1)%3];
+
+    double det = w[0][0] * inv[0][0] + w[0][1] * inv[1][0] + w[0][2] * inv[2][0];
+
+    for ( int i=0; i<3; ++i )
+      for ( int j=0; j<3; ++j )
+        inv[i][j] /= det;
+  }
+
+  SimModelAdvance();
+  SimModelHeadingError();
+
+  double azimuth = SimModelAzimuth() * M_PI / 180.;
+  double m[3] = { -sin( azimuth ), -cos( azimuth ), 0. };
+  long raw[3];
+
+  for ( int i=0; i<3; ++i )
+    raw[i] = lround( mag.fOffset[i] + inv[i][0] * m[0] + inv[i][1] * m[1]
+                                    + inv[i][2] * m[2] );
+
+  int n = snprintf( line, size, "$ACRAW,0,0,-16384,%ld,%ld,%ld",
+                    raw[0], raw[1], raw[2] );
+  uint8_t checksum = 0;
+
+  for ( int i=1; i<n; ++i ) checksum ^= line[i];
+
+  n += snprintf( line + n, size - n, "*%02X\n", checksum );
+
+  return n;
+}
+
+// ---------------------------------------------------------------------------
+
+/* --- UART --- */
+
+static FILE    *gInput = NULL;
+static FILE    *gOutput = NULL;
+
+static double   gByteTime;           // [us]
+
+static char     gLine[256];
+static size_t   gLineLen = 0, gLinePos = 0;
+static uint8_t  gLineHost = 0;       // gLine is from the tracking software
+
+static char     gCollideLine[64];    // command sent during a sentence (-j)
+static size_t   gCollideLen = 0, gCollidePos = 0;
+static size_t   gCollideAt = 0;      // position in gLine where it starts
+static double   gNextRx = -1.;       // arrival of next byte, < 0 = EOF
+static double   gFrameStart = 0.;
+static double   gEofTime = -1.;
+
+static uint8_t  gRxBuffer[UART_RX_BUFFER_SIZE];
+static uint8_t  gRxHead = 0, gRxTail = 0;
+static uint8_t  gRxError = 0;
+
+static uint8_t  gTxBuffer[UART_TX_BUFFER_SIZE];
+static uint8_t  gTxHead = 0, gTxTail = 0;
+static double   gTxDone = 0.;        // end of transmission of current byte
+
+// schedule the arrival of the next byte from the input file
+static void SimRxNext(void)
+ {
+  double due;
+
+  if ( gLinePos < gLineLen ) {
+
+    // -j: a command due now is sent during the sentence
+    if ( gSim.fCollide && !gLineHost && gCollideLen == 0 ) {
+      gCollideLen = SimHostData( gNextRx, gCollideLine, sizeof(gCollideLine), &due );
+      gCollidePos = 0;
+      gCollideAt = gLinePos;
+      if ( gCollideLen ) gStat.fRxCollisions++;
+    }
+
+    gNextRx += gByteTime;
+    return;
+  }
+
+  // the rest of a command which collided with the sentence
+  if ( gCollidePos < gCollideLen ) {
+    gLineLen = gCollideLen - gCollidePos;
+    memcpy( gLine, gCollideLine + gCollidePos, gLineLen );
+    gLinePos = 0;
+    gLineHost = 1;
+    gCollideLen = gCollidePos = 0;
+    gNextRx += gByteTime;
+    return;
+  }
+
+  gCollideLen = gCollidePos = 0;
+
+  // commands of the tracking software, before the next sentence starts
+  size_t n = SimHostData( gSim.fCollide ? gNextRx : gFrameStart, gLine, sizeof(gLine), &due );
+
+  if ( n ) {
+    gLineLen = n;
+    gLinePos = 0;
+    gLineHost = 1;
+    gNextRx = (due > gNextRx ? due : gNextRx) + gByteTime;
+    return;
+  }
+
+  gLineHost = 0;
+
+  if ( gSim.fModelSpeed >= 0. ) {
+
+    if ( gNow > gSim.fModelEnd || !SimModelSentence( gLine, sizeof(gLine) ) ) {
+      gEofTime = gNextRx < gNow ? gNow : gNextRx;
+      gNextRx = -1.;
+      return;
+    }
+  }
+  else if ( !gInput || !fgets( gLine, sizeof(gLine), gInput ) ) {
+    gEofTime = gNextRx < gNow ? gNow : gNextRx;
+    gNextRx = -1.;
+    return;
+  }
+
+  gLineLen = strlen( gLine );
+  gLinePos = 0;
+  gStat.fRxLines++;
+
+#ifdef COMPASS_BINARY_FORMAT
+  // what lsm303read.c sends with UseBinaryFormat
+  static uint8_t sequence = 0;
+  const char *acraw = strstr( gLine, "$ACRAW," );
+  int v[BINFRAME_N_VALUES];
+
+  if ( acraw && sscanf( acraw, "$ACRAW,%d,%d,%d,%d,%d,%d",
+                        &v[0], &v[1], &v[2], &v[3], &v[4], &v[5] ) == 6 ) {
+
+    bin_frame_t frame;
+
+    frame.fSequence = sequence++;
+    for ( int i=0; i<BINFRAME_N_VALUES; ++i ) frame.fValue[i] = v[i];
+
+    gLineLen = BinFrameEncode( &frame, (uint8_t *)gLine );
+  }
+#endif // COMPASS_BINARY_FORMAT
+
+  // the sensor starts a new sentence every frame period, if the wire is free
+  double start = gFrameStart > gNextRx ? gFrameStart : gNextRx;
+
+  gFrameStart += gSim.fFramePeriod;
+  gNextRx = start + gByteTime;
+}
+
+static void SimPumpRx(void)
+ {
+  while ( gNextRx >= 0. && gNextRx <= gNow ) {
+
+    uint8_t head = (gRxHead + 1) % UART_RX_BUFFER_SIZE;
+
+    if ( head == gRxTail ) {
+      gRxError = UART_BUFFER_OVERFLOW >> 8;
+      gStat.fRxOverflows++;
+    }
+    else {
+      gRxBuffer[head] = gLine[gLinePos];
+      gRxHead = head;
+
+      // both send, byte aligned: wired-AND
+      if ( gCollidePos < gCollideLen && gLinePos >= gCollideAt )
+        gRxBuffer[head] &= gCollideLine[gCollidePos++];
+    }
+
+    gLinePos++;
+    gStat.fRxBytes++;
+
+    SimRxNext();
+  }
+}
+
+// after the end of the input, the tracking software may still send
+static void SimRxHost(void)
+ {
+  double due;
+
+  // -j: a command due before the next sentence starts is sent at once, the
+  // part which is still on the line then collides with the sentence
+  if (    gSim.fCollide && gNextRx >= 0. && !gLineHost && gLinePos == 0
+       && gCollideLen == 0 && gNextRx - gByteTime > gNow ) {
+
+    char cmd[sizeof(gCollideLine)];
+    size_t n = SimHostData( gNow, cmd, sizeof(cmd), &due );
+
+    if ( !n || gLineLen + n > sizeof(gLine) ) return;
+
+    size_t k = (gNextRx - gByteTime - gNow) / gByteTime;  // before the sentence
+    if ( k > n ) k = n;
+
+    memmove( gLine + k, gLine, gLineLen );
+    memcpy( gLine, cmd, k );
+    gLineLen += k;
+
+    gCollideLen = n - k;
+    memcpy( gCollideLine, cmd + k, gCollideLen );
+    gCollidePos = 0;
+    gCollideAt = k;
+    if ( gCollideLen ) gStat.fRxCollisions++;
+
+    if ( k ) gNextRx = gNow + gByteTime;
+    return;
+  }
+
+  if ( gNextRx >= 0. ) return;
+
+  size_t n = SimHostData( gNow, gLine, sizeof(gLine), &due );
+
+  if ( !n ) return;
+
+  gLineLen = n;
+  gLinePos = 0;
+  gLineHost = 1;
+  gNextRx = gNow + gByteTime;
+}
+
+static void SimDrainTx(void)
+ {
+  while ( gTxHead != gTxTail && gTxDone <= gNow ) {
+
+    gTxTail = (gTxTail + 1) % UART_TX_BUFFER_SIZE;
+
+    if ( gOutput ) fputc( gTxBuffer[gTxTail], gOutput );
+    if ( gPty >= 0 ) SimPtyWrite( gTxBuffer[gTxTail] );
+
+    gStat.fTxBytes++;
+
+    gTxDone += gByteTime;
+  }
+
+  if ( gTxHead == gTxTail && gTxDone < gNow ) gTxDone = gNow;
+}
+
+static void SimService(void)
+ {
+  SimRxHost();
+  SimPumpRx();
+  SimDrainTx();
+  SimTwiCheck();
+  SimDisplayTimer();
+}
+
+void uart_init(unsigned int baudrate)
+ {
+  gByteTime = 10 * 1000000. / gSim.fBaudRate;  // 8N1
+
+  gRxHead = gRxTail = 0;
+  gTxHead = gTxTail = 0;
+
+  gFrameStart = gNow;
+  gNextRx = gNow;
+  gLinePos = gLineLen = 0;
+
+  SimRxNext();
+}
+
+unsigned int uart_getc(void)
+ {
+  SimAdvanceTo( gNow + SIM_LOOP_US );
+
+  if ( gRxHead == gRxTail ) {
+
+    if ( gNextRx < 0. ) {
+
+      double t = gEofTime + gSim.fLinger;
+
+      if ( gNow >= t ) SimExit();
+
+      if ( gNextTick >= 0. && gNextTick < t ) t = gNextTick;
+
+      SimAdvanceTo( t );
+    }
+    else {
+      // nothing to do for the firmware until the next event
+      double t = gNextRx;
+      if ( gNextTick >= 0. && gNextTick < t ) t = gNextTick;
+
+      SimAdvanceTo( t );
+    }
+
+    return UART_NO_DATA;
+  }
+
+  gRxTail = (gRxTail + 1) % UART_RX_BUFFER_SIZE;
+
+  unsigned int data = (gRxError << 8) + gRxBuffer[gRxTail];
+  gRxError = 0;
+
+  return data;
+}
+
+void uart_putc(unsigned char data)
+ {
+  uint8_t head = (gTxHead + 1) % UART_TX_BUFFER_SIZE;
+
+  SimService();
+
+  // the Fleury library waits for free space in the TX buffer
+  while ( head == gTxTail )
+    SimAdvanceTo( gTxDone > gNow ? gTxDone : gNow + gByteTime );
+
+  if ( gTxHead == gTxTail && gTxDone <= gNow ) gTxDone = gNow + gByteTime;
+
+  gTxBuffer[head] = data;
+  gTxHead = head;
+}
+
+void uart_puts(const char *s)
+ {
+  while ( *s ) uart_putc( *s++ );
+}
+
+void uart_puts_p(const char *s)
+ {
+  uart_puts( s );
+}
+
+// ---------------------------------------------------------------------------
+
+/* --- I2C and the display board --- */
+
+static uint8_t  gI2cBuffer[16];
+static uint8_t  gI2cLength = 0;
+static uint8_t  gI2cActive = 0;      // display addressed
+
+static uint8_t  gTwiEnabled = 0;
+static uint8_t  gTwiMaster = 0;      // START sent
+static uint8_t  gTwiAddressed = 0;   // SLA+W sent
+
+static struct DisplayState {
+
+  uint8_t  fOn;
+  int16_t  fLeft;
+  int16_t  fRight;
+  uint8_t  fRaw[6];
+  double   fDashTime;  // right digits show "---" from then on, -1 = never
+
+} gDisplay = { 0, -1, -1, { 0 }, -1. };
+
+static void SimDisplayLeft(int16_t value)
+ {
+  if ( gDisplay.fLeft != value && gSim.fVerbose )
+    SimLog( "heading", "%3d", value );
+
+  gDisplay.fLeft = value;
+  memset( &gDisplay.fRaw[0], 0, 3 );
+}
+
+static void SimDisplayRight(int16_t value)
+ {
+  if ( gDisplay.fRight != value && gSim.fVerbose )
+    SimLog( "preset", "%3d", value );
+
+  gDisplay.fRight = value;
+  memset( &gDisplay.fRaw[3], 0, 3 );
+}
+
+static void SimDisplayRaw(uint8_t first,uint8_t n,const uint8_t *raw)
+ {
+  if ( memcmp( &gDisplay.fRaw[first], raw, n ) && gSim.fVerbose > 1 ) {
+    char s[32] = "";
+    for ( uint8_t i=0; i<n; ++i )
+      snprintf( s + strlen(s), sizeof(s) - strlen(s), " %02x", raw[i] );
+    printf( "%10.3f  %-8s%s\n", gNow / 1000000., first ? "raw R" : "raw", s );
+  }
+
+  memcpy( &gDisplay.fRaw[first], raw, n );
+
+  if ( first == 0 ) gDisplay.fLeft = -1;
+  if ( first + n > 3 ) gDisplay.fRight = -1;
+}
+
+// I2C_DISP_DATA_TIMED: the display board replaces the preset by "---"
+static void SimDisplayTimer(void)
+ {
+  static const uint8_t dash[3] = { 0x08, 0x08, 0x08 };
+
+  if ( gDisplay.fDashTime < 0. || gNow < gDisplay.fDashTime ) return;
+
+  gDisplay.fDashTime = -1.;
+
+  SimDisplayRaw( 3, 3, dash );
+}
+
+// decode a complete write transaction, see DisplayUR/i2cdisplaydefs.h
+static void SimDisplayTransaction(void)
+ {
+  const uint8_t *d = &gI2cBuffer[2];
+  uint8_t n = gI2cLength > 2 ? gI2cLength - 2 : 0;
+
+  if ( gI2cLength < 2 ) return;
+
+  // any write to the right digits stops the timer
+  if ( gI2cBuffer[1] != I2C_DISP_OFF && gI2cBuffer[1] != I2C_DISP_ON
+       && gI2cBuffer[1] != I2C_DISP_DATA_LEFT
+       && gI2cBuffer[1] != I2C_DISP_RAWDATA_LEFT )
+    gDisplay.fDashTime = -1.;
+
+  switch ( gI2cBuffer[1] ) {
+
+    case I2C_DISP_OFF: gDisplay.fOn = 0; break;
+    case I2C_DISP_ON:  gDisplay.fOn = 1; break;
+
+    case I2C_DISP_DATA:
+         if ( n >= 4 ) {
+           SimDisplayLeft( d[0] | (d[1] << 8) );
+           SimDisplayRight( d[2] | (d[3] << 8) );
+         }
+         break;
+
+    case I2C_DISP_DATA_LEFT:
+         if ( n >= 2 ) SimDisplayLeft( d[0] | (d[1] << 8) );
+         break;
+
+    case I2C_DISP_DATA_RIGHT:
+         if ( n >= 2 ) SimDisplayRight( d[0] | (d[1] << 8) );
+         break;
+
+    case I2C_DISP_RAWDATA:
+         if ( n >= 6 ) SimDisplayRaw( 0, 6, d );
+         break;
+
+    case I2C_DISP_RAWDATA_LEFT:
+         if ( n >= 3 ) SimDisplayRaw( 0, 3, d );
+         break;
+
+    case I2C_DISP_RAWDATA_RIGHT:
+         if ( n >= 3 ) SimDisplayRaw( 3, 3, d );
+         break;
+
+    case I2C_DISP_DATA_TIMED:
+         if ( n >= 6 ) {
+           uint16_t timeout = d[4] | (d[5] << 8);
+           SimDisplayLeft( d[0] | (d[1] << 8) );
+           if ( timeout ) SimDisplayRight( d[2] | (d[3] << 8) );
+           if ( timeout != I2C_DISP_NO_TIMEOUT )
+             gDisplay.fDashTime = gNow + timeout * 1000.;
+           SimDisplayTimer();
+         }
+         break;
+  }
+}
+
+// time [us] for one byte plus ACK at the SCL clock set by TWBR and TWSR
+static double SimTwiByteTime(void)
+ {
+  double scl = F_CPU / (16. + 2. * TWBR * (1 << (2 * (TWSR & 0x03))));
+
+  return 9 * 1000000. / scl;
+}
+
+// end of a transaction: STOP or the TWI switched off
+static void SimTwiRelease(void)
+ {
+  if ( gI2cActive ) {
+    SimDisplayTransaction();
+    gStat.fI2cTransactions++;
+  }
+
+  gI2cActive = 0;
+  gTwiMaster = gTwiAddressed = 0;
+}
+
+// execute a write of TWCR with TWINT set, see hostsim/avr/io.h
+static void SimTwiCheck(void)
+ {
+  if ( !(TWCR & (1<<TWEN)) ) {
+
+    if ( gTwiEnabled ) SimTwiRelease();
+
+    gTwiEnabled = 0;
+    gTwiDone = -1.;
+    return;
+  }
+
+  if ( !gTwiEnabled ) {
+    gTwiEnabled = 1;
+    gStat.fI2cInits++;
+  }
+
+  if ( !(TWCR & (1<<TWINT)) || gTwiDone >= 0. ) return;
+
+  uint8_t twcr = TWCR;
+
+  TWCR &= ~((1<<TWINT) | (1<<TWSTO));
+
+  if ( twcr & (1<<TWSTO) ) {
+
+    SimTwiRelease();
+
+    if ( !(twcr & (1<<TWSTA)) ) return;
+  }
+
+  if ( twcr & (1<<TWSTA) ) {
+
+    gTwiStatus = gTwiMaster ? TW_REP_START : TW_START;
+
+    SimTwiRelease();
+    gTwiMaster = 1;
+
+    gTwiDone = gNow + SimTwiByteTime() / 9;
+  }
+  else if ( !gTwiMaster ) {            // data without START
+
+    gTwiStatus = TW_BUS_ERROR;
+    gTwiDone = gNow;
+  }
+  else if ( !gTwiAddressed ) {         // SLA+W, only the display answers
+
+    gTwiAddressed = 1;
+    gI2cLength = 0;
+    gI2cActive = TWDR == (I2C_DISPLAY | TW_WRITE)
+                 && (gNow < gSim.fDisplayOff[0] || gNow >= gSim.fDisplayOff[1]);
+
+    if ( !gI2cActive ) gStat.fI2cErrors++;
+
+    gTwiStatus = gI2cActive ? TW_MT_SLA_ACK : TW_MT_SLA_NACK;
+    gTwiDone = gNow + SimTwiByteTime();
+  }
+  else {
+
+    if ( gI2cLength < sizeof(gI2cBuffer) ) gI2cBuffer[gI2cLength++] = TWDR;
+
+    gStat.fI2cBytes++;
+
+    gTwiStatus = TW_MT_DATA_ACK;
+    gTwiDone = gNow + SimTwiByteTime();
+  }
+}
+
+static void SimTwiComplete(void)
+ {
+  gTwiDone = -1.;
+
+  TWSR = gTwiStatus | (TWSR & 0x03);
+
+  if ( !(TWCR & (1<<TWIE)) ) return;
+
+  gIntPending |= SIM_IRQ_TWI;
+
+  SimFireInterrupts();
+}
+
+// ---------------------------------------------------------------------------
+
+/* --- EEPROM, the EEMEM variables are ordinary variables here --- */
+
+static uint8_t gEepromProgram = 0;   // by the programmer, not counted
+
+uint8_t eeprom_read_byte(const uint8_t *addr) { return *addr; }
+uint16_t eeprom_read_word(const uint16_t *addr) { return *addr; }
+uint32_t eeprom_read_dword(const uint32_t *addr) { return *addr; }
+float eeprom_read_float(const float *addr) { return *addr; }
+
+void eeprom_read_block(void *dst,const void *src,size_t n)
+ {
+  memcpy( dst, src, n );
+}
+
+void eeprom_write_block(const void *src,void *dst,size_t n)
+ {
+  memcpy( dst, src, n );
+
+  if ( gEepromProgram ) return;
+
+  gStat.fEepromWrites += n;
+
+  // 3.3 ms per byte on the target
+  SimDelayUs( 3300. * n );
+}
+
+void eeprom_update_block(const void *src,void *dst,size_t n)
+ {
+  const uint8_t *s = (const uint8_t *)src;
+  uint8_t *d = (uint8_t *)dst;
+
+  for ( size_t i=0; i<n; ++i ) {
+    if ( d[i] != s[i] ) eeprom_write_block( &s[i], &d[i], 1 );
+  }
+}
+
+void eeprom_write_byte(uint8_t *addr,uint8_t value) { eeprom_write_block( &value, addr, sizeof(value) ); }
+void eeprom_write_word(uint16_t *addr,uint16_t value) { eeprom_write_block( &value, addr, sizeof(value) ); }
+void eeprom_write_dword(uint32_t *addr,uint32_t value) { eeprom_write_block( &value, addr, sizeof(value) ); }
+void eeprom_write_float(float *addr,float value) { eeprom_write_block( &value, addr, sizeof(value) ); }
+
+void eeprom_update_byte(uint8_t *addr,uint8_t value) { eeprom_update_block( &value, addr, sizeof(value) ); }
+void eeprom_update_word(uint16_t *addr,uint16_t value) { eeprom_update_block( &value, addr, sizeof(value) ); }
+void eeprom_update_dword(uint32_t *addr,uint32_t value) { eeprom_update_block( &value, addr, sizeof(value) ); }
+void eeprom_update_float(float *addr,float value) { eeprom_update_block( &value, addr, sizeof(value) ); }
+
+// ---------------------------------------------------------------------------
+
+static void SimExit(void)
+ {
+  struct timespec now;
+  clock_gettime( CLOCK_MONOTONIC, &now );
+
+  double wall = (now.tv_sec - gWallStart.tv_sec)
+              + (now.tv_nsec - gWallStart.tv_nsec) / 1e9;
+  double sim = gNow / 1000000.;
+
+  if ( gOutput ) fflush( gOutput );
+  fflush( stdout );
+
+  fprintf( stderr, "rotorsim: %lu lines, %lu bytes received, %lu lost (RX buffer overflow)\n",
+           gStat.fRxLines, gStat.fRxBytes, gStat.fRxOverflows );
+  if ( gSim.fCollide )
+    fprintf( stderr, "rotorsim: %lu GS-232 commands collided with a sentence\n",
+             gStat.fRxCollisions );
+  fprintf( stderr, "rotorsim: %lu bytes sent, %lu timer ticks, %lu relay switches\n",
+           gStat.fTxBytes, gStat.fTicks, gStat.fRelaySwitches );
+  fprintf( stderr, "rotorsim: %lu I2C transactions, %lu bytes, %lu errors, %lu re-inits\n",
+           gStat.fI2cTransactions, gStat.fI2cBytes, gStat.fI2cErrors, gStat.fI2cInits );
+  config_t ee;
+  uint8_t slot = ConfigRead( &ee );
+
+  fprintf( stderr, "rotorsim: %lu EEPROM bytes written, configuration record %d in slot %d, "
+           "heading %d at the last stop\n",
+           gStat.fEepromWrites, ee.fSequence, slot, (int16_t)ee.fHeading );
+  if ( gSim.fModelSpeed >= 0. )
+    fprintf( stderr, "rotorsim: model at %.1f deg (rotor %.1f, firmware %d), "
+             "run-out learned %d/%d deg (CW/CCW)\n",
+             SimModelAzimuth(), gModelPosition, GetRotorAngle(),
+             ee.fGotoCoast[0], ee.fGotoCoast[1] );
+  if ( gStat.fHeadingSamples )
+    fprintf( stderr, "rotorsim: heading error rms %.1f, max %.0f deg (model stopped), "
+             "MAG bounds x %.0f ... %.0f, y %.0f ... %.0f (EEPROM)\n",
+             sqrt( gStat.fHeadingError2 / gStat.fHeadingSamples ), gStat.fHeadingErrorMax,
+             ee.fMAG_min.x, ee.fMAG_max.x, ee.fMAG_min.y, ee.fMAG_max.y );
+  fprintf( stderr, "rotorsim: simulated %.3f s in %.3f s wall time (x%.0f)\n",
+           sim, wall, wall > 0. ? sim / wall : 0. );
+
+  exit( EXIT_SUCCESS );
+}
+
+// ---------------------------------------------------------------------------
+
+static void Usage(const char *argv0)
+ {
+  printf( "Usage: %s [options] [-i <input_file>]\n\n", argv0 );
+  printf( "where\n" );
+  printf( "\t-i <input_file>  : data from the sensor (default: stdin)\n" );
+  printf( "\t-o <output_file> : write data sent by the controller to file\n" );
+  printf( "\t-m <deg/s>       : sensor data from a rotator model instead\n" );
+  printf( "\t-a <deg>         : start azimuth of the model, +360 in the overlap (default: %.0f)\n",
+          gSim.fModelStart );
+  printf( "\t-w <deg>         : range of the rotator from the CCW stop (default: %d)\n",
+          MAX_ANGLE );
+  printf( "\t-k <msec>        : run-out time constant of the model after a stop (default: %.0f)\n",
+          gSim.fModelRunOut * 1000. );
+  printf( "\t-c <dx>,<dy>     : offset of the sensor of the model vs the EEPROM calibration\n" );
+  printf( "\t-e <sec>         : end of the model data (default: %.0f)\n", gSim.fModelEnd / 1000000. );
+  printf( "\t-p <msec>        : sensor frame period (default: %.0f)\n", gSim.fFramePeriod / 1000. );
+  printf( "\t-r <baud>        : baud rate (default: %ld)\n", gSim.fBaudRate );
+  printf( "\t-l <msec>        : keep running after end of input (default: %.0f)\n", gSim.fLinger / 1000. );
+  printf( "\t-x <factor>      : run at <factor> times real time (default: unpaced)\n" );
+  printf( "\t-b <ms>:<key>:<ms> : press key CW,CCW,STOP,PCW,PCCW at time for duration\n" );
+  printf( "\t-g <ms>:<command> : send GS-232 command (e.g. C2, M120, S) at time\n" );
+  printf( "\t-j               : GS-232 commands do not wait for a gap between the sentences\n" );
+  printf( "\t-n <ms>:<ms>     : the display does not answer (NACK) at time for duration\n" );
+  printf( "\t-t               : GS-232 and data sent by the controller on a pty\n" );
+  printf( "\t-v               : more verbose output (relays, raw display data)\n" );
+  printf( "\t-q               : quiet, only the summary\n" );
+  printf( "\t-h,-?            : display this help page\n" );
+  printf( "\n" );
+}
+
+// ---------------------------------------------------------------------------
+
+int main(int argc,char **argv)
+ {
+  int getopt_status;
+
+  while ( (getopt_status = getopt( argc, argv, "a:b:c:e:g:i:jk:l:m:n:o:p:qr:tvw:x:h?" )) != EOF ) {
+
+    switch ( getopt_status ) {
+
+      case 'a': gSim.fModelStart = atof( optarg );
+                break;
+
+      case 'b': if ( SimAddButton( optarg ) ) {
+                  fprintf( stderr, "%s: invalid button event '%s'\n", argv[0], optarg );
+                  exit( EXIT_FAILURE );
+                }
+                break;
+
+      case 'c': if ( sscanf( optarg, "%lf,%lf",
+                             &gSim.fModelShift[0], &gSim.fModelShift[1] ) != 2 ) {
+                  fprintf( stderr, "%s: invalid offset '%s'\n", argv[0], optarg );
+                  exit( EXIT_FAILURE );
+                }
+                break;
+
+      case 'e': gSim.fModelEnd = atof( optarg ) * 1000000.;
+                break;
+
+      case 'g': if ( SimAddHostCommand( optarg ) ) {
+                  fprintf( stderr, "%s: invalid GS-232 command '%s'\n", argv[0], optarg );
+                  exit( EXIT_FAILURE );
+                }
+                break;
+
+      case 'i': gSim.fInputFile = optarg;
+                break;
+
+      case 'l': gSim.fLinger = atof( optarg ) * 1000.;
+                break;
+
+      case 'k': gSim.fModelRunOut = atof( optarg ) / 1000.;
+                break;
+
+      case 'j': gSim.fCollide = 1;
+                break;
+
+      case 'n': if ( sscanf( optarg, "%lf:%lf",
+                             &gSim.fDisplayOff[0], &gSim.fDisplayOff[1] ) != 2 ) {
+                  fprintf( stderr, "%s: invalid display timeout '%s'\n", argv[0], optarg );
+                  exit( EXIT_FAILURE );
+                }
+                gSim.fDisplayOff[0] *= 1000.;
+                gSim.fDisplayOff[1] = gSim.fDisplayOff[0] + gSim.fDisplayOff[1] * 1000.;
+                break;
+
+      case 'm': gSim.fModelSpeed = atof( optarg );
+                break;
+
+      case 'o': gSim.fOutputFile = optarg;
+                break;
+
+      case 'p': gSim.fFramePeriod = atof( optarg ) * 1000.;
+                break;
+
+      case 'q': gSim.fVerbose = 0;
+                break;
+
+      case 'r': gSim.fBaudRate = atol( optarg );
+                break;
+
+      case 't': if ( SimOpenPty() ) {
+                  fprintf( stderr, "%s: cannot open a pty!\n", argv[0] );
+                  exit( EXIT_FAILURE );
+                }
+                break;
+
+      case 'v': gSim.fVerbose++;
+                break;
+
+      case 'w': gSim.fModelRange = atoi( optarg );
+                break;
+
+      case 'x': gSim.fSpeed = atof( optarg );
+                break;
+
+      case 'h':
+      case '?':
+      default:  Usage( argv[0] );
+                exit( EXIT_FAILURE );
+    }
+  }
+
+  if ( gSim.fBaudRate <= 0 ) {
+    fprintf( stderr, "%s: invalid baud rate!\n", argv[0] );
+    exit( EXIT_FAILURE );
+  }
+
+  // the configuration record as written by a programmer (defaults), the
+  // firmware stored before the reset whether the rotor was in the overlap
+  // and the heading of the model at its last stop
+  gEepromProgram = 1;
+
+  ConfigInit();
+
+  config_t programmed = gConfig;
+
+  if ( gSim.fModelRange > 0 ) {
+    if ( gSim.fModelRange < 180 || gSim.fModelRange > ROTOR_RANGE_MAX ) {
+      fprintf( stderr, "%s: invalid range %d!\n", argv[0], gSim.fModelRange );
+      exit( EXIT_FAILURE );
+    }
+    gConfig.fRotorRange = gSim.fModelRange;
+  }
+  gConfig.fRotorUpper = gSim.fModelStart >= 360.;
+  if ( gSim.fModelSpeed >= 0. )
+    gConfig.fHeading = 5 * ((int)gSim.fModelStart % 360 / 5);
+
+  if ( memcmp( &programmed, &gConfig, sizeof(config_t) ) ) {
+    ConfigSave();
+    ConfigFlush();
+  }
+
+  gModelConfig = gConfig;
+  gEepromProgram = 0;
+
+  if ( gSim.fModelSpeed >= 0. )
+    gInput = NULL;
+  else if ( strcmp( gSim.fInputFile, "-" ) == 0 )
+    gInput = stdin;
+  else if ( !(gInput = fopen( gSim.fInputFile, "r" )) ) {
+    fprintf( stderr, "%s: error opening file %s!\n", argv[0], gSim.fInputFile );
+    exit( EXIT_FAILURE );
+  }
+
+  if ( gSim.fOutputFile ) {
+    if ( strcmp( gSim.fOutputFile, "-" ) == 0 )
+      gOutput = stdout;
+    else if ( !(gOutput = fopen( gSim.fOutputFile, "w" )) ) {
+      fprintf( stderr, "%s: error opening file %s!\n", argv[0], gSim.fOutputFile );
+      exit( EXIT_FAILURE );
+    }
+  }
+
+  clock_gettime( CLOCK_MONOTONIC, &gWallStart );
+
+  // never returns, SimExit() is called at the end of the input
+  return FirmwareMain();
+}
+
+// ---------------------------------------------------------------------------
+// ---------------------------------------------------------------------------
@@ -0,0 +1,277 @@
+/*
+ * File   : calibrate.c
+ *
+ * Copyright:      Hermann-Josef Mathes  mailto: dc2ip@darc.de
+ * Author:         Hermann-Josef Mathes
+ * Remarks:
+ * Known problems: development status
+ * Version:        Version v1r0
+ * Description:    Calibration run of the MAG sensor, one sweep of the rotor
+ *                 from stop to stop.
+ *
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+   If not, write to the Free Software Foundation,
+   Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+
+ *
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/** @file calibrate.c
+  * Calibration run of the MAG sensor, one sweep of the rotor from stop to
+  * stop.
+  *
+  * A long press of STOP starts it, LED_CALIBRATE is then on. When STOP is
+  * released, the rotor is turned counter clockwise (RotatorExec()) until
+  * it is at the stop, the heading no longer changes. From there it is
+  * turned clockwise to the other stop, the minimum and maximum of the x
+  * and y readings of every frame of the sensor are collected on the way.
+  * The sweep is valid if the heading passed all 12 sectors of 30 deg and
+  * the ranges of x and y are plausible, the bounds are then used for the
+  * heading and written into EEPROM (CompassSetBounds()), z is kept. A
+  * failed run lets the LED blink until a key is pressed.
+  *
+  * Any key, a command of the serial interface or a timeout of a turn
+  * aborts the run, the rotor is stopped.
+  *
+  * @author H.-J. Mathes <dc2ip@darc.de>
+  */
+
+#include <avr/io.h>
+
+#include "global.h"
+
+#include "calibrate.h"
+
+/* local data types and variables */
+
+/** All 12 sectors of 30 deg have to be passed by the sweep. */
+#define CALIBRATE_SECTORS       0x0fff
+
+/** Frames of the sensor per half period of the blinking LED. */
+#define CALIBRATE_BLINK         5
+
+#define ALL_BUTTONS (BUTTON_PRESET_CCW | BUTTON_CCW | BUTTON_STOP \
+                     | BUTTON_CW | BUTTON_PRESET_CW)
+
+/** States of the calibration run. */
+typedef enum {
+
+  kCalibrateOff,
+  kCalibrateRelease,    // wait for STOP released and the rotor stopped
+  kCalibrateToStop,     // turning counter clockwise to the stop
+  kCalibrateAtStop,     // stopping there
+  kCalibrateSweep,      // turning clockwise to the other stop, collecting
+  kCalibrateDone,       // stopping there, then check and store
+  kCalibrateFailed,     // LED blinks until a key is pressed
+
+} ECalibrateState;
+
+static uint8_t    gCalibrateState = kCalibrateOff;
+
+static i_vector_t gCalibrateMin, gCalibrateMax;
+static uint16_t   gCalibrateSectors = 0;  // passed sectors of the heading
+static uint16_t   gCalibrateFrames = 0;   // since the start of the turn
+static uint8_t    gCalibrateStill = 0;    // frames without motion
+static int16_t    gCalibrateHeading = 0;  // heading of the last motion
+
+// --------------------------------------------------------------------------
+
+// a new turn, the rotor is assumed to move
+static void CalibrateTurn(uint8_t cmd) {
+
+  gCalibrateFrames = 0;
+  gCalibrateStill = 0;
+  gCalibrateHeading = GetCurrentHeading();
+
+  SetCommand( cmd );
+}
+
+// --------------------------------------------------------------------------
+
+// run ends, LED blinks if it failed
+static void CalibrateEnd(uint8_t failed) {
+
+  if ( IsRotatorBusy() ) SetCommand( kStop );
+
+  if ( failed ) {
+    gCalibrateState = kCalibrateFailed;
+    gCalibrateFrames = 0;
+  }
+  else {
+    gCalibrateState = kCalibrateOff;
+    LED_PORT &= ~LED_CALIBRATE;
+  }
+}
+
+// --------------------------------------------------------------------------
+
+// bounds of the sweep, all sectors passed and a circle rather than a line
+static uint8_t CalibrateValid(void) {
+
+  int16_t dx = gCalibrateMax.x - gCalibrateMin.x;
+  int16_t dy = gCalibrateMax.y - gCalibrateMin.y;
+
+  if ( gCalibrateSectors != CALIBRATE_SECTORS ) return FALSE;
+
+  if ( dx < CALIBRATE_MIN_RANGE || dy < CALIBRATE_MIN_RANGE ) return FALSE;
+
+  return dx <= 2 * dy && dy <= 2 * dx;
+}
+
+// --------------------------------------------------------------------------
+
+void CalibrateStart(void) {
+
+  if ( gCalibrateState != kCalibrateOff && gCalibrateState != kCalibrateFailed )
+    return;
+
+  LED_PORT |= LED_CALIBRATE;
+
+  gCalibrateState = kCalibrateRelease;
+}
+
+// --------------------------------------------------------------------------
+
+// called by CompassMessageReceive() for each frame
+void CalibrateSample(const i_vector_t *mag,int heading) {
+
+  switch ( gCalibrateState ) {
+
+    case kCalibrateOff:
+         return;
+
+    case kCalibrateFailed:
+         if ( ++gCalibrateFrames >= CALIBRATE_BLINK ) {
+           gCalibrateFrames = 0;
+           LED_PORT ^= LED_CALIBRATE;
+         }
+         return;
+
+    case kCalibrateSweep:
+         if ( mag->x < gCalibrateMin.x ) gCalibrateMin.x = mag->x;
+         if ( mag->x > gCalibrateMax.x ) gCalibrateMax.x = mag->x;
+         if ( mag->y < gCalibrateMin.y ) gCalibrateMin.y = mag->y;
+         if ( mag->y > gCalibrateMax.y ) gCalibrateMax.y = mag->y;
+
+         gCalibrateSectors |= 1 << (heading / 30);
+         break;
+  }
+
+  if ( gCalibrateFrames < CALIBRATE_TIMEOUT ) gCalibrateFrames++;
+
+  // the rotor is at a stop when the heading no longer changes
+  int16_t diff = heading - gCalibrateHeading;
+
+  if ( diff > 180 ) diff -= 360;
+  if ( diff < -180 ) diff += 360;
+
+  if ( abs( diff ) >= CALIBRATE_STALL_ANGLE ) {
+    gCalibrateHeading = heading;
+    gCalibrateStill = 0;
+  }
+  else if ( gCalibrateStill < CALIBRATE_STALL_FRAMES )
+    gCalibrateStill++;
+}
+
+// --------------------------------------------------------------------------
+
+// called by main()
+void CalibrateExec(void) {
+
+  uint8_t stopped = !IsRotatorBusy() && gRotatorCommand == kNone;
+
+  switch ( gCalibrateState ) {
+
+    case kCalibrateOff:
+         return;
+
+    case kCalibrateFailed:
+         if ( GetKeyPress( ALL_BUTTONS ) ) {
+           gCalibrateState = kCalibrateOff;
+           LED_PORT &= ~LED_CALIBRATE;
+         }
+         return;
+
+    case kCalibrateRelease:
+         if ( (gKeyState & BUTTON_STOP) || !stopped ) return;
+
+         GetKeyPress( ALL_BUTTONS );    // older presses are not an abort
+         gCalibrateState = kCalibrateToStop;
+         CalibrateTurn( kTurnCCW );
+         return;
+
+    default:
+         break;
+  }
+
+  // a key, a turn of PresetGoto() (GS-232 'M', track) or a command of the
+  // serial interface which stopped or reversed the rotor aborts the run
+  uint8_t turning = gCalibrateState == kCalibrateToStop ? kTurningCCW
+                  : gCalibrateState == kCalibrateSweep ? kTurningCW : kIdle;
+
+  if (    GetKeyPress( ALL_BUTTONS )
+       || gPresetCommand != kPresetNone
+       || (turning != kIdle && (stopped || (   gRotatorState != turning
+                                             && gRotatorCommand == kNone))) ) {
+    CalibrateEnd( TRUE );
+    return;
+  }
+
+  switch ( gCalibrateState ) {
+
+    case kCalibrateToStop:
+    case kCalibrateSweep:
+         if ( gCalibrateFrames >= CALIBRATE_TIMEOUT ) {
+           CalibrateEnd( TRUE );
+           return;
+         }
+
+         if ( gCalibrateStill < CALIBRATE_STALL_FRAMES ) return;
+
+         SetCommand( kStop );
+         gCalibrateState = gCalibrateState == kCalibrateToStop ? kCalibrateAtStop
+                                                               : kCalibrateDone;
+         break;
+
+    case kCalibrateAtStop:
+         if ( !stopped ) return;
+
+         gCalibrateMin.x = gCalibrateMin.y = INT16_MAX;
+         gCalibrateMax.x = gCalibrateMax.y = INT16_MIN;
+         gCalibrateSectors = 0;
+
+         gCalibrateState = kCalibrateSweep;
+         CalibrateTurn( kTurnCW );
+         break;
+
+    case kCalibrateDone:
+         if ( !stopped ) return;
+
+         if ( !CalibrateValid() ) {
+           CalibrateEnd( TRUE );
+           return;
+         }
+
+         CompassSetBounds( &gCalibrateMin, &gCalibrateMax );
+         CalibrateEnd( FALSE );
+         break;
+  }
+}
+
+// --------------------------------------------------------------------------
+// --------------------------------------------------------------------------
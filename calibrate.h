@@ -0,0 +1,85 @@
+/*
+ * File   : calibrate.h
+ *
+ * Copyright:      Hermann-Josef Mathes  mailto: dc2ip@darc.de
+ * Author:         Hermann-Josef Mathes
+ * Remarks:
+ * Known problems: development status
+ * Version:        Version v1r0
+ * Description:    Declarations for the calibration run of the MAG sensor,
+ *                 one sweep of the rotor from stop to stop.
+ *
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+   If not, write to the Free Software Foundation,
+   Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+
+ *
+ */
+
+
+/** @file calibrate.h
+  * Declarations for the calibration run of the MAG sensor, one sweep of
+  * the rotor from stop to stop.
+  * @author H.-J.Mathes <dc2ip@darc.de>
+  */
+
+#ifndef _calibrate_h_
+#define _calibrate_h_
+
+#include <stdint.h>
+
+#include "fixheading.h"   // i_vector_t
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** The rotor is at a stop when its heading did not change by this number
+  * of degrees ...
+  */
+#define CALIBRATE_STALL_ANGLE   10
+/** ... within this number of frames of the sensor (10 s at 10 Hz), thus
+  * rotators down to 1 deg/s.
+  */
+#define CALIBRATE_STALL_FRAMES  100
+
+/** Frames of the sensor until a turn to a stop is given up (20 min). */
+#define CALIBRATE_TIMEOUT       12000
+
+/** Smallest range [counts] of the x and y readings of a valid sweep, the
+  * smaller one has to be at least half of the larger one.
+  */
+#define CALIBRATE_MIN_RANGE     100
+
+/** Start the calibration run (long press of STOP), LED_CALIBRATE is on
+  * while it runs and blinks if it failed.
+  */
+extern void CalibrateStart(void);
+
+/** To be called for each frame of the sensor with the raw readings 'mag'
+  * and the heading (0 ... 359) from them.
+  */
+extern void CalibrateSample(const i_vector_t *mag,int heading);
+
+/** To be called by main(): turns the rotor to the counter clockwise stop,
+  * then to the clockwise one and stores the bounds of this sweep.
+  */
+extern void CalibrateExec(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _calibrate_h_ */
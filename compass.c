@@ -33,7 +33,6 @@
 #include <stdlib.h>
 #include <math.h>          // round(), atan2()
 #include <avr/pgmspace.h>
-#include <avr/eeprom.h>
 
 
 /** @file compass.c
@@ -49,6 +48,13 @@
 #include "vector.h"    // both are in ./LSM303 directory
 #include "num2uart.h"
 
+#include "headingfilter.h"
+#include "calibrate.h"
+
+#ifdef COMPASS_BINARY_FORMAT
+#include "binframe.h"  // in ./LSM303 directory
+#endif // COMPASS_BINARY_FORMAT
+
 /* local data types and variables */
 
 #if 0
@@ -63,40 +69,277 @@ static vector_t gMin_MAG = { -474, -257, -257 };
 static vector_t gMax_MAG = {   36,  238,  238 };
 #endif
 
+#ifdef COMPASS_AUTO_CALIBRATION
+/** Online calibration of the x/y bounds of the MAG sensor while the rotor
+  * turns (CompassAutoCalibrate()), the bounds in Q16 of the readings.
+  */
+#define AUTOCAL_SHIFT       16
+/** A bound follows a reading beyond it by 1/2 per frame (noise). */
+#define AUTOCAL_ATTACK      1
+/** A bound decays towards the center by 2^-16 per frame while turning,
+  * old extremes (e.g. of a changed mast) are gone within half an hour of
+  * turning, the droop between two full turns stays below the threshold.
+  */
+#define AUTOCAL_DECAY       16
+/** All 12 sectors of 30 deg have to be passed before the bounds are used. */
+#define AUTOCAL_SECTORS     0x0fff
+/** Change of a bound [counts] to be used for the heading. */
+#define AUTOCAL_THRESHOLD   8
+/** Frames between two writes of the bounds into EEPROM, 1 h at 10 Hz. */
+#define AUTOCAL_INTERVAL    36000
+
+static uint8_t  gAutoCal = FALSE;      // the min/max calibration is used
+static int32_t  gAutoMin[2], gAutoMax[2];
+static uint16_t gAutoSectors = 0;      // passed sectors of the heading
+static uint16_t gAutoFrames = 0;       // since the last write into EEPROM
+static uint8_t  gAutoChanged = FALSE;  // bounds differ from the EEPROM
+#endif // COMPASS_AUTO_CALIBRATION
+
+#ifdef HEADING_TRACKER
+/** Tracker of the heading, knows the motion of the rotator from the relays. */
+static heading_tracker_t gHeadingTracker;
+#else
+/** Moving average of the heading values, size of the window from EEPROM. */
+static heading_filter_t gHeadingFilter;
+#endif // HEADING_TRACKER
+
+#ifdef COMPASS_BINARY_FORMAT
+/** Receiver of binary frames, $ACRAW sentences are still accepted. */
+static bin_decoder_t gBinDecoder;
+#endif // COMPASS_BINARY_FORMAT
+
 /* local prototypes */
 
+static void CompassCalibInit(const mag_calib_t *mag);
+#ifdef COMPASS_AUTO_CALIBRATION
+static void CompassAutoInit(void);
+static void CompassAutoCalibrate(const i_vector_t *mag,int heading);
+#endif // COMPASS_AUTO_CALIBRATION
 static void CompassMessageConvert(i_vector_t*acc,i_vector_t* mag);
 static uint8_t CompassMessageDecode(uint8_t newchar);
-
-static int GetAverageHeading(int cur_heading);
+static void CompassMessageError(void);
+#ifdef COMPASS_BINARY_FORMAT
+static uint8_t CompassFrameDecode(uint8_t newchar);
+#endif // COMPASS_BINARY_FORMAT
+
+#ifdef COMPASS_FIXED_POINT
+/** MAG calibration for the integer heading calculation. */
+static fix_calib_t gCalib_MAG;
+#else
+/** MAG calibration, offset and correction matrix. */
+static mag_calib_t gCalib_MAG;
 
 // Returns a heading (in degrees) given an acceleration vector a due to gravity, a magnetic vector m, and a facing vector p.
 static int GetHeading3D(const vector_t *a,const vector_t *m,const vector_t *p);
+#endif // COMPASS_FIXED_POINT
 
 // --------------------------------------------------------------------------
 
 // called from main()
 void CompassInit(void) {
 
-  // read min/max readings for MAG sensor from EEPROM
-  gMin_MAG.x = eeprom_read_float( &gEE_MAG_min.x );
-  gMin_MAG.y = eeprom_read_float( &gEE_MAG_min.y );
-  gMin_MAG.z = eeprom_read_float( &gEE_MAG_min.z );
+  // fitted calibration of the MAG sensor from EEPROM, if there is one
+  mag_calib_t mag = gConfig.fMAG_calib;
+
+  // else the min/max readings
+  gMin_MAG = gConfig.fMAG_min;
+  gMax_MAG = gConfig.fMAG_max;
+
+#ifdef HEADING_TRACKER
+  HeadingTrackerInit( &gHeadingTracker );
+#else
+  HeadingFilterInit( &gHeadingFilter, gConfig.fHeadingWindow );
+#endif // HEADING_TRACKER
+
+  if ( mag.fMagic != MAG_CALIB_MAGIC ) {
+
+    MagCalibInit( &mag, &gMin_MAG, &gMax_MAG );
+
+#ifdef COMPASS_AUTO_CALIBRATION
+    // a fitted calibration is better than any bounds, else they are tracked
+    CompassAutoInit();
+#endif // COMPASS_AUTO_CALIBRATION
+  }
+
+  CompassCalibInit( &mag );
 
-  gMax_MAG.x = eeprom_read_float( &gEE_MAG_max.x );
-  gMax_MAG.y = eeprom_read_float( &gEE_MAG_max.y );
-  gMax_MAG.z = eeprom_read_float( &gEE_MAG_max.z );
+#ifdef COMPASS_BINARY_FORMAT
+  BinFrameInit( &gBinDecoder );
+#endif // COMPASS_BINARY_FORMAT
 }
 
 // --------------------------------------------------------------------------
 
+// the calibration used for the heading
+static void CompassCalibInit(const mag_calib_t *mag) {
+
+#ifdef COMPASS_FIXED_POINT
+  // offsets and matrix in fixed point, no divisions per frame
+  FixHeadingInit( &gCalib_MAG, mag );
+#else
+  gCalib_MAG = *mag;
+#endif // COMPASS_FIXED_POINT
+}
+
+// --------------------------------------------------------------------------
+
+// called by CalibrateExec() from main(), z is kept
+void CompassSetBounds(const i_vector_t *min,const i_vector_t *max) {
+
+  gMin_MAG.x = min->x;
+  gMin_MAG.y = min->y;
+  gMax_MAG.x = max->x;
+  gMax_MAG.y = max->y;
+
+  gConfig.fMAG_min = gMin_MAG;
+  gConfig.fMAG_max = gMax_MAG;
+
+  // a fitted calibration is outdated now (e.g. work on the mast)
+  gConfig.fMAG_calib.fMagic = MAG_CALIB_NONE;
+
+  ConfigSave();
+
+  mag_calib_t calib;
+
+  MagCalibInit( &calib, &gMin_MAG, &gMax_MAG );
+  CompassCalibInit( &calib );
+
+#ifdef COMPASS_AUTO_CALIBRATION
+  CompassAutoInit();
+#endif // COMPASS_AUTO_CALIBRATION
+}
+
+// --------------------------------------------------------------------------
+
+#ifdef COMPASS_AUTO_CALIBRATION
+// the tracked bounds start from the ones in use
+static void CompassAutoInit(void) {
+
+  gAutoCal = TRUE;
+
+  gAutoMin[0] = (int32_t)gMin_MAG.x << AUTOCAL_SHIFT;
+  gAutoMin[1] = (int32_t)gMin_MAG.y << AUTOCAL_SHIFT;
+  gAutoMax[0] = (int32_t)gMax_MAG.x << AUTOCAL_SHIFT;
+  gAutoMax[1] = (int32_t)gMax_MAG.y << AUTOCAL_SHIFT;
+
+  gAutoSectors = 0;
+  gAutoChanged = FALSE;
+}
+
+// --------------------------------------------------------------------------
+
+/* The bounds of x and y are tracked while the rotor turns, z hardly changes
+ * then and is kept. When all sectors of the heading have been passed and a
+ * bound differs by AUTOCAL_THRESHOLD from the one in use, the calibration
+ * is updated; the bounds are written into EEPROM at most once per
+ * AUTOCAL_INTERVAL (ConfigSave(), a whole record).
+ */
+static void CompassAutoCalibrate(const i_vector_t *mag,int heading) {
+
+  if ( !gAutoCal ) return;
+
+  if ( gAutoFrames < AUTOCAL_INTERVAL ) gAutoFrames++;
+
+  if ( gRotatorState != kTurningCW && gRotatorState != kTurningCCW ) return;
+
+  int16_t m[2] = { mag->x, mag->y };
+
+  for ( uint8_t i=0; i<2; ++i ) {
+
+    int32_t v = (int32_t)m[i] << AUTOCAL_SHIFT;
+    int32_t center = gAutoMin[i] / 2 + gAutoMax[i] / 2;
+
+    if ( v > gAutoMax[i] ) gAutoMax[i] += (v - gAutoMax[i]) >> AUTOCAL_ATTACK;
+    else gAutoMax[i] -= (gAutoMax[i] - center) >> AUTOCAL_DECAY;
+
+    if ( v < gAutoMin[i] ) gAutoMin[i] -= (gAutoMin[i] - v) >> AUTOCAL_ATTACK;
+    else gAutoMin[i] += (center - gAutoMin[i]) >> AUTOCAL_DECAY;
+  }
+
+  gAutoSectors |= 1 << (heading / 30);
+
+  if ( gAutoSectors != AUTOCAL_SECTORS ) return;
+
+  gAutoSectors = 0;
+
+  // x and y, each member by its own pointer
+  float *pmin[2] = { &gMin_MAG.x, &gMin_MAG.y };
+  float *pmax[2] = { &gMax_MAG.x, &gMax_MAG.y };
+  uint8_t changed = FALSE;
+
+  for ( uint8_t i=0; i<2; ++i ) {
+
+    int16_t min = (gAutoMin[i] + (1L << (AUTOCAL_SHIFT-1))) >> AUTOCAL_SHIFT;
+    int16_t max = (gAutoMax[i] + (1L << (AUTOCAL_SHIFT-1))) >> AUTOCAL_SHIFT;
+
+    if (    abs( min - (int16_t)*pmin[i] ) >= AUTOCAL_THRESHOLD
+         || abs( max - (int16_t)*pmax[i] ) >= AUTOCAL_THRESHOLD ) {
+      *pmin[i] = min;
+      *pmax[i] = max;
+      changed = TRUE;
+    }
+  }
+
+  if ( changed ) {
+
+    mag_calib_t calib;
+
+    MagCalibInit( &calib, &gMin_MAG, &gMax_MAG );
+    CompassCalibInit( &calib );
+
+    gAutoChanged = TRUE;
+  }
+
+  if ( gAutoChanged && gAutoFrames >= AUTOCAL_INTERVAL ) {
+
+    gConfig.fMAG_min = gMin_MAG;
+    gConfig.fMAG_max = gMax_MAG;
+
+    ConfigSave();
+
+    gAutoFrames = 0;
+    gAutoChanged = FALSE;
+  }
+}
+#endif // COMPASS_AUTO_CALIBRATION
+
+// --------------------------------------------------------------------------
+
+#ifdef HEADING_TRACKER
+// motion of the rotator from the state of the relay sequence
+static uint8_t CompassMotion(void) {
+
+  switch ( gRotatorState ) {
+
+    case kTurningCW:
+         return kHeadingCW;
+
+    case kTurningCCW:
+         return kHeadingCCW;
+
+    case kRotorRampup:   // brake released, motor not yet or no more on
+    case kLockBrake:
+         return kHeadingFree;
+
+    default:
+         return kHeadingStopped;
+  }
+}
+#endif // HEADING_TRACKER
+
+// --------------------------------------------------------------------------
+
+#ifndef COMPASS_FIXED_POINT
 static vector_t gACC, gMAG;
+#endif // COMPASS_FIXED_POINT
 
 // called by main()
 void CompassMessageReceive(unsigned int uart_data) {
 
   static uint8_t msg_complete = FALSE;
+#ifndef COMPASS_FIXED_POINT
   static vector_t p = { 0.0, -1.0, 0.0 }; // X: to the right, Y: backward, Z: down
+#endif // COMPASS_FIXED_POINT
 
   if ( (uart_data >> 8) == 0) {
 
@@ -106,6 +349,12 @@ void CompassMessageReceive(unsigned int uart_data) {
 
     msg_complete = CompassMessageDecode( uart_data & 0xff );
 
+#ifdef COMPASS_BINARY_FORMAT
+    // 0x00 ends a frame and resets the decoding of sentences, thus both
+    // formats can share the line
+    if ( CompassFrameDecode( uart_data & 0xff ) ) msg_complete = TRUE;
+#endif // COMPASS_BINARY_FORMAT
+
     if ( msg_complete ) {
 
       // parse messages from individual buffers
@@ -113,22 +362,39 @@ void CompassMessageReceive(unsigned int uart_data) {
 
       CompassMessageConvert( &acc, &mag );
 
+#ifdef COMPASS_FIXED_POINT
+      int heading3D = FixGetHeading3D( &gCalib_MAG, &acc, &mag );
+#else
       gACC.x  = acc.x;
       gACC.y  = acc.y;
       gACC.z  = acc.z;
 
-      gMAG.x  = mag.x;
-      gMAG.y  = mag.y;
-      gMAG.z  = mag.z;
+      // shift and correct, m' = W (m - c)
+      float d[3] = { mag.x - gCalib_MAG.fOffset[0],
+                     mag.y - gCalib_MAG.fOffset[1],
+                     mag.z - gCalib_MAG.fOffset[2] };
+      float *pm[3] = { &gMAG.x, &gMAG.y, &gMAG.z };
 
-      // shift and scale
-      gMAG.x = (gMAG.x - gMin_MAG.x) / (gMax_MAG.x - gMin_MAG.x) * 2.0 - 1.0;
-      gMAG.y = (gMAG.y - gMin_MAG.y) / (gMax_MAG.y - gMin_MAG.y) * 2.0 - 1.0;
-      gMAG.z = (gMAG.z - gMin_MAG.z) / (gMax_MAG.z - gMin_MAG.z) * 2.0 - 1.0;
+      for ( uint8_t i=0; i<3; ++i )
+        *pm[i] = gCalib_MAG.fMatrix[i][0] * d[0] + gCalib_MAG.fMatrix[i][1] * d[1]
+               + gCalib_MAG.fMatrix[i][2] * d[2];
 
       int heading3D = GetHeading3D( &gACC, &gMAG, &p );
+#endif // COMPASS_FIXED_POINT
 
-      int heading3D_averaged = GetAverageHeading( heading3D );
+#ifdef HEADING_TRACKER
+      int heading3D_averaged = HeadingTrackerAdd( &gHeadingTracker, heading3D,
+                                                  CompassMotion() );
+#else
+      int heading3D_averaged = HeadingFilterAdd( &gHeadingFilter, heading3D );
+#endif // HEADING_TRACKER
+
+#ifdef COMPASS_AUTO_CALIBRATION
+      CompassAutoCalibrate( &mag, heading3D );
+#endif // COMPASS_AUTO_CALIBRATION
+
+      // calibration run from the front panel, if active
+      CalibrateSample( &mag, heading3D );
 
       // -> 5 degrees resolution ...
       heading3D_averaged = 5 * (heading3D_averaged / 5);
@@ -141,128 +407,183 @@ void CompassMessageReceive(unsigned int uart_data) {
       msg_complete = FALSE;  // ready to wait for next message
     }
   }
-  else { // UART receive error
+  else { // UART receive error, e.g. a collision on the RX line
+    CompassMessageError();
   }
 }
 
 // --------------------------------------------------------------------------
 
-#define N_VALUES    5
+typedef enum {
 
-// perform an averaging of several heading values
-// handles also the averaging at 359/0 degrees
-// negative values are invalid
-static int GetAverageHeading(int cur_heading) {
+  kSENTENCE_TYPE_UNKNOWN = 0,
+  kSENTENCE_TYPE_ACOK,
+  kSENTENCE_TYPE_ACERR,
+  kSENTENCE_TYPE_ACRAW,
 
-  static int last_average = 0;
-  static int last_heading[N_VALUES] = { 0 };
-  static uint8_t n_values = 0;
+} ESentenceType;
 
-  // normalize input value
-  while ( cur_heading >= 360 ) cur_heading -= 360;
-  while ( cur_heading < 0 ) cur_heading += 360;
+static uint8_t gSentenceType = kSENTENCE_TYPE_UNKNOWN;
 
-  int average = 0;
+typedef enum {
 
-  if ( n_values < N_VALUES ) {
-    last_heading[n_values++] = cur_heading;
+  kDECODE_IDLE = 0,      // waiting for '$'
+  kDECODE_DATA,          // between '$' and '*'
+  kDECODE_CHECKSUM,      // between '*' and '\n'
 
-    // take current value as average ...
-    average = cur_heading;
+} EDecodeState;
 
-    last_average = average;
+static uint8_t gDecodeState = kDECODE_IDLE;
 
-    return average;
-  }
-  else {
+/** Sentences dropped so far (modulo 256), see CompassMessageDropped(). */
+static uint8_t gDecodeDropped = 0;
 
-    for ( uint8_t i=1; i<n_values; ++i )
-      last_heading[i-1] = last_heading[i];
+// drop the current sentence
+#define CompassDrop() do { gDecodeState = kDECODE_IDLE; gDecodeDropped++; } while (0)
 
-    last_heading[n_values-1] = cur_heading;
-  }
+/* values of the current $ACRAW sentence: ACC x,y,z and MAG x,y,z */
 
-  // calculate the sum, take 359/0 degree issue into account
-  for ( uint8_t i=0; i<n_values; ++i ) {
-    if ( last_average > 270 && last_heading[i] < 90 )
-      average += last_heading[i] + 360;
-    else if ( last_average < 90 && last_heading[i] > 270 )
-      average += last_heading[i] - 360;
-    else
-      average += last_heading[i];
-  }
+#define N_RAW_VALUES    6
 
-  average /= n_values;
+static int16_t gRawValue[N_RAW_VALUES];
 
-  // finally normalize the average
-  if ( average >= 360 )
-    average -= 360;
-  else if ( average < 0 )
-    average += 360;
+/* state of the field which is currently decoded */
 
-  last_average = average;
+#define FIELD_NEGATIVE  0x01
+#define FIELD_DIGITS    0x02
 
-  return average;
-}
+static uint16_t gFieldValue;         // absolute value, built digit by digit
+static uint8_t  gFieldFlags;
 
-// --------------------------------------------------------------------------
+static uint8_t  gChecksum;           // XOR of all characters between '$' and '*'
+static uint8_t  gChecksumRx;         // checksum received after '*'
+static uint8_t  gChecksumDigits;
 
-typedef enum {
+// finish the current field of an $ACRAW sentence, FALSE if it is empty
+static uint8_t CompassFieldEnd(uint8_t field) {
 
-  kSENTENCE_TYPE_UNKNOWN = 0,
-  kSENTENCE_TYPE_ACOK,
-  kSENTENCE_TYPE_ACERR,
-  kSENTENCE_TYPE_ACRAW,
+  if ( !(gFieldFlags & FIELD_DIGITS) ) return FALSE;
 
-} ESentenceType;
+  if ( field >= 1 && field <= N_RAW_VALUES )
+    gRawValue[field-1] = (gFieldFlags & FIELD_NEGATIVE)
+                       ? -(int32_t)gFieldValue : (int32_t)gFieldValue;
 
-static uint8_t gSentenceType = kSENTENCE_TYPE_UNKNOWN;
+  gFieldValue = 0;
+  gFieldFlags = 0;
 
-/* raw data string of individual quantities */
+  return TRUE;
+}
 
-static char gACC_x_raw[7];
-static char gACC_y_raw[7];
-static char gACC_z_raw[7];
+// older versions of lsm303read.c send the two checksum nibbles swapped,
+// both orders are accepted
+static uint8_t CompassChecksumOK(void) {
 
-static char gMAG_x_raw[5];
-static char gMAG_y_raw[5];
-static char gMAG_z_raw[5];
+  return ( gChecksumRx == gChecksum )
+      || ( gChecksumRx == (uint8_t)((gChecksum << 4) | (gChecksum >> 4)) );
+}
 
 // inspired by G.Dion's (WhereAVR) MsgHandler() function
 //
+// The values are accumulated as the characters arrive, nothing is copied.
+// Returns TRUE only at the end of a complete $ACRAW sentence with six
+// valid int16_t values and a correct checksum, any malformed sentence is
+// dropped at the first offending character.
+//
 static uint8_t CompassMessageDecode(uint8_t newchar) {
 
   static uint8_t commas;			// Number of commas for far in sentence
-  static uint8_t index;				// Individual array index
 
   if ( newchar == 0 ) {				// A NULL character resets decoding
 
-    commas = 25;			    	// Set to an outrageous value
+    gDecodeState = kDECODE_IDLE;
     gSentenceType = kSENTENCE_TYPE_UNKNOWN;	// Clear local parse variable
     return FALSE;
   }
 
   if ( newchar == '$' ) {			// Start of Sentence character, reset
 
+    if ( gDecodeState != kDECODE_IDLE ) gDecodeDropped++;
+
     commas = 0; 			    	// No commas detected in sentence for far
     gSentenceType = kSENTENCE_TYPE_UNKNOWN;	// Clear local parse variable
+    gDecodeState = kDECODE_DATA;
+    gChecksum = 0;
+    gChecksumRx = 0;
+    gChecksumDigits = 0;
+    gFieldValue = 0;
+    gFieldFlags = 0;
     return FALSE;
   }
 
-  if ( newchar == ',' ) {			// If there is a comma
+  if ( gDecodeState == kDECODE_IDLE )		// outside of a sentence
+    return FALSE;
 
-    commas += 1;			    	// Increment the comma count
-    index = 0;  			    	// And reset the field index
+  if ( gDecodeState == kDECODE_CHECKSUM ) {	// "*XX\r\n"
+
+    uint8_t digit;
+
+    if ( newchar == '\r' ) return FALSE;
+
+    if ( newchar == '\n' ) {			// end of sentence
+      if ( gChecksumDigits != 2 || !CompassChecksumOK() ) {
+        CompassDrop();
+        return FALSE;
+      }
+      gDecodeState = kDECODE_IDLE;
+      return gSentenceType == kSENTENCE_TYPE_ACRAW;
+    }
+
+    if ( newchar >= '0' && newchar <= '9' )
+      digit = newchar - '0';
+    else if ( newchar >= 'A' && newchar <= 'F' )
+      digit = newchar - 'A' + 10;
+    else if ( newchar >= 'a' && newchar <= 'f' )
+      digit = newchar - 'a' + 10;
+    else
+      digit = 0xff;
+
+    if ( digit == 0xff || gChecksumDigits == 2 ) {
+      CompassDrop();				// garbage, drop sentence
+      return FALSE;
+    }
+
+    gChecksumRx = (gChecksumRx << 4) | digit;
+    gChecksumDigits++;
     return FALSE;
   }
 
-  //if ( newchar == '*' ) {			// If there is a '*' -> checksum
-  //  return TRUE;
-  //}
+  // kDECODE_DATA
 
-  if ( newchar == '\n' ) {			// If there is a linefeed character
-    gSentenceType = kSENTENCE_TYPE_UNKNOWN;	// Clear local parse variable
-    return TRUE;
+  if ( newchar == '\r' || newchar == '\n' ) {	// sentence without checksum
+    CompassDrop();
+    return FALSE;
+  }
+
+  if ( newchar == '*' ) {			// end of data, checksum follows
+
+    if ( gSentenceType == kSENTENCE_TYPE_ACRAW
+         && ( commas != N_RAW_VALUES || !CompassFieldEnd( commas ) ) ) {
+      CompassDrop();
+      return FALSE;
+    }
+
+    gDecodeState = kDECODE_CHECKSUM;
+    return FALSE;
+  }
+
+  gChecksum ^= newchar;
+
+  if ( newchar == ',' ) {			// If there is a comma
+
+    if ( gSentenceType == kSENTENCE_TYPE_ACRAW
+         && ( (commas > 0 && !CompassFieldEnd( commas ))
+              || commas == N_RAW_VALUES ) ) {
+      CompassDrop();
+      return FALSE;
+    }
+
+    commas += 1;			    	// Increment the comma count
+    return FALSE;
   }
 
   if ( commas == 0 ) {
@@ -284,51 +605,80 @@ static uint8_t CompassMessageDecode(uint8_t newchar) {
     return FALSE;
   }
 
-  if ( gSentenceType == kSENTENCE_TYPE_ACOK ) {         // $ACOK sentence decode initiated
-
-  }
+  if ( gSentenceType != kSENTENCE_TYPE_ACRAW )	// $ACOK, $ACERR: nothing to do
+    return FALSE;
 
-  if ( gSentenceType == kSENTENCE_TYPE_ACERR ) {        // $ACERR sentence decode initiated
+  // example: "$ACRAW,768,-704,-16208,-278,-342,337*E4"
 
+  if ( newchar == '-' && !gFieldFlags ) {
+    gFieldFlags = FIELD_NEGATIVE;
+    return FALSE;
   }
 
-  if ( gSentenceType == kSENTENCE_TYPE_ACRAW ) {	// $ACRAW sentence decode initiated
+  if ( newchar >= '0' && newchar <= '9' ) {
 
-    // example: "$ACRAW,768,-704,-16208,-278,-342,337*E4"
+    uint8_t digit = newchar - '0';
+    uint16_t limit = (gFieldFlags & FIELD_NEGATIVE) ? 32768 : 32767;
 
-    switch ( commas ) {
-      case 1: gACC_x_raw[index++] = newchar; return FALSE;
-      case 2: gACC_y_raw[index++] = newchar; return FALSE;
-      case 3: gACC_z_raw[index++] = newchar; return FALSE;
-      case 4: gMAG_x_raw[index++] = newchar; return FALSE;
-      case 5: gMAG_y_raw[index++] = newchar; return FALSE;
-      case 6: gMAG_z_raw[index++] = newchar; return FALSE;
+    if ( gFieldValue <= (limit - digit) / 10 ) {
+      gFieldValue = 10 * gFieldValue + digit;
+      gFieldFlags |= FIELD_DIGITS;
+      return FALSE;
     }
-
-    return FALSE;
   }
 
+  CompassDrop();				// overflow or garbage, drop sentence
   return FALSE;
 
 }  // end of CompassMessageDecode()
 
 // --------------------------------------------------------------------------
 
+#ifdef COMPASS_BINARY_FORMAT
+
+// decoding of binary frames (../LSM303/binframe.h), the values are
+// stored in the same place as those of an $ACRAW sentence
+static uint8_t CompassFrameDecode(uint8_t newchar) {
+
+  bin_frame_t frame;
+
+  if ( !BinFrameDecode( &gBinDecoder, newchar, &frame ) ) return FALSE;
+
+  for ( uint8_t i=0; i<N_RAW_VALUES; ++i )
+    gRawValue[i] = frame.fValue[i];
+
+  return TRUE;
+}
+
+#endif // COMPASS_BINARY_FORMAT
+
+// --------------------------------------------------------------------------
+
 void CompassMessageInit(void) {
 
   CompassMessageDecode( 0 );
+}
 
-  for (uint8_t i=0; i<sizeof(gACC_x_raw); ++i) {
-    gACC_x_raw[i] = 0;
-    gACC_y_raw[i] = 0;
-    gACC_z_raw[i] = 0;
-  }
+// --------------------------------------------------------------------------
 
-  for (uint8_t i=0; i<sizeof(gMAG_x_raw); ++i) {
-    gMAG_x_raw[i] = 0;
-    gMAG_y_raw[i] = 0;
-    gMAG_z_raw[i] = 0;
-  }
+// a receive error drops the sentence
+static void CompassMessageError(void) {
+
+  if ( gDecodeState != kDECODE_IDLE ) CompassDrop();
+}
+
+// --------------------------------------------------------------------------
+
+uint8_t CompassMessageBusy(void) {
+
+  return gDecodeState != kDECODE_IDLE;
+}
+
+// --------------------------------------------------------------------------
+
+uint8_t CompassMessageDropped(void) {
+
+  return gDecodeDropped;
 }
 
 // --------------------------------------------------------------------------
@@ -337,17 +687,19 @@ static void CompassMessageConvert(i_vector_t* acc,i_vector_t* mag) {
 
   if ( !acc || !mag ) return;
 
-  acc->x = atoi( gACC_x_raw );
-  acc->y = atoi( gACC_y_raw );
-  acc->z = atoi( gACC_z_raw );
+  acc->x = gRawValue[0];
+  acc->y = gRawValue[1];
+  acc->z = gRawValue[2];
 
-  mag->x = atoi( gMAG_x_raw );
-  mag->y = atoi( gMAG_y_raw );
-  mag->z = atoi( gMAG_z_raw );
+  mag->x = gRawValue[3];
+  mag->y = gRawValue[4];
+  mag->z = gRawValue[5];
 }
 
 // --------------------------------------------------------------------------
 
+#ifndef COMPASS_FIXED_POINT
+
 // Returns a heading (in degrees) given an acceleration vector a due to gravity, a magnetic vector m, and a facing vector p.
 int GetHeading3D(const vector_t *a, const vector_t *m, const vector_t *p) {
 
@@ -370,5 +722,7 @@ int GetHeading3D(const vector_t *a, const vector_t *m, const vector_t *p) {
   return heading;
 }
 
+#endif // COMPASS_FIXED_POINT
+
 // --------------------------------------------------------------------------
 // --------------------------------------------------------------------------
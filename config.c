@@ -0,0 +1,201 @@
+/*
+ * File   : config.c
+ *
+ * Copyright:      Hermann-Josef Mathes  mailto: dc2ip@darc.de
+ * Author:         Hermann-Josef Mathes
+ * Remarks:
+ * Known problems: development status
+ * Version:        Version v1r0
+ * Description:    Configuration record in EEPROM (versioned, CRC,
+ *                 round-robin slots).
+ *
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+   If not, write to the Free Software Foundation,
+   Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+
+ *
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+/** @file config.c
+  * Configuration record in EEPROM (versioned, CRC, round-robin slots).
+  *
+  * All settings and learned values of the controller are one record
+  * (config_t), ConfigInit() reads it at once into gConfig. The modules
+  * take their values from there and change them in gConfig, ConfigSave()
+  * then has it written.
+  *
+  * Each write goes into the next of CONFIG_SLOTS slots with the sequence
+  * number incremented, thus the cells of the EEPROM wear CONFIG_SLOTS
+  * times slower than with fixed addresses. The CRC comes last, a write
+  * cut by a reset or power loss leaves an invalid slot and the previous
+  * record is used. ConfigRead() takes the valid record (version and CRC)
+  * with the highest sequence number, modulo 256.
+  *
+  * ConfigExec() writes one byte whenever the EEPROM is ready (3.4 ms per
+  * byte), the main loop is not blocked for the 100 bytes. A change during
+  * the write restarts it into the same slot.
+  *
+  * Without a valid record (new controller, layout changed) the defaults
+  * below are written at the first start.
+  *
+  * @author H.-J. Mathes <dc2ip@darc.de>
+  */
+
+#include <avr/io.h>
+#include <avr/eeprom.h>
+#include <avr/pgmspace.h>
+#include <util/crc16.h>
+
+#include "global.h"
+
+/* local data types and variables */
+
+config_t gConfig;
+
+/** The slots of the record. */
+static config_t gEE_Config[CONFIG_SLOTS] EEMEM;
+
+/** Defaults, the values of the former EEMEM variables. */
+static const config_t cConfigDefault PROGMEM = {
+  CONFIG_VERSION,
+  0,
+  LIMIT_ANGLE,
+  MAX_ANGLE,
+  0,
+  HEADING_FILTER_DEFAULT,
+  { -474, -257, -257 },                  // min/max at mockup location
+  {   36,  238,  238 },
+  {
+    MAG_CALIB_NONE,                      // not fitted, min/max are used
+    { -219.0, -9.5, -9.5 },
+    { { 2.0/510, 0, 0 }, { 0, 2.0/495, 0 }, { 0, 0, 2.0/495 } }
+  },
+  CONFIG_RELAY_DELAYS,
+  { 0xff, 0xff },
+  { 0, 0, 0 },
+  CONFIG_HEADING_UNKNOWN,
+  0
+};
+
+static uint8_t gConfigSlot = 0;          // of the newest record
+static uint8_t gConfigSaved = FALSE;     // gConfig to be written
+static uint8_t gConfigByte = sizeof(config_t); // next one to write
+
+// --------------------------------------------------------------------------
+
+static uint16_t ConfigCRC(const config_t *config) {
+
+  const uint8_t *p = (const uint8_t *)config;
+  uint16_t crc = 0xffff;
+
+  for ( uint8_t i=0; i<sizeof(config_t)-sizeof(config->fCRC); ++i )
+    crc = _crc_ccitt_update( crc, p[i] );
+
+  return crc;
+}
+
+// --------------------------------------------------------------------------
+
+uint8_t ConfigRead(config_t *config) {
+
+  uint8_t newest = CONFIG_SLOTS, sequence = 0;
+
+  for ( uint8_t i=0; i<CONFIG_SLOTS; ++i ) {
+
+    eeprom_read_block( config, &gEE_Config[i], sizeof(config_t) );
+
+    if ( config->fVersion != CONFIG_VERSION || config->fCRC != ConfigCRC( config ) )
+      continue;
+
+    if ( newest == CONFIG_SLOTS || (int8_t)(config->fSequence - sequence) > 0 ) {
+      newest = i;
+      sequence = config->fSequence;
+    }
+  }
+
+  if ( newest < CONFIG_SLOTS )
+    eeprom_read_block( config, &gEE_Config[newest], sizeof(config_t) );
+
+  return newest;
+}
+
+// --------------------------------------------------------------------------
+
+// called first by main()
+void ConfigInit(void) {
+
+  gConfigSlot = ConfigRead( &gConfig );
+
+  if ( gConfigSlot < CONFIG_SLOTS ) return;
+
+  // no valid record, the defaults become the first one (slot 0)
+  memcpy_P( &gConfig, &cConfigDefault, sizeof(config_t) );
+  gConfig.fSequence = 0xff;
+  gConfigSlot = CONFIG_SLOTS - 1;
+
+  ConfigSave();
+  ConfigFlush();
+}
+
+// --------------------------------------------------------------------------
+
+void ConfigSave(void) {
+
+  gConfigSaved = TRUE;
+}
+
+// --------------------------------------------------------------------------
+
+// called by main()
+void ConfigExec(void) {
+
+  if ( !eeprom_is_ready() ) return;
+
+  uint8_t slot = (gConfigSlot + 1) % CONFIG_SLOTS;
+
+  // (re)start, the sequence number of the newest record + 1
+  if ( gConfigSaved ) {
+
+    gConfigSaved = FALSE;
+
+    if ( gConfigByte == sizeof(config_t) ) gConfig.fSequence++;
+    gConfig.fCRC = ConfigCRC( &gConfig );
+    gConfigByte = 0;
+  }
+
+  if ( gConfigByte == sizeof(config_t) ) return;
+
+  // skips unchanged bytes of the old record in this slot
+  eeprom_update_byte( (uint8_t *)&gEE_Config[slot] + gConfigByte,
+                      ((const uint8_t *)&gConfig)[gConfigByte] );
+
+  if ( ++gConfigByte == sizeof(config_t) ) gConfigSlot = slot;
+}
+
+// --------------------------------------------------------------------------
+
+void ConfigFlush(void) {
+
+  do {
+    eeprom_busy_wait();
+    ConfigExec();
+  } while ( gConfigByte < sizeof(config_t) );
+}
+
+// --------------------------------------------------------------------------
+// --------------------------------------------------------------------------
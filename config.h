@@ -0,0 +1,150 @@
+/*
+ * File   : config.h
+ *
+ * Copyright:      Hermann-Josef Mathes  mailto: dc2ip@darc.de
+ * Author:         Hermann-Josef Mathes
+ * Remarks:
+ * Known problems: development status
+ * Version:        Version v1r0
+ * Description:    Declarations for the configuration record in EEPROM
+ *                 (versioned, CRC, round-robin slots).
+ *
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+   If not, write to the Free Software Foundation,
+   Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+
+ *
+ */
+
+
+/** @file config.h
+  * Declarations for the configuration record in EEPROM (versioned, CRC,
+  * round-robin slots). Also used by the host tools (Linux/magcalib).
+  * @author H.-J.Mathes <dc2ip@darc.de>
+  */
+
+#ifndef _config_h_
+#define _config_h_
+
+#include <stddef.h>   // offsetof
+#include <stdint.h>
+
+#include "fixheading.h"   // vector_t, mag_calib_t
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Delays of the relay sequence in RotatorExec(), index of fRelayDelay[]. */
+typedef enum {
+
+  kDelayPowerOn,        // PowerOn() -> BrakeRelease()            [10 ms]
+  kDelayBrakeRelease,   // BrakeRelease() -> RotatorCW/CCW()      [10 ms]
+  kDelayRotatorOn,      // RotatorCW/CCW() -> kTurningCW/CCW      [10 ms]
+  kDelayRotatorOff,     // RotatorOff() -> BrakeLock()            [10 ms]
+  kDelayBrakeLock,      // BrakeLock() -> PowerOff()              [10 ms]
+  kDelayPowerOff,       // PowerOff() -> next command             [10 ms]
+  kDelayHoldPower,      // power stays on after a stop, 0 = off  [100 ms]
+  kNRelayDelays,
+
+} ERelayDelay;
+
+/** Default of fRelayDelay[], also the one of Linux/passplan. */
+#define CONFIG_RELAY_DELAYS     { 10, 5, 5, 5, 5, 10, 0 }
+
+/** Samples without a change of the heading after a stop until it is taken
+  * as settled, at least, at most GOTO_TIMEOUT (PresetGoto()). After a turn
+  * at full speed it is the time for two steps of the heading (5 deg) at
+  * this speed. Here as Linux/passplan models the waits of the firmware.
+  */
+#define GOTO_SETTLE_SAMPLES     5
+
+/** Layout of config_t, records of another version are not used. */
+#define CONFIG_VERSION          1
+
+/** Number of slots for the record in EEPROM, written in turn. */
+#define CONFIG_SLOTS            10
+
+/** fHeading before the rotor was stopped once. */
+#define CONFIG_HEADING_UNKNOWN  0xffff
+
+/** The configuration of the controller, one record in EEPROM.
+  *
+  * Each field starts at a multiple of its alignment on the host (4 for the
+  * floats, 2 for uint16_t), thus there is no padding and the layout (100
+  * bytes) is the same on the AVR and on the host. The offsets are checked
+  * below, a new field has to keep this (e.g. take it from fSpare[]).
+  */
+typedef struct _config {
+
+  uint8_t     fVersion;          // CONFIG_VERSION
+  uint8_t     fSequence;         // +1 per write, the newest record is used
+  uint16_t    fLimitAngle;       // heading of the counter clockwise stop
+  uint16_t    fRotorRange;       // [deg] from the stop, up to ROTOR_RANGE_MAX
+  uint8_t     fRotorUpper;       // the rotor was in the upper half (overlap)
+  uint8_t     fHeadingWindow;    // headings to average (HEADING_FILTER_MAX)
+  vector_t    fMAG_min;          // min/max readings of the MAG sensor
+  vector_t    fMAG_max;
+  mag_calib_t fMAG_calib;        // fitted by Linux/magcalib, if its magic is valid
+  uint8_t     fRelayDelay[kNRelayDelays];
+  uint8_t     fGotoCoast[2];     // [deg] run-out CW, CCW, 0xff = not yet known
+  uint8_t     fSpare[3];
+  uint16_t    fHeading;          // at the last stop, shown at once after a reset
+  uint16_t    fCRC;              // CRC-16 (CCITT) of the bytes before
+
+} config_t;
+
+/** Fails to compile if '_cond_' is false (C99 and C++98). */
+#define CONFIG_ASSERT(_cond_,_name_) \
+  typedef char config_assert_##_name_[(_cond_) ? 1 : -1]
+
+CONFIG_ASSERT( sizeof(config_t) == 100, size );
+CONFIG_ASSERT( offsetof(config_t, fLimitAngle) == 2, limit_angle );
+CONFIG_ASSERT( offsetof(config_t, fMAG_min) == 8, mag_min );
+CONFIG_ASSERT( offsetof(config_t, fMAG_calib) == 32, mag_calib );
+CONFIG_ASSERT( offsetof(config_t, fRelayDelay) == 84, relay_delay );
+CONFIG_ASSERT( offsetof(config_t, fGotoCoast) == 91, goto_coast );
+CONFIG_ASSERT( offsetof(config_t, fHeading) == 96, heading );
+CONFIG_ASSERT( offsetof(config_t, fCRC) == 98, crc );
+
+/** The configuration in RAM, read from EEPROM by ConfigInit(). */
+extern config_t gConfig;
+
+/** Read the newest valid record from EEPROM into gConfig, to be called
+  * first in main(). Without one the defaults are written.
+  */
+extern void ConfigInit(void);
+
+/** Read the newest valid record from EEPROM into 'config'. Returns its
+  * slot, CONFIG_SLOTS if there is none.
+  */
+extern uint8_t ConfigRead(config_t *config);
+
+/** gConfig was changed, it is written into the next slot by ConfigExec(). */
+extern void ConfigSave(void);
+
+/** To be called by main(): writes a saved gConfig, one byte whenever the
+  * EEPROM is ready.
+  */
+extern void ConfigExec(void);
+
+/** Write a saved gConfig now, waits for the EEPROM. */
+extern void ConfigFlush(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _config_h_ */
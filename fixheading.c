@@ -0,0 +1,269 @@
+/*
+ * File   : fixheading.c
+ *
+ * Copyright:      Hermann-Josef Mathes  mailto: dc2ip@darc.de
+ * Author:         Hermann-Josef Mathes
+ * Remarks:
+ * Known problems: development status
+ * Version:        Version v1r0
+ * Description:    Integer (fixed point) version of the heading calculation,
+ *                 replaces the float code of GetHeading3D().
+ *
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+   If not, write to the Free Software Foundation,
+   Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+
+ *
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/** @file fixheading.c
+  * Integer (fixed point) version of the heading calculation.
+  *
+  * The same steps as in GetHeading3D() are done, but without soft-float:
+  * @li the MAG readings are shifted and multiplied with the matrix of the
+  *     calibration, both are converted once (FixHeadingInit())
+  * @li E = m x a and N = a x E are calculated with int32_t, E is rescaled
+  *     to 14 bits in between (block floating point)
+  * @li instead of normalizing E and N (2 x sqrt and 6 divisions) the heading
+  *     atan2(-E.y, -N.y/|a|) is calculated as atan2(-E.y * |a|, -N.y),
+  *     thus only one integer square root is required
+  * @li atan2() is done by CORDIC with an angle table in PROGMEM
+  *
+  * This file is also compiled on the host (Linux/headingtest.cc).
+  *
+  * @author H.-J. Mathes <dc2ip@darc.de>
+  */
+
+#ifdef __AVR__
+# include <avr/pgmspace.h>
+#else
+# define PROGMEM
+# define pgm_read_word(addr)   (*(addr))
+#endif // __AVR__
+
+#include "fixheading.h"
+
+// --------------------------------------------------------------------------
+
+void MagCalibInit(mag_calib_t *mag,
+                  const vector_t *min,const vector_t *max) {
+
+  // each member by its own pointer
+  const float *pmin[3] = { &min->x, &min->y, &min->z };
+  const float *pmax[3] = { &max->x, &max->y, &max->z };
+
+  mag->fMagic = MAG_CALIB_MAGIC;
+
+  for ( uint8_t i=0; i<3; ++i ) {
+
+    float range = *pmax[i] - *pmin[i];
+
+    if ( range < 16.0 ) range = 16.0;   // no valid calibration
+
+    mag->fOffset[i] = (*pmax[i] + *pmin[i]) / 2.0;
+
+    for ( uint8_t j=0; j<3; ++j )
+      mag->fMatrix[i][j] = i == j ? 2.0 / range : 0.0;
+  }
+}
+
+// --------------------------------------------------------------------------
+
+/** Limit of the fixed point matrix elements, W = 2/16 as for a range of 16. */
+#define FIX_MATRIX_MAX  (1L << (FIX_MAG_SHIFT+FIX_SCALE_SHIFT-4))
+
+void FixHeadingInit(fix_calib_t *calib,const mag_calib_t *mag) {
+
+  float rest[3];
+
+  for ( uint8_t i=0; i<3; ++i ) {
+    calib->fOffset[i] = (int16_t)(2.0 * mag->fOffset[i]
+                                  + (mag->fOffset[i] < 0 ? -0.5 : 0.5));
+    rest[i] = 0.5 * calib->fOffset[i] - mag->fOffset[i];
+  }
+
+  for ( uint8_t i=0; i<3; ++i ) {
+
+    float bias = 0.0;
+
+    for ( uint8_t j=0; j<3; ++j )
+      bias += mag->fMatrix[i][j] * rest[j];
+
+    bias *= (float)(1L << FIX_MAG_SHIFT);
+    if ( !(bias > -1024.0 && bias < 1024.0) ) bias = 0.0;   // also NaN
+
+    calib->fBias[i] = (int16_t)(bias + (bias < 0 ? -0.5 : 0.5));
+
+    for ( uint8_t j=0; j<3; ++j ) {
+
+      float w = mag->fMatrix[i][j]
+                * (float)(1L << (FIX_MAG_SHIFT+FIX_SCALE_SHIFT-1));
+
+      if ( !(w > -FIX_MATRIX_MAX) ) w = -FIX_MATRIX_MAX;  // also NaN
+      else if ( w > FIX_MATRIX_MAX ) w = FIX_MATRIX_MAX;
+
+      calib->fMatrix[i][j] = (int32_t)(w + (w < 0 ? -0.5 : 0.5));
+    }
+  }
+}
+
+// --------------------------------------------------------------------------
+
+/** atan(2^-i) in units of 1/256 degree. */
+static const int16_t cCordicAngle[] PROGMEM = {
+  11520, 6801, 3593, 1824, 916, 458, 229, 115, 57, 29, 14, 7, 4, 2, 1
+};
+
+#define N_CORDIC   (sizeof(cCordicAngle)/sizeof(cCordicAngle[0]))
+
+int32_t FixAtan2(int32_t y,int32_t x) {
+
+  int32_t angle = 0;
+
+  if ( x == 0 && y == 0 ) return 0;
+
+  // rotate into the right half plane
+  if ( x < 0 ) {
+    int32_t t = x;
+    if ( y >= 0 ) {
+      x = y; y = -t; angle = 90L * 256;
+    }
+    else {
+      x = -y; y = t; angle = -90L * 256;
+    }
+  }
+
+  // scale to 28 bits, leaves room for the CORDIC gain of 1.65
+  while ( labs(x) >= (1L << 28) || labs(y) >= (1L << 28) ) {
+    x /= 2; y /= 2;
+  }
+  while ( labs(x) < (1L << 27) && labs(y) < (1L << 27) ) {
+    x *= 2; y *= 2;
+  }
+
+  for ( uint8_t i=0; i<N_CORDIC; ++i ) {
+
+    int32_t dx = x >> i;
+    int32_t dy = y >> i;
+    int16_t da = pgm_read_word( &cCordicAngle[i] );
+
+    if ( y > 0 ) {
+      x += dy; y -= dx; angle += da;
+    }
+    else {
+      x -= dy; y += dx; angle -= da;
+    }
+  }
+
+  return angle;
+}
+
+// --------------------------------------------------------------------------
+
+uint16_t FixSqrt(uint32_t x) {
+
+  uint32_t root = 0;
+  uint32_t bit = 1UL << 30;
+
+  while ( bit > x ) bit >>= 2;
+
+  while ( bit ) {
+    if ( x >= root + bit ) {
+      x -= root + bit;
+      root = (root >> 1) + bit;
+    }
+    else
+      root >>= 1;
+    bit >>= 2;
+  }
+
+  return (uint16_t)root;
+}
+
+// --------------------------------------------------------------------------
+
+// one component of m' = W (m - c), Q12
+static int16_t FixScaleMAG(const fix_calib_t *calib,uint8_t i,const int32_t *d) {
+
+  int32_t s = calib->fBias[i];
+
+  for ( uint8_t j=0; j<3; ++j )
+    s += (d[j] * calib->fMatrix[i][j]) >> FIX_SCALE_SHIFT;
+
+  if ( s > 32767 ) s = 32767;
+  else if ( s < -32767 ) s = -32767;
+
+  return (int16_t)s;
+}
+
+// --------------------------------------------------------------------------
+
+int FixGetHeading3D(const fix_calib_t *calib,
+                    const i_vector_t *a,const i_vector_t *m) {
+
+  // MAG: shift, 2 * (m - c)
+  int32_t d[3] = { 2 * (int32_t)m->x - calib->fOffset[0],
+                   2 * (int32_t)m->y - calib->fOffset[1],
+                   2 * (int32_t)m->z - calib->fOffset[2] };
+
+  for ( uint8_t i=0; i<3; ++i ) {
+    if ( d[i] > 16383 ) d[i] = 16383;
+    else if ( d[i] < -16383 ) d[i] = -16383;
+  }
+
+  // and correct, Q12
+  int32_t mx = FixScaleMAG( calib, 0, d );
+  int32_t my = FixScaleMAG( calib, 1, d );
+  int32_t mz = FixScaleMAG( calib, 2, d );
+
+  // ACC: 1 g = 16384 -> 2048
+  int32_t ax = a->x >> 3;
+  int32_t ay = a->y >> 3;
+  int32_t az = a->z >> 3;
+
+  // cross magnetic vector with "down" to produce "east"
+  int32_t ex = my * az - mz * ay;
+  int32_t ey = mz * ax - mx * az;
+  int32_t ez = mx * ay - my * ax;
+
+  // rescale "east" to 14 bits, its length doesn't matter
+  while ( labs(ex) >= (1L << 14) || labs(ey) >= (1L << 14)
+                                 || labs(ez) >= (1L << 14) ) {
+    ex /= 2; ey /= 2; ez /= 2;
+  }
+
+  // cross "down" with "east" to produce "north", only N.y is needed
+  int32_t ny = az * ex - ax * ez;
+
+  // |E x a| = |E| * |a|, so atan2(E.p/|E|,N.p/|N|) = atan2(E.p * |a|,N.p)
+  int32_t amag = FixSqrt( (uint32_t)(ax*ax + ay*ay + az*az) );
+
+  // facing vector p = (0,-1,0)
+  int32_t angle = FixAtan2( -ey * amag, -ny );
+
+  // round to degrees like round() does, i.e. halfway away from zero
+  int heading = angle >= 0 ? (int)((angle + 128) >> 8)
+                           : -(int)((-angle + 128) >> 8);
+  if ( heading < 0 )
+    heading += 360;
+
+  return heading;
+}
+
+// --------------------------------------------------------------------------
+// --------------------------------------------------------------------------
@@ -0,0 +1,121 @@
+/*
+ * File   : fixheading.h
+ *
+ * Copyright:      Hermann-Josef Mathes  mailto: dc2ip@darc.de
+ * Author:         Hermann-Josef Mathes
+ * Remarks:
+ * Known problems: development status
+ * Version:        Version v1r0
+ * Description:    Declarations for the integer (fixed point) heading
+ *                 calculation.
+ *
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+   If not, write to the Free Software Foundation,
+   Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+
+ *
+ */
+
+
+/** @file fixheading.h
+  * Declarations for the integer (fixed point) heading calculation.
+  * @author H.-J.Mathes <dc2ip@darc.de>
+  */
+
+#ifndef _fixheading_h_
+#define _fixheading_h_
+
+#include <stdint.h>
+
+#include "vector.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** vector like data type with int16_t components. */
+typedef struct i_vector {
+
+  int16_t  x;
+  int16_t  y;
+  int16_t  z;
+
+} i_vector_t;
+
+/** Number of fractional bits of the scaled MAG readings, 1.0 = 4096.
+  *
+  * Q12 instead of Q15 leaves headroom for readings outside of the
+  * calibrated range.
+  */
+#define FIX_MAG_SHIFT       12
+
+/** Number of fractional bits of the precomputed matrix. */
+#define FIX_SCALE_SHIFT     8
+
+/** Calibration of the MAG sensor, part of the record in EEPROM (config.h).
+  *
+  * The readings are corrected by m' = W (m - c): c is the center of the
+  * ellipsoid of the readings (hard iron), W maps it onto the unit sphere
+  * (soft iron). Linux/magcalib fits both and writes the record into an
+  * EEPROM image: packed, little endian, 52 bytes.
+  */
+typedef struct _mag_calib {
+
+  uint32_t fMagic;        // MAG_CALIB_MAGIC, else the min/max are used
+  float    fOffset[3];    // c
+  float    fMatrix[3][3]; // W, row major
+
+} mag_calib_t;
+
+/** Marks a valid record in EEPROM, "MCAL". */
+#define MAG_CALIB_MAGIC     0x4c41434dUL
+/** Marks the place of the record before a fit, "MCA0". */
+#define MAG_CALIB_NONE      0x3041434dUL
+
+/** The calibration from the min/max readings of each axis: the center of
+  * the box and a diagonal W which scales each axis to -1 ... +1.
+  */
+extern void MagCalibInit(mag_calib_t *mag,
+                         const vector_t *min,const vector_t *max);
+
+/** Calibration of the MAG sensor, precomputed for the integer pipeline. */
+typedef struct _fix_calib {
+
+  int16_t  fOffset[3];     // 2 * c, rounded
+  int16_t  fBias[3];       // W (c - c'), the rounding of the offset, Q12
+  int32_t  fMatrix[3][3];  // W * 2^(FIX_MAG_SHIFT+FIX_SCALE_SHIFT-1)
+
+} fix_calib_t;
+
+/** Precompute offsets and the fixed point matrix from the calibration. */
+extern void FixHeadingInit(fix_calib_t *calib,const mag_calib_t *mag);
+
+/** atan2(y,x) in units of 1/256 degree, range -180 ... +180 degrees. */
+extern int32_t FixAtan2(int32_t y,int32_t x);
+
+/** Integer square root. */
+extern uint16_t FixSqrt(uint32_t x);
+
+/** Returns the heading (0 ... 359 degrees) for the raw ACC and MAG readings,
+  * with the facing vector p = (0,-1,0) as in GetHeading3D().
+  */
+extern int FixGetHeading3D(const fix_calib_t *calib,
+                           const i_vector_t *a,const i_vector_t *m);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _fixheading_h_ */
@@ -28,12 +28,14 @@
 
 volatile uint8_t gKeyState = 0;
 volatile uint8_t gKeyPress = 0;
+volatile uint8_t gKeyLong = 0;
 
 // --------------------------------------------------------------------------
 
 void CheckKeys(void) {
 
   static uint8_t ct0, ct1;
+  static uint8_t long_ct = BUTTON_LONG_TIME;
   uint8_t i;
 
   i = gKeyState ^ ~BUTTON_PIN;	// key changed ?
@@ -43,6 +45,12 @@ void CheckKeys(void) {
   i &= ct0 & ct1;		// count until roll over
   gKeyState ^= i;		// then toggle debounced state
   gKeyPress |= gKeyState & i;	// 0->1: key pressing detect
+
+  // long press, once per press of the key(s) in BUTTON_LONG_MASK
+  if ( !(gKeyState & BUTTON_LONG_MASK) )
+    long_ct = BUTTON_LONG_TIME;
+  else if ( long_ct && !--long_ct )
+    gKeyLong |= gKeyState & BUTTON_LONG_MASK;
 }
 
 // --------------------------------------------------------------------------
@@ -51,8 +59,8 @@ uint8_t GetKeyPress(uint8_t key_mask) {
 
   cli();          // read and clear atomic !
 
-  gKeyState &= key_mask;                        // read key(s)
-  key_mask ^= gKeyState;                        // clear key(s)
+  key_mask &= gKeyPress;                        // read key(s)
+  gKeyPress ^= key_mask;                        // clear key(s)
 
   sei();
 
@@ -68,5 +76,19 @@ uint8_t GetKeyShort(uint8_t key_mask) {
   return GetKeyPress( ~gKeyState & key_mask );
 }
 
+// --------------------------------------------------------------------------
+
+uint8_t GetKeyLong(uint8_t key_mask) {
+
+  cli();          // read and clear atomic !
+
+  key_mask &= gKeyLong;                         // read key(s)
+  gKeyLong ^= key_mask;                         // clear key(s)
+
+  sei();
+
+  return key_mask;
+}
+
 // --------------------------------------------------------------------------
 // --------------------------------------------------------------------------
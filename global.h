@@ -53,6 +53,9 @@
 #endif /* FALSE */
 
 #include "vector.h"
+#include "fixheading.h"   // i_vector_t
+#include "headingfilter.h"
+#include "config.h"       // configuration record in EEPROM, gConfig
 
 /* --- for the UART library of P.Fleury --- */
 
@@ -64,7 +67,7 @@
 /* --- my program constants --- */
 
 // 12 MHz crystal ==> CLK/1024 = 11.71875 kHz
-// T_0 = 0.0853 msec ==> * 117 = 9.984 msec = T_1
+// T_0 = 0.0853 msec ==> * 118 (to the overflow) = 10.07 msec = T_1
 #define CNT0_PRESET             (0xff - 117)
 
 #define BUTTON_PORT             PORTA
@@ -77,6 +80,11 @@
 #define BUTTON_CW               (1<<PA1)
 #define BUTTON_PRESET_CW        (1<<PA3)
 
+/** Key(s) with a long press (GetKeyLong()), STOP starts the calibration. */
+#define BUTTON_LONG_MASK        BUTTON_STOP
+/** Time [10 ms] a key has to be held for a long press. */
+#define BUTTON_LONG_TIME        200
+
 #define LED_PORT                PORTC
 #define LED_DDR                 DDRC
 
@@ -114,42 +122,68 @@
 #define RotatorCCW()            { RELAY_PORT |= RELAY_CCW; }
 #define RotatorOff()            { RELAY_PORT &= ~(RELAY_CW | RELAY_CCW); }
 
-/** vector like data type with int16_t components. */
-typedef struct i_vector {
-
-  int16_t  x;
-  int16_t  y;
-  int16_t  z;
-
-} i_vector_t;
-
-/* --- configuration data in EEPROM --- */
-
-//extern i_vector_t EEMEM gEE_MAG_min;
-//extern i_vector_t EEMEM gEE_MAG_max;
-extern vector_t EEMEM gEE_MAG_min;
-extern vector_t EEMEM gEE_MAG_max;
-
 /* --- declaration(s) for file get8key4.c --- */
 
 extern volatile uint8_t gKeyState;
 extern volatile uint8_t gKeyPress;
+extern volatile uint8_t gKeyLong;
 
 extern void CheckKeys(void);
 extern uint8_t GetKeyPress(uint8_t key_mask);
 extern uint8_t GetKeyShort(uint8_t key_mask);
+/** Key(s) of 'key_mask' held for BUTTON_LONG_TIME, cleared when read. */
+extern uint8_t GetKeyLong(uint8_t key_mask);
 
 /* --- declaration(s) for file rotorstate.c --- */
 
+/** Read the relay delays and the learned run-out from EEPROM, to be called before the timer
+  * interrupt runs RotatorExec().
+  */
+extern void RotatorInit(void);
+
+/** Delay 'index' (ERelayDelay) of the relay sequence. */
+extern uint8_t GetRelayDelay(uint8_t index);
+
+/** Change delay 'index' (ERelayDelay) of the relay sequence, also in
+  * EEPROM.
+  */
+extern void SetRelayDelay(uint8_t index,uint8_t value);
+
 /** Set the current heading (for the display).
   *
   * If we are not in 'preset' mode, the gPresetHeading is also modified.
   */
 extern void SetCurrentHeading(int);
 
-/**  */
+/** The current heading, as shown by the display. */
+extern int GetCurrentHeading(void);
+
+/** FALSE after a reset until the sensor sends, if no heading of the last
+  * stop was stored (gConfig.fHeading), GetCurrentHeading() is then 0.
+  */
+extern uint8_t IsHeadingValid(void);
+
+/** Angle [deg] of the rotor from the counter clockwise stop, unwrapped from
+  * the headings, 0 ... gConfig.fRotorRange.
+  */
+extern int GetRotorAngle(void);
+
+/** Turn the rotator to the given heading (shown as preset), see
+  * PresetGoto().
+  */
 extern void SetPresetHeading(int);
 
+/** Called by main(): turns the rotator towards the preset heading (given
+  * to SetPresetHeading() or by the PRESET buttons) and stops it there,
+  * decides once per compass sample.
+  */
+extern void PresetGoto(void);
+
+/** Command from the serial interface (GS-232): kTurnCW, kTurnCCW (until
+  * stopped) or kStop, a turn to the preset heading is cancelled.
+  */
+extern void SetRemoteCommand(uint8_t cmd);
+
 /**  */
 extern void RotatorExec(void);
 
@@ -171,6 +205,7 @@ typedef enum {
   kRotorRampdown,
   kTurningCCW,
   kTurningCW,
+  kHoldPower,           // stopped, brake locked, power still on
 
 } ERotorState;
 
@@ -195,7 +230,6 @@ extern void SetPresetCommand(uint8_t cmd);
 
 /**  */
 extern void PresetExec(void);
-extern void PresetExecSlow(void);
 /**  */
 extern void UpdateDisplay(void);
 
@@ -206,6 +240,9 @@ extern void UpdateDisplay(void);
 /** A mechanical stop where we cannot rotate further. */
 #define LIMIT_ANGLE    270
 
+/** Largest range of the rotator, two full turns. */
+#define ROTOR_RANGE_MAX 720
+
 typedef enum {
 
   kPresetNone = 0,
@@ -213,6 +250,7 @@ typedef enum {
   kPresetCCW,
   kPresetStop,
   kPresetExec,
+  kPresetGoto,          // turn to the preset heading (GS-232 'M')
 
 } EPresetCommand;
 
@@ -220,12 +258,22 @@ typedef enum {
 extern volatile uint8_t gPresetCommand;
 extern volatile uint8_t gPresetCounter;
 
-extern volatile uint16_t gPresetDisplayCounter;
-
 /* --- declaration(s) for file compass.c --- */
 
 extern void CompassInit(void);
 extern void CompassMessageInit(void);
 extern void CompassMessageReceive(unsigned int uart_data);
 
+/** TRUE while a sentence of the sensor is received. */
+extern uint8_t CompassMessageBusy(void);
+/** Number of broken sentences (checksum, garbage, receive error), modulo
+  * 256, e.g. by a collision with the host on the RX line.
+  */
+extern uint8_t CompassMessageDropped(void);
+
+/** New x/y bounds of the MAG sensor (calibrate.c), used for the heading
+  * and written into EEPROM, a fitted calibration is then dropped.
+  */
+extern void CompassSetBounds(const i_vector_t *min,const i_vector_t *max);
+
 #endif /* _global_h_ */
@@ -0,0 +1,405 @@
+/*
+ * File   : gs232.c
+ *
+ * Copyright:      Hermann-Josef Mathes  mailto: dc2ip@darc.de
+ * Author:         Hermann-Josef Mathes
+ * Remarks:
+ * Known problems: development status
+ * Version:        Version v1r0
+ * Description:    Server for the Yaesu GS-232A/B rotator commands.
+ *
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+   If not, write to the Free Software Foundation,
+   Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+
+ *
+ */
+
+#include <stdint.h>
+
+/** @file gs232.c
+  * Server for the Yaesu GS-232A/B rotator commands, thus tracking software
+  * (e.g. hamlib's rotctld, model 'gs232a') can drive the rotator:
+  *
+  * @li C, C2   : azimuth ("+0nnn", "+0nnn+0000"), from the cached heading,
+  *               no answer (and no frame) before there is one after a reset
+  * @li Mnnn    : turn to azimuth nnn (000 ... 450)
+  * @li R, L    : turn clockwise, counter clockwise
+  * @li A, S    : stop
+  * @li Tnn     : unsolicited frames "$RCHDG,hhh,s*cs" on each change of the
+  *               heading hhh or of the state s ('R', 'L' turning, 'B' brake
+  *               or ramp, 'S' stopped) and every nn seconds, T0 ends them
+  * @li Yk, Ykvvv: read ("Yk=vvv"), set delay k (ERelayDelay) of the relay
+  *               sequence, also in EEPROM
+  * @li K, Kttttt: read ("K=ttttt"), set the clock of the track in seconds
+  *               of the time base of the host (track.c)
+  * @li Q, Qtttttaaa: free entries of the queue ("Q=nn"), append azimuth
+  *               aaa at ttttt seconds of the clock to the track, which is
+  *               ended by M, R, L, A, S and the buttons
+  *
+  * Other commands are answered with "?>". The parser is fed byte by byte
+  * from the main loop and never waits, a query is answered as soon as its
+  * CR is received.
+  *
+  * The ATmega32 has only one USART, the commands share the RX line with the
+  * sensor: the TX of the host and the RS485 receiver have to be combined
+  * (e.g. a diode-OR or a second RS485 driver on the bus, not two outputs
+  * wired together). At 9600 baud a sentence every 100 ms occupies the line
+  * about 40 % of the time and the host cannot see the gaps, a command which
+  * is sent during a sentence collides with it. Both are then lost: the
+  * sentence fails its checksum, and a command line is dropped without an
+  * answer if any of its characters arrived while a sentence was received
+  * (CompassMessageBusy()), a sentence was broken meanwhile
+  * (CompassMessageDropped()) or the USART reported an error. The host has
+  * to repeat a query without answer and check that an 'M', 'R', 'L' or 'S'
+  * took effect (Linux/rotorctld does both). The sentences themselves are no
+  * valid command lines ('$', ',', '*') and are dropped.
+  *
+  * @author H.-J. Mathes <dc2ip@darc.de>
+  */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+#include "global.h"
+
+#include <uart.h>
+
+#include "gs232.h"
+#include "track.h"
+
+static char    gLine[GS232_LINE_MAX];
+static uint8_t gLength = 0;
+static uint8_t gValid = TRUE;
+static uint8_t gDropped;                 // CompassMessageDropped() at the start
+
+static uint8_t  gKeepalive = 0;          // [s], 0: no frames
+static int16_t  gFrameHeading = -1;      // in the last frame, -1: none yet
+static char     gFrameState;
+static volatile uint16_t gTicks = 0;     // GS232Timer() calls since then
+
+// --------------------------------------------------------------------------
+
+void GS232Init(void) {
+
+  gLength = 0;
+  gValid = TRUE;
+}
+
+// --------------------------------------------------------------------------
+
+// 'n' digits (up to 5) of 'value'
+static void GS232PutDigits(uint16_t value,uint8_t n) {
+
+  char s[6];
+
+  s[n] = '\0';
+
+  while ( n-- ) {
+    s[n] = '0' + value % 10;
+    value /= 10;
+  }
+
+  uart_puts( s );
+}
+
+// three digits of 'value' (0 ... 999)
+#define GS232PutValue(_value_) GS232PutDigits( _value_, 3 )
+
+// --------------------------------------------------------------------------
+
+// value of the 'n' digits at gLine[pos], FALSE if there are other characters
+static uint8_t GS232GetDigits(uint8_t pos,uint8_t n,uint32_t *value) {
+
+  *value = 0;
+
+  for ( uint8_t i=pos; i<pos+n; ++i ) {
+    if ( gLine[i] < '0' || gLine[i] > '9' ) return FALSE;
+    *value = 10 * *value + gLine[i] - '0';
+  }
+
+  return TRUE;
+}
+
+// --------------------------------------------------------------------------
+
+// answer to 'C', 'C2' (with elevation)
+static void GS232Position(uint8_t elevation) {
+
+  uint16_t heading = GetCurrentHeading();
+
+#ifdef GS232_FORMAT_B
+  uart_puts_P( "AZ=" );
+  GS232PutValue( heading );
+  if ( elevation ) uart_puts_P( "  EL=000" );
+#else
+  uart_puts_P( "+0" );
+  GS232PutValue( heading );
+  if ( elevation ) uart_puts_P( "+0000" );
+#endif // GS232_FORMAT_B
+
+  uart_puts_P( "\r\n" );
+}
+
+// --------------------------------------------------------------------------
+
+// execute the command in gLine[], returns FALSE if unknown or invalid
+static uint8_t GS232Execute(void) {
+
+  switch ( gLine[0] ) {
+
+    case 'C':
+         if ( gLength != 1 && (gLength != 2 || gLine[1] != '2') ) return FALSE;
+
+         // no heading yet after a reset: no answer, as if lost, rather
+         // than a made-up 0
+         if ( IsHeadingValid() ) GS232Position( gLength == 2 );
+         break;
+
+    case 'M': {
+         if ( gLength != 4 ) return FALSE;
+
+         uint16_t heading = 0;
+
+         for ( uint8_t i=1; i<4; ++i ) {
+           if ( gLine[i] < '0' || gLine[i] > '9' ) return FALSE;
+           heading = 10 * heading + gLine[i] - '0';
+         }
+
+         // 360 ... 450 is the overlap range of the Yaesu rotators
+         if ( heading > 450 ) return FALSE;
+         if ( heading > MAX_ANGLE ) heading -= 360;
+
+         TrackClear();
+         SetPresetHeading( heading );
+         }
+         break;
+
+    case 'T': {
+         if ( gLength < 2 || gLength > 3 ) return FALSE;
+
+         uint8_t keepalive = 0;
+
+         for ( uint8_t i=1; i<gLength; ++i ) {
+           if ( gLine[i] < '0' || gLine[i] > '9' ) return FALSE;
+           keepalive = 10 * keepalive + gLine[i] - '0';
+         }
+
+         if ( keepalive > GS232_KEEPALIVE_MAX ) return FALSE;
+
+         // GS232Telemetry() sends the first frame at once
+         gKeepalive = keepalive;
+         gFrameHeading = -1;
+         }
+         break;
+
+    case 'Y': {
+         if ( gLength != 2 && gLength != 5 ) return FALSE;
+
+         uint8_t index = gLine[1] - '0';
+
+         if ( index >= kNRelayDelays ) return FALSE;
+
+         if ( gLength == 2 ) {
+           char s[4] = { 'Y', gLine[1], '=', '\0' };
+
+           uart_puts( s );
+           GS232PutValue( GetRelayDelay( index ) );
+           uart_puts_P( "\r\n" );
+           break;
+         }
+
+         uint16_t value = 0;
+
+         for ( uint8_t i=2; i<5; ++i ) {
+           if ( gLine[i] < '0' || gLine[i] > '9' ) return FALSE;
+           value = 10 * value + gLine[i] - '0';
+         }
+
+         if ( value > 255 ) return FALSE;
+
+         SetRelayDelay( index, value );
+         }
+         break;
+
+    case 'K': {
+         if ( gLength == 1 ) {
+           uart_puts_P( "K=" );
+           GS232PutDigits( TrackGetTime(), 5 );
+           uart_puts_P( "\r\n" );
+           break;
+         }
+
+         uint32_t sec;
+
+         if ( gLength != 6 || !GS232GetDigits( 1, 5, &sec ) ) return FALSE;
+         if ( sec > 0xffff ) return FALSE;
+
+         TrackSetTime( sec );
+         }
+         break;
+
+    case 'Q': {
+         if ( gLength == 1 ) {
+           uart_puts_P( "Q=" );
+           GS232PutDigits( TrackFree(), 2 );
+           uart_puts_P( "\r\n" );
+           break;
+         }
+
+         uint32_t sec, azimuth;
+
+         if (    gLength != 9 || !GS232GetDigits( 1, 5, &sec )
+              || !GS232GetDigits( 6, 3, &azimuth ) ) return FALSE;
+
+         if ( sec > 0xffff || azimuth > 450 ) return FALSE;
+         if ( azimuth > MAX_ANGLE ) azimuth -= 360;
+
+         // full or not later than the last point
+         if ( TrackAdd( sec, azimuth ) ) return FALSE;
+         }
+         break;
+
+    case 'R':
+    case 'L':
+    case 'A':
+    case 'S':
+         if ( gLength != 1 ) return FALSE;
+
+         TrackClear();
+         SetRemoteCommand( gLine[0] == 'R' ? kTurnCW
+                           : gLine[0] == 'L' ? kTurnCCW : kStop );
+         break;
+
+    default:
+         return FALSE;
+  }
+
+  return TRUE;
+}
+
+// --------------------------------------------------------------------------
+
+// called by main()
+void GS232Receive(unsigned int uart_data) {
+
+  char c = uart_data & 0xff;
+
+  if ( gLength == 0 ) gDropped = CompassMessageDropped();
+
+  // receive error or collision with a sentence of the sensor, drop the line
+  if (    (uart_data >> 8) || CompassMessageBusy()
+       || CompassMessageDropped() != gDropped ) gValid = FALSE;
+
+  if ( c == '\r' || c == '\n' ) {
+
+    if ( gValid && gLength && !GS232Execute() )
+      uart_puts_P( "?>\r\n" );
+
+    GS232Init();
+    return;
+  }
+
+  if ( c == ' ' ) return;
+
+  if ( c >= 'a' && c <= 'z' ) c -= 'a' - 'A';
+
+  if ( gLength < GS232_LINE_MAX
+       && ((c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')) )
+    gLine[gLength++] = c;
+  else
+    gValid = FALSE;
+}
+
+// --------------------------------------------------------------------------
+
+// state of the rotator as one character
+static char GS232State(void) {
+
+  switch ( gRotatorState ) {
+
+    case kTurningCW:  return 'R';
+    case kTurningCCW: return 'L';
+    case kIdle:
+    case kHoldPower:  return 'S';
+    default:          return 'B';
+  }
+}
+
+// --------------------------------------------------------------------------
+
+static char GS232Hex(uint8_t nibble) {
+
+  return nibble < 10 ? '0' + nibble : 'A' + nibble - 10;
+}
+
+// --------------------------------------------------------------------------
+
+// called by main()
+void GS232Telemetry(void) {
+
+  if ( !gKeepalive || !IsHeadingValid() ) return;
+
+  int16_t heading = GetCurrentHeading();
+  char state = GS232State();
+
+  cli();
+   uint16_t ticks = gTicks;
+  sei();
+
+  if ( heading == gFrameHeading && state == gFrameState
+       && ticks < 100 * gKeepalive ) return;
+
+  // "$RCHDG,hhh,s*cs\r\n"
+  char s[18] = "$RCHDG,";
+
+  s[7]  = '0' + heading / 100;
+  s[8]  = '0' + heading / 10 % 10;
+  s[9]  = '0' + heading % 10;
+  s[10] = ',';
+  s[11] = state;
+
+  uint8_t checksum = 0;
+
+  for ( uint8_t i=1; i<12; ++i ) checksum ^= s[i];
+
+  s[12] = '*';
+  s[13] = GS232Hex( checksum >> 4 );
+  s[14] = GS232Hex( checksum & 0x0f );
+  s[15] = '\r';
+  s[16] = '\n';
+  s[17] = '\0';
+
+  uart_puts( s );
+
+  gFrameHeading = heading;
+  gFrameState = state;
+
+  cli();
+   gTicks = 0;
+  sei();
+}
+
+// --------------------------------------------------------------------------
+
+// called from ISR(TIMER0_OVF_vect)
+void GS232Timer(void) {
+
+  if ( gTicks < 0xffff ) gTicks++;
+}
+
+// --------------------------------------------------------------------------
+// --------------------------------------------------------------------------
@@ -0,0 +1,82 @@
+/*
+ * File   : gs232.h
+ *
+ * Copyright:      Hermann-Josef Mathes  mailto: dc2ip@darc.de
+ * Author:         Hermann-Josef Mathes
+ * Remarks:
+ * Known problems: development status
+ * Version:        Version v1r0
+ * Description:    Declarations for the GS-232 command server.
+ *
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+   If not, write to the Free Software Foundation,
+   Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+
+ *
+ */
+
+
+/** @file gs232.h
+  * Declarations for the server of the Yaesu GS-232A/B rotator commands
+  * (Docu/GS232A.pdf, Docu/Yaesu_GS-232B_Manual.pdf), azimuth only.
+  * @author H.-J.Mathes <dc2ip@darc.de>
+  */
+
+#ifndef _gs232_h_
+#define _gs232_h_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Reply to 'C' and 'C2' as the GS-232B ("AZ=nnn") instead of the
+  * GS-232A ("+0nnn").
+  */
+//#define GS232_FORMAT_B
+
+/** Maximum length of a command line, without CR. */
+#define GS232_LINE_MAX          10
+
+/** Longest keepalive interval of the unsolicited heading frames ('Tnn'),
+  * in seconds.
+  */
+#define GS232_KEEPALIVE_MAX     99
+
+/** Reset the command parser. */
+extern void GS232Init(void);
+
+/** Feed one value returned by uart_getc(), a complete command line (ended
+  * by CR or LF) is executed at once and answered from the cached heading.
+  * Lines with characters which are no part of a command (e.g. '$', ',',
+  * '*' of the sensor sentences on the same line) are ignored.
+  */
+extern void GS232Receive(unsigned int uart_data);
+
+/** To be called by main(): after the command 'Tnn' a frame
+  * "$RCHDG,hhh,s*cs" is sent whenever the heading or the state of the
+  * rotator changes and at least every nn seconds.
+  */
+extern void GS232Telemetry(void);
+
+/** To be called every 10 ms from the timer interrupt (keepalive timer). */
+extern void GS232Timer(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _gs232_h_ */
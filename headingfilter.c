@@ -0,0 +1,229 @@
+/*
+ * File   : headingfilter.c
+ *
+ * Copyright:      Hermann-Josef Mathes  mailto: dc2ip@darc.de
+ * Author:         Hermann-Josef Mathes
+ * Remarks:
+ * Known problems: development status
+ * Version:        Version v1r0
+ * Description:    Moving (circular) average of heading values.
+ *
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+   If not, write to the Free Software Foundation,
+   Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+
+ *
+ */
+
+#include <stdint.h>
+
+/** @file headingfilter.c
+  * Moving (circular) average of heading values.
+  *
+  * Each heading is taken as unit vector (sin, cos), the ring buffer keeps
+  * the last values and the sums of their vectors are updated by adding the
+  * new and subtracting the oldest value. The direction of the sum is the
+  * average, independent of the 359/0 degree transition and of the spread
+  * of the values. The cost of an update does not depend on the window size.
+  *
+  * The average of N values lags (N-1)/2 samples behind a turning rotator.
+  * The tracker instead predicts the heading with its rate and corrects it
+  * with each value (alpha-beta filter), it knows from the relays whether
+  * and in which direction the motor turns: a rate against the direction
+  * of the motor is dropped, with locked brake the rate decays at once.
+  *
+  * This file is also compiled on the host (Linux/compass1.cc).
+  *
+  * @author H.-J. Mathes <dc2ip@darc.de>
+  */
+
+#ifdef __AVR__
+# include <avr/pgmspace.h>
+#else
+# define PROGMEM
+# define pgm_read_word(addr)   (*(addr))
+#endif // __AVR__
+
+#include "fixheading.h"      // FixAtan2()
+#include "headingfilter.h"
+
+// --------------------------------------------------------------------------
+
+/** sin() for 0 ... 90 degrees, Q14. */
+static const int16_t cSinTable[91] PROGMEM = {
+      0,   286,   572,   857,  1143,  1428,  1713,  1997,  2280,  2563,
+   2845,  3126,  3406,  3686,  3964,  4240,  4516,  4790,  5063,  5334,
+   5604,  5872,  6138,  6402,  6664,  6924,  7182,  7438,  7692,  7943,
+   8192,  8438,  8682,  8923,  9162,  9397,  9630,  9860, 10087, 10311,
+  10531, 10749, 10963, 11174, 11381, 11585, 11786, 11982, 12176, 12365,
+  12551, 12733, 12911, 13085, 13255, 13421, 13583, 13741, 13894, 14044,
+  14189, 14330, 14466, 14598, 14726, 14849, 14968, 15082, 15191, 15296,
+  15396, 15491, 15582, 15668, 15749, 15826, 15897, 15964, 16026, 16083,
+  16135, 16182, 16225, 16262, 16294, 16322, 16344, 16362, 16374, 16382,
+  16384,
+};
+
+int16_t HeadingSin(uint16_t heading) {
+
+  if ( heading <= 90 )
+    return pgm_read_word( &cSinTable[heading] );
+  else if ( heading <= 180 )
+    return pgm_read_word( &cSinTable[180 - heading] );
+  else if ( heading <= 270 )
+    return -(int16_t)pgm_read_word( &cSinTable[heading - 180] );
+  else
+    return -(int16_t)pgm_read_word( &cSinTable[360 - heading] );
+}
+
+// --------------------------------------------------------------------------
+
+int16_t HeadingCos(uint16_t heading) {
+
+  heading += 90;
+  if ( heading >= 360 ) heading -= 360;
+
+  return HeadingSin( heading );
+}
+
+// --------------------------------------------------------------------------
+
+void HeadingFilterInit(heading_filter_t *filter,uint8_t window) {
+
+  if ( window < 1 ) window = 1;
+  if ( window > HEADING_FILTER_MAX ) window = HEADING_FILTER_MAX;
+
+  filter->fWindow = window;
+  filter->fCount = 0;
+  filter->fNext = 0;
+  filter->fSumSin = 0;
+  filter->fSumCos = 0;
+}
+
+// --------------------------------------------------------------------------
+
+int HeadingFilterAdd(heading_filter_t *filter,int heading) {
+
+  // normalize input value
+  while ( heading >= 360 ) heading -= 360;
+  while ( heading < 0 ) heading += 360;
+
+  if ( filter->fCount == filter->fWindow ) {     // remove oldest value
+
+    uint16_t old = filter->fHeading[filter->fNext];
+
+    filter->fSumSin -= HeadingSin( old );
+    filter->fSumCos -= HeadingCos( old );
+  }
+  else
+    filter->fCount++;
+
+  filter->fHeading[filter->fNext] = heading;
+
+  filter->fSumSin += HeadingSin( heading );
+  filter->fSumCos += HeadingCos( heading );
+
+  if ( ++filter->fNext == filter->fWindow ) filter->fNext = 0;
+
+  // direction of the sum vector, rounded to degrees
+  int32_t angle = FixAtan2( filter->fSumSin, filter->fSumCos );
+
+  int average = (int)((angle + 128) >> 8);
+  if ( average < 0 )
+    average += 360;
+  if ( average >= 360 )
+    average -= 360;
+
+  return average;
+}
+
+// --------------------------------------------------------------------------
+
+#define HEADING_TRACKER_FULL   (360L * 256)
+
+void HeadingTrackerInit(heading_tracker_t *tracker) {
+
+  tracker->fAngle = 0;
+  tracker->fRate = 0;
+  tracker->fValid = 0;
+}
+
+// --------------------------------------------------------------------------
+
+int HeadingTrackerAdd(heading_tracker_t *tracker,int heading,uint8_t motion) {
+
+  // normalize input value
+  while ( heading >= 360 ) heading -= 360;
+  while ( heading < 0 ) heading += 360;
+
+  int32_t measured = (int32_t)heading << 8;
+
+  if ( !tracker->fValid ) {
+    tracker->fAngle = measured;
+    tracker->fRate = 0;
+    tracker->fValid = 1;
+    return heading;
+  }
+
+  // prediction, the rate as the relays allow
+  int16_t rate = tracker->fRate;
+  int16_t alpha = HEADING_TRACKER_ALPHA, beta = HEADING_TRACKER_BETA;
+
+  switch ( motion ) {
+
+    case kHeadingStopped:
+         rate /= 2;
+         alpha = HEADING_TRACKER_ALPHA_STOPPED;
+         beta = 0;
+         break;
+
+    case kHeadingCW:
+         if ( rate < 0 ) rate = 0;
+         break;
+
+    case kHeadingCCW:
+         if ( rate > 0 ) rate = 0;
+         break;
+  }
+
+  int32_t angle = tracker->fAngle + rate;
+
+  // correction by the measured value, across 359/0 the short way
+  int32_t residual = measured - angle;
+
+  if ( residual >= HEADING_TRACKER_FULL / 2 ) residual -= HEADING_TRACKER_FULL;
+  if ( residual < -HEADING_TRACKER_FULL / 2 ) residual += HEADING_TRACKER_FULL;
+
+  angle += (alpha * residual) >> 8;
+
+  int32_t new_rate = rate + ((beta * residual) >> 8);
+
+  if ( new_rate > HEADING_TRACKER_RATE_MAX * 256 )
+    new_rate = HEADING_TRACKER_RATE_MAX * 256;
+  if ( new_rate < -HEADING_TRACKER_RATE_MAX * 256 )
+    new_rate = -HEADING_TRACKER_RATE_MAX * 256;
+
+  if ( angle < 0 ) angle += HEADING_TRACKER_FULL;
+  if ( angle >= HEADING_TRACKER_FULL ) angle -= HEADING_TRACKER_FULL;
+
+  tracker->fAngle = angle;
+  tracker->fRate = new_rate;
+
+  int estimate = (int)((angle + 128) >> 8);
+
+  return estimate >= 360 ? estimate - 360 : estimate;
+}
+
+// --------------------------------------------------------------------------
+// --------------------------------------------------------------------------
@@ -0,0 +1,129 @@
+/*
+ * File   : headingfilter.h
+ *
+ * Copyright:      Hermann-Josef Mathes  mailto: dc2ip@darc.de
+ * Author:         Hermann-Josef Mathes
+ * Remarks:
+ * Known problems: development status
+ * Version:        Version v1r0
+ * Description:    Declarations for the moving (circular) average of
+ *                 heading values.
+ *
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+   If not, write to the Free Software Foundation,
+   Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+
+ *
+ */
+
+
+/** @file headingfilter.h
+  * Declarations for the moving (circular) average of heading values and
+  * for the heading tracker.
+  * @author H.-J.Mathes <dc2ip@darc.de>
+  */
+
+#ifndef _headingfilter_h_
+#define _headingfilter_h_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Maximum number of heading values which can be averaged. */
+#define HEADING_FILTER_MAX      32
+
+/** Default number of heading values which are averaged. */
+#define HEADING_FILTER_DEFAULT  5
+
+/** Ring buffer of the last heading values and running sums of their
+  * unit vectors (sin, cos in Q14).
+  */
+typedef struct _heading_filter {
+
+  uint16_t  fHeading[HEADING_FILTER_MAX];
+  int32_t   fSumSin;
+  int32_t   fSumCos;
+  uint8_t   fWindow;     // number of values to average
+  uint8_t   fCount;      // number of values in buffer
+  uint8_t   fNext;       // next slot to write
+
+} heading_filter_t;
+
+/** sin() of a heading in degrees (0 ... 359), Q14 (1.0 = 16384). */
+extern int16_t HeadingSin(uint16_t heading);
+/** cos() of a heading in degrees (0 ... 359), Q14 (1.0 = 16384). */
+extern int16_t HeadingCos(uint16_t heading);
+
+/** Clear the filter and set the number of values to average
+  * (1 ... HEADING_FILTER_MAX).
+  */
+extern void HeadingFilterInit(heading_filter_t *filter,uint8_t window);
+
+/** Add a heading value (degrees, any range) and return the circular mean
+  * of the last 'window' values (0 ... 359).
+  */
+extern int HeadingFilterAdd(heading_filter_t *filter,int heading);
+
+/** Motion of the rotator as known from the relays, input of the tracker. */
+typedef enum {
+
+  kHeadingStopped = 0,  // brake locked
+  kHeadingCW,           // motor on, heading increases
+  kHeadingCCW,          // motor on, heading decreases
+  kHeadingFree,         // brake released, motor off (ramp, run-out)
+
+} EHeadingMotion;
+
+/** Gains of the tracker while the motor is on or the rotator runs out,
+  * Q8 (256 = 1.0), beta = alpha^2 / (2 - alpha).
+  */
+#define HEADING_TRACKER_ALPHA           77
+#define HEADING_TRACKER_BETA            13
+
+/** Gain of the tracker with locked brake, Q8. */
+#define HEADING_TRACKER_ALPHA_STOPPED   64
+
+/** Largest rate [deg/sample] of the tracker. */
+#define HEADING_TRACKER_RATE_MAX        10
+
+/** Heading and rate of the alpha-beta tracker (steady state Kalman filter
+  * of a constant rate), in 1/256 degrees.
+  */
+typedef struct _heading_tracker {
+
+  int32_t   fAngle;      // 0 ... 360*256-1
+  int16_t   fRate;       // per sample
+  uint8_t   fValid;
+
+} heading_tracker_t;
+
+/** Clear the tracker, the next heading is taken as it is. */
+extern void HeadingTrackerInit(heading_tracker_t *tracker);
+
+/** Add a heading value (degrees, any range) measured with the rotator in
+  * the state 'motion' (EHeadingMotion) and return the estimated heading
+  * (0 ... 359).
+  */
+extern int HeadingTrackerAdd(heading_tracker_t *tracker,int heading,
+                             uint8_t motion);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _headingfilter_h_ */
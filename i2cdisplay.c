@@ -33,214 +33,207 @@
 
 /** @file i2cdisplay.c
   * Functions for the I2C driven display unit (UR).
+  *
+  * All functions only queue the transaction (i2cqueue.c) and return
+  * immediately, 1 is returned if the queue is full.
+  *
+  * A shadow copy of the values shown by the display is kept, writes of
+  * values already shown are not sent to the bus. Raw data and timed
+  * contents (I2C_DISP_DATA_TIMED) are not tracked, i.e. the next value
+  * is always sent.
+  *
   * @author H.-J. Mathes <dc2ip@darc.de>
   */
 
 #include <avr/io.h>
 #include <avr/pgmspace.h>
-#include <util/delay.h>
 
-#include <i2cmaster.h>   // P.Fleury's lib
+#include "i2cqueue.h"
 
 #include "i2cdisplay.h"
 
+/** Marks a group of digits with unknown contents in the shadow copy. */
+#define SHADOW_UNKNOWN   (-1)
+
+static int16_t gShadowLeft = SHADOW_UNKNOWN;
+static int16_t gShadowRight = SHADOW_UNKNOWN;
+
+static uint16_t gShadowErrors = 0;
+
 // --------------------------------------------------------------------------
 
 void I2CDisplayInit(void) {
 
+  I2CQueueInit();
+
+  gShadowLeft = gShadowRight = SHADOW_UNKNOWN;
+  gShadowErrors = 0;
 }
 
 // --------------------------------------------------------------------------
 
-void I2CDisplayBlank(void) {
+// queue remote buffer address, command and 'n' data bytes
+static uint8_t I2CDisplayCommand(uint8_t cmd,uint8_t n,const uint8_t *data) {
+
+  uint8_t msg[I2C_QUEUE_DATA_SIZE];
 
-  uint8_t ret = i2c_start( I2C_DISPLAY | I2C_WRITE);
+  if ( n > I2C_QUEUE_DATA_SIZE - 2 ) return 1;
 
-  if ( ret ) {
-    i2c_stop();
-    return;
+  // a transaction got lost, the shadow copy cannot be trusted
+  uint16_t errors = I2CQueueErrors();
+
+  if ( errors != gShadowErrors ) {
+    gShadowErrors = errors;
+    gShadowLeft = gShadowRight = SHADOW_UNKNOWN;
   }
 
-  i2c_write(0x00); 			// write remote buffer address
-  i2c_write(I2C_DISP_RAWDATA);  	// write command
-  for (uint8_t i=0; i<6; ++i)
-    i2c_write( 0x00 );
-  i2c_stop();
+  msg[0] = 0x00;			// remote buffer address
+  msg[1] = cmd;				// command
+
+  for (uint8_t i=0; i<n; ++i)
+    msg[2+i] = data[i];
+
+  return I2CQueueWrite( I2C_DISPLAY, n + 2, msg );
 }
 
 // --------------------------------------------------------------------------
 
-void I2CDisplayOn(void) {
-
-  uint8_t ret = i2c_start( I2C_DISPLAY | I2C_WRITE);
+void I2CDisplayBlank(void) {
 
-  if ( ret ) {
-    i2c_stop();
-    return;
-  }
+  static const uint8_t blank[6] = { 0 };
 
-  i2c_write(0x00); 			// write remote buffer address
-  i2c_write(I2C_DISP_ON);  		// write command
-  i2c_stop();
+  if ( !I2CDisplayCommand( I2C_DISP_RAWDATA, sizeof(blank), blank ) )
+    gShadowLeft = gShadowRight = SHADOW_UNKNOWN;
 }
 
 // --------------------------------------------------------------------------
 
-void I2CDisplayOff(void) {
+void I2CDisplayOn(void) {
 
-  uint8_t ret = i2c_start( I2C_DISPLAY | I2C_WRITE);
+  I2CDisplayCommand( I2C_DISP_ON, 0, NULL );
+}
 
-  if ( ret ) {
-    i2c_stop();
-    return;
-  }
+// --------------------------------------------------------------------------
+
+void I2CDisplayOff(void) {
 
-  i2c_write(0x00); 			// write remote buffer address
-  i2c_write(I2C_DISP_OFF);  		// write command
-  i2c_stop();
+  I2CDisplayCommand( I2C_DISP_OFF, 0, NULL );
 }
 
 // --------------------------------------------------------------------------
 
 uint8_t I2CDisplayWrite_p(uint8_t l_msg,const uint8_t *p_msg) {
 
-  uint8_t ret = i2c_start( I2C_DISPLAY | I2C_WRITE);
+  uint8_t msg[6];
 
-  if ( ret ) {
-    i2c_stop();
-    return 1;
-  }
-
-  i2c_write(0x00); 			// write remote buffer address
-  i2c_write(I2C_DISP_RAWDATA);  	// write command
-
-  for (uint8_t i=0; i<l_msg; ++i) {
-    i2c_write( pgm_read_byte( &p_msg[i] ) );
-  }
+  if ( l_msg > sizeof(msg) ) return 1;
 
-  i2c_stop();
+  for (uint8_t i=0; i<l_msg; ++i)
+    msg[i] = pgm_read_byte( &p_msg[i] );
 
-  return 0;
+  return I2CDisplayWrite( l_msg, msg );
 }
 
 // --------------------------------------------------------------------------
 
 uint8_t I2CDisplayWrite(uint8_t l_msg,const uint8_t *p_msg) {
 
-  uint8_t ret = i2c_start( I2C_DISPLAY | I2C_WRITE);
+  uint8_t ret = I2CDisplayCommand( I2C_DISP_RAWDATA, l_msg, p_msg );
 
-  if ( ret ) {
-    i2c_stop();
-    return 1;
-  }
-
-  i2c_write(0x00); 			// write remote buffer address
-  i2c_write(I2C_DISP_RAWDATA);  	// write command
-
-  for (uint8_t i=0; i<l_msg; ++i) {
-    i2c_write( p_msg[i] );
-  }
+  if ( !ret ) gShadowLeft = gShadowRight = SHADOW_UNKNOWN;
 
-  i2c_stop();
-
-  return 0;
+  return ret;
 }
 
 // --------------------------------------------------------------------------
 
 uint8_t I2CDisplayWriteL(uint8_t l_msg,const uint8_t *p_msg) {
 
-  uint8_t ret = i2c_start( I2C_DISPLAY | I2C_WRITE);
+  uint8_t ret = I2CDisplayCommand( I2C_DISP_RAWDATA_LEFT, l_msg, p_msg );
 
-  if ( ret ) {
-    i2c_stop();
-    return 1;
-  }
+  if ( !ret ) gShadowLeft = SHADOW_UNKNOWN;
 
-  i2c_write(0x00); 			// write remote buffer address
-  i2c_write(I2C_DISP_RAWDATA_LEFT);  	// write command
-
-  for (uint8_t i=0; i<l_msg; ++i) {
-    i2c_write( p_msg[i] );
-  }
-
-  i2c_stop();
-
-  return 0;
+  return ret;
 }
 
 // --------------------------------------------------------------------------
 
 uint8_t I2CDisplayWriteR(uint8_t l_msg,const uint8_t *p_msg) {
 
-  uint8_t ret = i2c_start( I2C_DISPLAY | I2C_WRITE);
-
-  if ( ret ) {
-    i2c_stop();
-    return 1;
-  }
+  uint8_t ret = I2CDisplayCommand( I2C_DISP_RAWDATA_RIGHT, l_msg, p_msg );
 
-  i2c_write(0x00); 			// write remote buffer address
-  i2c_write(I2C_DISP_RAWDATA_RIGHT);  	// write command
+  if ( !ret ) gShadowRight = SHADOW_UNKNOWN;
 
-  for (uint8_t i=0; i<l_msg; ++i) {
-    i2c_write( p_msg[i] );
-  }
-
-  i2c_stop();
-
-  return 0;
+  return ret;
 }
 
 // --------------------------------------------------------------------------
 
 uint8_t I2CDisplayWriteLData(int16_t data) {
 
-  if ( i2c_start( I2C_DISPLAY | I2C_WRITE) ) {
-    i2c_stop();
-    return 1;
-  }
+  if ( data == gShadowLeft ) return 0;
 
-  i2c_write(0x00); 			// write remote buffer address
-  i2c_write(I2C_DISP_DATA_LEFT);  	// write command
-  i2c_write(data & 0xff);		// write data bytes to remote buffer
-  i2c_write((data & 0xff00) >> 8);
-  i2c_stop();
+  uint8_t msg[2] = { data & 0xff, (data & 0xff00) >> 8 };
 
-  return 0;
+  uint8_t ret = I2CDisplayCommand( I2C_DISP_DATA_LEFT, sizeof(msg), msg );
+
+  if ( !ret ) gShadowLeft = data;
+
+  return ret;
 }
 
 // --------------------------------------------------------------------------
 
 uint8_t I2CDisplayWriteRData(int16_t data) {
 
-  if ( i2c_start( I2C_DISPLAY | I2C_WRITE) ) {
-    i2c_stop();
-    return 1;
-  }
+  if ( data == gShadowRight ) return 0;
+
+  uint8_t msg[2] = { data & 0xff, (data & 0xff00) >> 8 };
 
-  i2c_write(0x00); 			// write remote buffer address
-  i2c_write(I2C_DISP_DATA_RIGHT);  	// write command
-  i2c_write(data & 0xff);		// write data bytes to remote buffer
-  i2c_write((data & 0xff00) >> 8);
-  i2c_stop();
+  uint8_t ret = I2CDisplayCommand( I2C_DISP_DATA_RIGHT, sizeof(msg), msg );
 
-  return 0;
+  if ( !ret ) gShadowRight = data;
+
+  return ret;
 }
 
 // --------------------------------------------------------------------------
 
 uint8_t I2CDisplayWriteData(int16_t l_data,int16_t r_data) {
 
-  uint8_t ret;
+  if ( l_data == gShadowLeft && r_data == gShadowRight ) return 0;
 
-  if ( (ret = I2CDisplayWriteLData( l_data )) ) {
-    i2c_init();
+  if ( r_data == gShadowRight ) return I2CDisplayWriteLData( l_data );
+  if ( l_data == gShadowLeft ) return I2CDisplayWriteRData( r_data );
+
+  uint8_t msg[4] = { l_data & 0xff, (l_data & 0xff00) >> 8,
+                     r_data & 0xff, (r_data & 0xff00) >> 8 };
+
+  uint8_t ret = I2CDisplayCommand( I2C_DISP_DATA, sizeof(msg), msg );
+
+  if ( !ret ) {
+    gShadowLeft = l_data;
+    gShadowRight = r_data;
   }
 
-  _delay_ms(1.0);
+  return ret;
+}
+
+// --------------------------------------------------------------------------
+
+uint8_t I2CDisplayWriteDataTimed(int16_t l_data,int16_t r_data,
+                                 uint16_t timeout_ms) {
 
-  ret = I2CDisplayWriteRData( r_data );
+  uint8_t msg[6] = { l_data & 0xff, (l_data & 0xff00) >> 8,
+                     r_data & 0xff, (r_data & 0xff00) >> 8,
+                     timeout_ms & 0xff, (timeout_ms & 0xff00) >> 8 };
+
+  uint8_t ret = I2CDisplayCommand( I2C_DISP_DATA_TIMED, sizeof(msg), msg );
+
+  if ( !ret ) {
+    gShadowLeft = l_data;
+    gShadowRight = timeout_ms == I2C_DISP_NO_TIMEOUT ? r_data : SHADOW_UNKNOWN;
+  }
 
   return ret;
 }
@@ -45,6 +45,11 @@
 
 #include <DisplayUR/i2cdisplaydefs.h>
 
+/** Initialize the I2C bus (i2cqueue.c), all functions below queue their
+  * transaction and return immediately.
+  */
+extern void I2CDisplayInit(void);
+
 /** Empty the display buffer of the I2C display */
 extern void I2CDisplayBlank(void);
 
@@ -66,7 +71,13 @@ extern uint8_t I2CDisplayWriteR(uint8_t l_msg,const uint8_t *p_msg);
 extern uint8_t I2CDisplayWriteLData(int16_t data);
 /** Write data to right group of digits of the I2C display. */
 extern uint8_t I2CDisplayWriteRData(int16_t data);
-/** Write data to the I2C display (both groups). */
+/** Write data to the I2C display (both groups, one transaction). */
 extern uint8_t I2CDisplayWriteData(int16_t l_data,int16_t r_data);
+/** Write data to the I2C display, the display itself replaces the right
+  * group by "---" after 'timeout_ms' (0: at once, I2C_DISP_NO_TIMEOUT:
+  * never).
+  */
+extern uint8_t I2CDisplayWriteDataTimed(int16_t l_data,int16_t r_data,
+                                        uint16_t timeout_ms);
 
 #endif /* _i2cdisplay_h_ */
@@ -0,0 +1,266 @@
+/*
+ * File   : i2cqueue.c
+ *
+ * Copyright:      Hermann-Josef Mathes  mailto: dc2ip@darc.de
+ * Author:         Hermann-Josef Mathes
+ * Remarks:
+ * Known problems: development status
+ * Version:        Version v1r0
+ * Description:    Interrupt driven I2C (TWI) master with a queue of write
+ *                 transactions.
+ *
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+   If not, write to the Free Software Foundation,
+   Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+
+ *
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+/** @file i2cqueue.c
+  * Interrupt driven I2C (TWI) master with a queue of write transactions.
+  *
+  * I2CQueueWrite() copies a transaction into a small ring buffer and
+  * returns at once, the TWI interrupt sends one byte after the other and
+  * continues with the next transaction (STOP followed by START). The main
+  * loop is thus never blocked by the display.
+  *
+  * A transaction which is not acknowledged or ends with a bus error is
+  * dropped, the queue is restarted by the next write or by I2CQueueTimer().
+  * If the bus hangs (no TWI interrupt for I2C_QUEUE_TIMEOUT ticks), the TWI
+  * is switched off, which releases SCL and SDA. The same is done if the
+  * STOP before a new START does not complete (SCL held low by a slave), it
+  * is never waited for in a loop.
+  *
+  * @author H.-J. Mathes <dc2ip@darc.de>
+  */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/twi.h>
+
+#include "global.h"
+
+#include "i2cqueue.h"
+
+/* local data types and variables */
+
+/** One write transaction. */
+typedef struct _i2c_transaction {
+
+  uint8_t  fAddress;
+  uint8_t  fLength;
+  uint8_t  fData[I2C_QUEUE_DATA_SIZE];
+
+} i2c_transaction_t;
+
+static i2c_transaction_t gQueue[I2C_QUEUE_SIZE];
+
+static uint8_t gQueueHead = 0;           // next free entry
+static uint8_t gQueueTail = 0;           // oldest entry, the one on the bus
+static volatile uint8_t gQueueCount = 0;
+
+static volatile uint8_t gBusy = FALSE;   // oldest entry is on the bus
+static uint8_t gDataPos;                 // next byte of the oldest entry
+
+static volatile uint8_t  gTicks = 0;     // I2CQueueTimer() calls w/o progress
+static volatile uint16_t gErrors = 0;
+
+#define TWCR_START  ((1<<TWINT) | (1<<TWSTA) | (1<<TWEN) | (1<<TWIE))
+#define TWCR_SEND   ((1<<TWINT) | (1<<TWEN) | (1<<TWIE))
+#define TWCR_STOP   ((1<<TWINT) | (1<<TWSTO) | (1<<TWEN) | (1<<TWIE))
+
+// --------------------------------------------------------------------------
+
+void I2CQueueInit(void) {
+
+  TWCR = 0;
+
+  TWSR = 0;                            // no prescaler
+  TWBR = ((F_CPU / I2C_QUEUE_SCL_CLOCK) - 16) / 2;
+
+  gQueueHead = gQueueTail = gQueueCount = 0;
+  gBusy = FALSE;
+
+  TWCR = (1<<TWEN);
+}
+
+// --------------------------------------------------------------------------
+
+// interrupts must be disabled (or called from an ISR); while the previous
+// STOP is still on the bus nothing is started, I2CQueueTimer() tries again
+static void I2CQueueStart(void) {
+
+  if ( TWCR & (1<<TWSTO) ) return;
+
+  gBusy = TRUE;
+  gTicks = 0;
+
+  TWCR = TWCR_START;
+}
+
+// --------------------------------------------------------------------------
+
+// remove the oldest entry from the queue
+static void I2CQueueRemove(uint8_t ok) {
+
+  gQueueTail = (gQueueTail + 1) % I2C_QUEUE_SIZE;
+  gQueueCount--;
+
+  if ( !ok ) gErrors++;
+
+  gTicks = 0;
+}
+
+// --------------------------------------------------------------------------
+
+// end of a transaction on the bus, continue with the next one if 'ok'
+static void I2CQueueDone(uint8_t ok) {
+
+  I2CQueueRemove( ok );
+
+  gBusy = ok && gQueueCount;
+
+  TWCR = gBusy ? TWCR_STOP | (1<<TWSTA) : TWCR_STOP;
+}
+
+// --------------------------------------------------------------------------
+
+ISR(TWI_vect) {
+
+  i2c_transaction_t *t = &gQueue[gQueueTail];
+
+  gTicks = 0;
+
+  switch ( TW_STATUS ) {
+
+    case TW_START:
+    case TW_REP_START:
+         gDataPos = 0;
+         TWDR = t->fAddress | TW_WRITE;
+         TWCR = TWCR_SEND;
+         break;
+
+    case TW_MT_SLA_ACK:
+    case TW_MT_DATA_ACK:
+         if ( gDataPos < t->fLength ) {
+           TWDR = t->fData[gDataPos++];
+           TWCR = TWCR_SEND;
+         }
+         else
+           I2CQueueDone( TRUE );
+         break;
+
+    default:  // no ACK, arbitration lost, bus error: drop the transaction
+         I2CQueueDone( FALSE );
+         break;
+  }
+}
+
+// --------------------------------------------------------------------------
+
+uint8_t I2CQueueWrite(uint8_t addr,uint8_t n,const uint8_t *data) {
+
+  if ( n > I2C_QUEUE_DATA_SIZE ) return 1;
+
+  i2c_transaction_t *t = NULL;
+
+  cli();
+
+  uint8_t last = (gQueueHead + I2C_QUEUE_SIZE - 1) % I2C_QUEUE_SIZE;
+
+  // replace the newest entry if it has not yet started, e.g. a heading
+  // which is already outdated
+  if ( gQueueCount > (gBusy ? 1 : 0) && n >= 2
+       && gQueue[last].fAddress == addr && gQueue[last].fLength >= 2
+       && gQueue[last].fData[0] == data[0] && gQueue[last].fData[1] == data[1] ) {
+
+    t = &gQueue[last];
+  }
+  else if ( gQueueCount < I2C_QUEUE_SIZE ) {
+
+    t = &gQueue[gQueueHead];
+
+    gQueueHead = (gQueueHead + 1) % I2C_QUEUE_SIZE;
+    gQueueCount++;
+  }
+
+  if ( t ) {
+
+    t->fAddress = addr;
+    t->fLength = n;
+    memcpy( t->fData, data, n );
+
+    if ( !gBusy ) I2CQueueStart();
+  }
+
+  sei();
+
+  return t ? 0 : 1;
+}
+
+// --------------------------------------------------------------------------
+
+uint8_t I2CQueueIdle(void) {
+
+  return gQueueCount == 0;
+}
+
+// --------------------------------------------------------------------------
+
+uint16_t I2CQueueErrors(void) {
+
+  cli();
+   uint16_t errors = gErrors;
+  sei();
+
+  return errors;
+}
+
+// --------------------------------------------------------------------------
+
+// called from ISR(TIMER0_OVF_vect)
+void I2CQueueTimer(void) {
+
+  if ( !gBusy ) {
+
+    if ( !gQueueCount ) return;
+
+    // the STOP does not complete, switch the TWI off to release the bus
+    if ( (TWCR & (1<<TWSTO)) && ++gTicks >= I2C_QUEUE_TIMEOUT ) {
+      TWCR = 0;
+      TWCR = (1<<TWEN);
+      gTicks = 0;
+    }
+
+    I2CQueueStart();                       // after an error or a STOP
+    return;
+  }
+
+  if ( ++gTicks < I2C_QUEUE_TIMEOUT ) return;
+
+  // no TWI interrupt for some time, switch the TWI off to release the bus
+  TWCR = 0;
+
+  I2CQueueRemove( FALSE );
+  gBusy = FALSE;
+
+  TWCR = (1<<TWEN);                      // restarted by the next call
+}
+
+// --------------------------------------------------------------------------
+// --------------------------------------------------------------------------
@@ -0,0 +1,88 @@
+/*
+ * File   : i2cqueue.h
+ *
+ * Copyright:      Hermann-Josef Mathes  mailto: dc2ip@darc.de
+ * Author:         Hermann-Josef Mathes
+ * Remarks:
+ * Known problems: development status
+ * Version:        Version v1r0
+ * Description:    Declarations for the interrupt driven I2C (TWI) master
+ *                 with a queue of write transactions.
+ *
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+   If not, write to the Free Software Foundation,
+   Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+
+ *
+ */
+
+
+/** @file i2cqueue.h
+  * Declarations for the interrupt driven I2C (TWI) master with a queue
+  * of write transactions.
+  * @author H.-J.Mathes <dc2ip@darc.de>
+  */
+
+#ifndef _i2cqueue_h_
+#define _i2cqueue_h_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Clock of the I2C bus. */
+#define I2C_QUEUE_SCL_CLOCK     100000L
+
+/** Number of transactions which can be queued. */
+#define I2C_QUEUE_SIZE          6
+
+/** Maximum number of data bytes of one transaction. */
+#define I2C_QUEUE_DATA_SIZE     8
+
+/** A transaction without progress or a STOP which does not complete for
+  * this number of calls of I2CQueueTimer() (10 ms each): the transaction
+  * is aborted or the TWI is reset.
+  */
+#define I2C_QUEUE_TIMEOUT       3
+
+/** Initialize the TWI hardware and empty the queue. */
+extern void I2CQueueInit(void);
+
+/** Queue a write transaction of 'n' bytes to the slave 'addr' (8 bit
+  * address as for I2C_DISPLAY). If the last queued transaction has not yet
+  * started and writes to the same slave with the same first two bytes
+  * (remote buffer address and command), it is replaced.
+  * Returns immediately, 0 if queued and 1 if the queue is full.
+  */
+extern uint8_t I2CQueueWrite(uint8_t addr,uint8_t n,const uint8_t *data);
+
+/** TRUE if no transaction is queued or on the bus. */
+extern uint8_t I2CQueueIdle(void);
+
+/** Number of failed transactions (no ACK, bus error, timeout). */
+extern uint16_t I2CQueueErrors(void);
+
+/** To be called every 10 ms from the timer interrupt: restarts the queue
+  * after an error and resets a stuck bus.
+  */
+extern void I2CQueueTimer(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _i2cqueue_h_ */
@@ -44,14 +44,19 @@
 #include <avr/eeprom.h>
 #include <util/delay.h>
 
-#include <i2cmaster.h>   // P.Fleury's lib
-
 #include "global.h"
 
 #include <uart.h>        // P.Fleury's lib
 
 #include "vector.h"
 #include "i2cdisplay.h"
+#include "i2cqueue.h"
+#include "calibrate.h"
+
+#ifdef GS232_SERVER
+#include "gs232.h"
+#include "track.h"
+#endif // GS232_SERVER
 
 #define UART_BAUD_RATE 9600
 
@@ -85,20 +90,15 @@
 // avrdude -p atmega32 -P usb -c usbasp -y -U flash:w:displaytest.hex
 //
 
-// local prototypes
-
-static void delay_sec(uint8_t);
-
-// --------------------------------------------------------------------------
-
-// configuration storage in EEPROM
-
-uint16_t gLimitAngle EEMEM = LIMIT_ANGLE;
+/** Time [10 ms] the start message is shown, a key or a turn of the rotor
+  * ends it earlier.
+  */
+#define START_MESSAGE_TIME 100
 
-//i_vector_t gEE_MAG_min EEMEM = { -474, -257, -257 };
-//i_vector_t gEE_MAG_max EEMEM = {   36,  238,  238 };
-vector_t gEE_MAG_min EEMEM = { -474, -257, -257 };
-vector_t gEE_MAG_max EEMEM = {   36,  238,  238 };
+/** Counted down by the timer ISR while the start message is shown. */
+static volatile uint8_t gStartMessageTicks = 0;
+static uint8_t gStartMessageShown = FALSE;
+static uint8_t gStartMessagePause = FALSE; // "---" shown, no heading yet
 
 // --------------------------------------------------------------------------
 
@@ -110,6 +110,9 @@ ISR(TIMER0_OVF_vect) {
 
   TCNT0 = CNT0_PRESET;
 
+  // time of the start message
+  if ( gStartMessageTicks ) gStartMessageTicks--;
+
   // call button check routine
   CheckKeys();
 
@@ -122,17 +125,22 @@ ISR(TIMER0_OVF_vect) {
   // execute 'Preset' program
   PresetExec();
 
-  // will switchoff 'Preset' display after some time
-  if ( gPresetDisplayCounter > 0 )
-    gPresetDisplayCounter--;
+  // restart of the display transactions after an I2C error
+  I2CQueueTimer();
+
+#ifdef GS232_SERVER
+  // keepalive of the unsolicited heading frames
+  GS232Timer();
+
+  // clock of the queued track
+  TrackTimer();
+#endif // GS232_SERVER
 }
 
 // --------------------------------------------------------------------------
 
 static void InitHardware(void) {
 
-  delay_sec( 1 );
-
   // timer 0 initialisation
   TCNT0 = CNT0_PRESET;
   TCCR0 = (1<<CS02)|(1<<CS00);  // CK/1024 -> 1 tick each .128 msec
@@ -172,8 +180,8 @@ static void InitHardware(void) {
   // enable interrupts globally
   sei();
 
-  // init I2C interface
-  i2c_init();
+  // init I2C interface, interrupt driven
+  I2CDisplayInit();
 
   I2CDisplayBlank();
   I2CDisplayOn();
@@ -188,35 +196,66 @@ static const uint8_t cStartMessage[] PROGMEM =
 static const uint8_t cPauseMessage[] PROGMEM =
          { 0x08, 0x08, 0x08, 0x08, 0x08, 0x08 }; // "---" "---"
 
-static void StartMessage(uint8_t n_sec) {
+// queue the start message, the headings replace it after
+// START_MESSAGE_TIME, the main loop is not blocked
+static void StartMessage(void) {
 
   I2CDisplayWrite_p( sizeof(cStartMessage), cStartMessage );
   I2CDisplayOn();
 
-  delay_sec( n_sec );
+  gStartMessageTicks = START_MESSAGE_TIME;
+  gStartMessageShown = TRUE;
+}
 
-  I2CDisplayWrite_p( sizeof(cPauseMessage), cPauseMessage );
+// called by main() while the start message is shown, the heading (from
+// EEPROM until the sensor sends) and "---" replace it; without any heading
+// "---" "---" until the first frame
+static void StartMessageExec(void) {
 
-  delay_sec( 1 );
+  if ( gStartMessageTicks && !gKeyState && !IsRotatorBusy() ) return;
 
-  I2CDisplayBlank();
+  if ( !IsHeadingValid() ) {
+    if ( !gStartMessagePause
+         && !I2CDisplayWrite_p( sizeof(cPauseMessage), cPauseMessage ) )
+      gStartMessagePause = TRUE;
+    return;
+  }
+
+  int heading = GetCurrentHeading();
+
+  // queue full: try again with the next call
+  if ( I2CDisplayWriteDataTimed( heading, heading, 0 ) ) return;
+
+  gStartMessageTicks = 0;
+  gStartMessageShown = FALSE;
 }
 
 // --------------------------------------------------------------------------
 
 int main(void) {
 
+  // configuration record from EEPROM, before anything uses it
+  ConfigInit();
+
+  // relay delays from the configuration, before the timer starts
+  RotatorInit();
+
   // initialize the hardware ...
   InitHardware();
 
   // reset the message decoding engine
   CompassMessageInit();
 
+#ifdef GS232_SERVER
+  // reset the GS-232 command parser
+  GS232Init();
+#endif // GS232_SERVER
+
   // initialize the compass calculator
   CompassInit();
 
-  // display the start message, and leave it for # seconds on
-  StartMessage(2);
+  // display the start message, the sensor is read meanwhile
+  StartMessage();
 
   unsigned int uart_data;
 
@@ -229,13 +268,48 @@ int main(void) {
      CompassMessageReceive( uart_data );
    }
 
-   // --- handle serial messages from RS232 interface
+   // --- handle serial messages from RS232 interface (GS-232 commands,
+   //     the ATmega32 has only one USART shared with the sensor)
+
+#ifdef GS232_SERVER
+   if ( uart_data != UART_NO_DATA ) GS232Receive( uart_data );
+#endif // GS232_SERVER
+
+#ifdef GS232_SERVER
+   // --- follow the queued track ('K', 'Q'), any button ends it
+
+    if ( gKeyState & (BUTTON_PRESET_CCW | BUTTON_CCW | BUTTON_STOP
+                      | BUTTON_CW | BUTTON_PRESET_CW) ) TrackClear();
+
+    TrackExec();
+#endif // GS232_SERVER
+
+   // --- turn to the preset heading (PRESET buttons, GS-232 'M' command)
+
+    PresetGoto();
+
+#ifdef GS232_SERVER
+   // --- unsolicited heading frames ('Tnn')
+
+    GS232Telemetry();
+#endif // GS232_SERVER
+
+   // --- update of heading display, after the start message
 
-     // ...
+    if ( gStartMessageShown )
+      StartMessageExec();
+    else
+      UpdateDisplay();
 
-   // --- update of heading display
+   // --- calibration run of the MAG sensor (long press of STOP)
 
-    UpdateDisplay();
+    if ( GetKeyLong( BUTTON_STOP ) ) CalibrateStart();
+
+    CalibrateExec();
+
+   // --- changed configuration into EEPROM, one byte at a time
+
+    ConfigExec();
 
    // --- 5 button user interface to rotator control
 
@@ -305,18 +379,5 @@ int main(void) {
   return 0;
 }
 
-// --------------------------------------------------------------------------
-
-/** Active delay for a given number of seconds (up to 255). */
-static void delay_sec(uint8_t n_sec) {
-
-  while ( n_sec ) {
-    // inline in util/delay.h
-    for ( int m=0; m<100; m++ )
-      _delay_ms( 10.0 );
-    n_sec--;
-  }
-}
-
 // --------------------------------------------------------------------------
 // --------------------------------------------------------------------------
@@ -30,6 +30,7 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 /** @file rotorstate.c
   * State machine for the rotator control program.
@@ -39,15 +40,13 @@
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include <avr/pgmspace.h>
-#include <util/delay.h>
-
-#include <i2cmaster.h>   // P.Fleury's lib
 
 #include "global.h"
 
 #include <uart.h>
 
 #include "i2cdisplay.h"
+#include "i2cqueue.h"
 #include "num2uart.h"
 
 volatile uint8_t gRotatorBusy = 0;
@@ -57,7 +56,11 @@ volatile uint8_t gRotatorBusyCounter = 0;
 
 #define SetBusy(_busy_) { gRotatorBusy = _busy_; }
 
+static uint8_t gRelayDelay[kNRelayDelays];    // copy of gConfig.fRelayDelay[]
+static uint16_t gHoldCounter = 0;             // [10 ms] until PowerOff()
+
 volatile static int16_t gCurrentHeading = 0;
+static uint8_t gHeadingValid = FALSE;    // from the sensor or from EEPROM
 volatile static int16_t gPresetHeading = 0;
 
 #define PRESET_COUNTER_MAX           32
@@ -67,8 +70,43 @@ volatile uint8_t gPresetCommand = kPresetNone;
 static uint8_t gPresetCounterStart = PRESET_COUNTER_MAX;
 volatile uint8_t gPresetCounter = 0;
 
+/** Some degrees of noise beyond the stops are accepted by
+  * RotorAngleUpdate(), more means the angle is lost.
+  */
+#define ROTOR_ANGLE_SLACK           30
+
+/** Hysteresis [deg] around the middle of the range for fRotorUpper. */
+#define ROTOR_UPPER_HYSTERESIS      10
+
+/** Angle [deg] of the rotor from the counter clockwise stop at gLimit,
+  * 0 ... gRange. It is unwrapped from the compass headings by adding up
+  * their changes, thus it exceeds 360 deg in the overlap of rotators with
+  * a range of e.g. 450 deg, where the heading alone is ambiguous.
+  */
+static int16_t  gRotorAngle = 0;
+static uint8_t  gRotorAngleValid = FALSE;
+static int16_t  gRotorHeading;           // heading of the last update
+
+static uint16_t gLimit = LIMIT_ANGLE;    // heading of the CCW stop
+static uint16_t gRange = MAX_ANGLE;      // range [deg] from the CCW stop
+static uint8_t  gRotorUpper = FALSE;     // in the upper half of the range
+
+/** Frames of the sensor (2 s) with the same heading after a stop until it
+  * is written into the configuration (fHeading).
+  */
+#define HEADING_STORE_FRAMES        20
+
+static int16_t  gHeadingLast = -1;       // heading of the last frame
+static uint8_t  gHeadingStill = 0;       // frames with this heading
+static uint8_t  gHeadingStore = TRUE;    // turned since the last write
+
 /* local prototypes */
-static uint8_t GetDirection(uint16_t cur_heading,uint16_t nom_heading);
+static int16_t GetTargetAngle(uint16_t nom_heading);
+static uint8_t GetDirection(int16_t target);
+static void GotoInit(void);
+static void RotorAngleInit(void);
+static void RotorAngleUpdate(int16_t heading);
+static void HeadingStore(int16_t heading);
 
 // --------------------------------------------------------------------------
 
@@ -115,10 +153,55 @@ static uint8_t GetDirection(uint16_t cur_heading,uint16_t nom_heading);
  *
  * It will be handled in a similar way for the command kRotateCCW.
  *
+ * The delays between the steps are taken from gConfig.fRelayDelay[]. With a
+ * hold time (kDelayHoldPower) the power is not switched off after
+ * LockBrake(), the state kHoldPower is kept for this time and a new turn
+ * starts at once with ReleaseBrake(). Tracking software with step moves
+ * every few seconds thus saves the PowerOn() delay.
+ *
  * As the trasitions will take some time, it is not unlikely, that the kStop
  * event is issued before the state kTurningCW is reached. In that case the
  * rotor relays etc. must be switched off in a proper order.
  */
+void RotatorInit(void) {
+
+  memcpy( gRelayDelay, gConfig.fRelayDelay, kNRelayDelays );
+
+  GotoInit();
+  RotorAngleInit();
+
+  // the heading at the last stop until the sensor sends, at once for the
+  // display and GS-232 'C' after a reset; none stored (never stopped since
+  // the update of the record): no heading until the first frame
+  if ( gConfig.fHeading < 360 ) {
+    gCurrentHeading = gPresetHeading = gConfig.fHeading;
+    gHeadingValid = TRUE;
+  }
+}
+
+// --------------------------------------------------------------------------
+
+uint8_t GetRelayDelay(uint8_t index) {
+
+  return index < kNRelayDelays ? gRelayDelay[index] : 0;
+}
+
+// --------------------------------------------------------------------------
+
+void SetRelayDelay(uint8_t index,uint8_t value) {
+
+  if ( index >= kNRelayDelays ) return;
+
+  gRelayDelay[index] = value;
+
+  if ( gConfig.fRelayDelay[index] == value ) return;
+
+  gConfig.fRelayDelay[index] = value;
+  ConfigSave();
+}
+
+// --------------------------------------------------------------------------
+
 void RotatorExec(void) {
 
   switch ( gRotatorCommand ) {
@@ -133,23 +216,25 @@ void RotatorExec(void) {
 	   case kTurningCW:
 	   case kTurningCCW:
 	        RotatorOff();
-		gRotatorBusyCounter = 5;
+		gRotatorBusyCounter = gRelayDelay[kDelayRotatorOff];
 		gRotatorState = kLockBrake;
 	        break;
 
 	   case kRotorRampup: // ???
 	   case kLockBrake:
 	        BrakeLock();
-		gRotatorBusyCounter = 5;
-		gRotatorState = kRotorRampdown;
+		gRotatorBusyCounter = gRelayDelay[kDelayBrakeLock];
+		gHoldCounter = 10 * gRelayDelay[kDelayHoldPower];
+		gRotatorState = gHoldCounter ? kHoldPower : kRotorRampdown;
 	        break;
 
 	   case kRotorRampdown:
 		PowerOff();
 	        gRotatorState = kIdle;
-		gRotatorBusyCounter = 10;
+		gRotatorBusyCounter = gRelayDelay[kDelayPowerOff];
 	        break;
 
+	   case kHoldPower:    // PowerOff() when the hold time is over
 	   case kIdle:
 		gRotatorCommand = kNone;
 		SetBusy(0);
@@ -167,19 +252,20 @@ void RotatorExec(void) {
 	   case kIdle:
 	        PowerOn();
 		gRotatorState = kReleaseBrake;
-		gRotatorBusyCounter = 10;
+		gRotatorBusyCounter = gRelayDelay[kDelayPowerOn];
 		break;
 
+	   case kHoldPower:    // power is still on
 	   case kReleaseBrake:
 	        BrakeRelease();
 		gRotatorState = kRotorRampup;
-		gRotatorBusyCounter = 5;
+		gRotatorBusyCounter = gRelayDelay[kDelayBrakeRelease];
 		break;
 
 	   case kRotorRampup:
 		gRotatorState = kTurningCW;
          	RotatorCW();
-		gRotatorBusyCounter = 5;
+		gRotatorBusyCounter = gRelayDelay[kDelayRotatorOn];
 		break;
 
 	   case kTurningCW:
@@ -199,19 +285,20 @@ void RotatorExec(void) {
 	   case kIdle:
 	        PowerOn();
 		gRotatorState = kReleaseBrake;
-		gRotatorBusyCounter = 10;
+		gRotatorBusyCounter = gRelayDelay[kDelayPowerOn];
 		break;
 
+	   case kHoldPower:    // power is still on
 	   case kReleaseBrake:
 	        BrakeRelease();
 		gRotatorState = kRotorRampup;
-		gRotatorBusyCounter = 5;
+		gRotatorBusyCounter = gRelayDelay[kDelayBrakeRelease];
 		break;
 
 	   case kRotorRampup:
 		gRotatorState = kTurningCCW;
          	RotatorCCW();
-		gRotatorBusyCounter = 5;
+		gRotatorBusyCounter = gRelayDelay[kDelayRotatorOn];
 		break;
 
 	   case kTurningCCW:
@@ -243,6 +330,12 @@ void RotatorExec(void) {
          break;
 
     default:
+         // end of the hold time, called every 10 ms while not busy
+         if ( gRotatorState == kHoldPower && (!gHoldCounter || !--gHoldCounter) ) {
+           PowerOff();
+           gRotatorState = kIdle;
+           gRotatorBusyCounter = gRelayDelay[kDelayPowerOff];
+         }
          break;
   }
 }
@@ -266,71 +359,89 @@ uint8_t GetLastCommand(void) {
 
 // --------------------------------------------------------------------------
 
-volatile uint16_t gPresetDisplayCounter = 0;
+/** Time [ms] the preset heading is shown if equal to the current heading,
+  * the display replaces it by "---" itself.
+  */
+#define PRESET_DISPLAY_TIME     5000
 
 static uint16_t gCurrentHeadingOld = 999;
 static uint16_t gPresetHeadingOld = 999;
 
-// called by main()
-void UpdateDisplay(void) {
+/** Right group of digits shows the preset heading without timeout, it is
+  * replaced by "---" when the current heading reaches it. SetCurrentHeading()
+  * changes the preset without updating the display.
+  */
+static uint8_t gPresetShown = FALSE;
 
-  static uint8_t ret = 0;
+/** I2CQueueErrors() when the display was last known to be up to date. */
+static uint16_t gDisplayErrors = 0;
 
-  if ( gCurrentHeadingOld != gCurrentHeading ) {
+// called by main(), the display transactions are only queued, at most one
+// per change of the headings or lost transaction
+void UpdateDisplay(void) {
 
-    gCurrentHeadingOld = gCurrentHeading;
+  uint8_t ret;
 
-    if ( ret ) {
-      i2c_init();
+  // a transaction got lost, e.g. the display was reset: all of it again,
+  // not only with the next change of a heading
+  uint16_t errors = I2CQueueErrors();
 
-      _delay_ms(10.0);
-    }
+  if ( errors != gDisplayErrors ) {
+
+    // "---" at once for a preset which is not shown
+    ret = I2CDisplayWriteDataTimed( gCurrentHeading,
+                                    gPresetShown ? gPresetHeading : gCurrentHeading,
+                                    gPresetShown ? I2C_DISP_NO_TIMEOUT : 0 );
 
-    ret = I2CDisplayWriteLData( gCurrentHeading );
+    if ( ret ) return;
 
-    _delay_ms(1.0);
+    gDisplayErrors = errors;
+    return;
   }
 
   if ( gPresetHeadingOld != gPresetHeading ) {
 
-    gPresetHeadingOld = gPresetHeading;
-
-    if ( ret ) {
-      i2c_init();
+    // 'PRESET' display should vanish after 5 sec if both are equal
+    uint8_t equal = gCurrentHeading == gPresetHeading;
 
-      _delay_ms(10.0);
-    }
+    ret = I2CDisplayWriteDataTimed( gCurrentHeading, gPresetHeading,
+                           equal ? PRESET_DISPLAY_TIME : I2C_DISP_NO_TIMEOUT );
 
-    ret = I2CDisplayWriteRData( gPresetHeading );
+    // queue full: try again with the next call
+    if ( ret ) return;
 
-    _delay_ms(1.0);
+    gPresetShown = !equal;
+    gPresetHeadingOld = gPresetHeading;
+    gCurrentHeadingOld = gCurrentHeading;
+  }
+  else if ( gCurrentHeadingOld != gCurrentHeading ) {
 
-    // 'PRESET' display should vanish after 5 sec if both are equal
-    if ( gCurrentHeading == gPresetHeading ) {
+    uint8_t reached = gPresetShown && gCurrentHeading == gPresetHeading;
 
-      // atomic set uint16_t type variable
-      cli();
-       gPresetDisplayCounter = 500;
-      sei();
-    }
-  }
+    // preset heading reached: "---" at once
+    ret = reached ? I2CDisplayWriteDataTimed( gCurrentHeading, gPresetHeading, 0 )
+                  : I2CDisplayWriteLData( gCurrentHeading );
 
-  // 'PRESET' display should vanish after 5 sec if both are equal
-  if ( gCurrentHeading == gPresetHeading ) {
+    if ( ret ) return;
 
-    if ( gPresetDisplayCounter == 0 )
-      //I2CDisplayWriteR( 3, (uint8_t*)"\000\000\000" );  // blank display
-      I2CDisplayWriteR( 3, (uint8_t*)"\010\010\010" );    // "---"
+    if ( reached ) gPresetShown = FALSE;
+    gCurrentHeadingOld = gCurrentHeading;
   }
 }
 
 // --------------------------------------------------------------------------
 
+/** Timer [10 ms] of PresetGoto(), since the last change of the heading. */
+static volatile uint16_t gGotoTicks = 0;
+
 // is called for every 10ms
 void PresetExec(void) {
 
-  // nothing to do here...
-  if ( gPresetCommand == kPresetNone ) return;
+  if ( gGotoTicks < 0xffff ) gGotoTicks++;
+
+  // nothing to do here, PresetGoto() turns to the preset heading
+  if (    gPresetCommand == kPresetNone || gPresetCommand == kPresetGoto
+       || gPresetCommand == kPresetExec ) return;
 
   static uint16_t preset_duration = 0;
 
@@ -375,58 +486,345 @@ void PresetExec(void) {
   }
 
   gPresetCounter = gPresetCounterStart;
+}
+
+// --------------------------------------------------------------------------
+
+void SetPresetCommand(uint8_t cmd) {
+
+  gPresetCommand = cmd;
+}
 
-#if 0
-  PresetExecSlow();
-#endif
+// --------------------------------------------------------------------------
+
+int GetCurrentHeading(void) {
+
+  return gCurrentHeading;
 }
 
 // --------------------------------------------------------------------------
 
-void PresetExecSlow(void) {
+uint8_t IsHeadingValid(void) {
+
+  return gHeadingValid;
+}
 
-  if ( gPresetCommand == kNone ) return;
+// --------------------------------------------------------------------------
 
-  if (    gPresetCommand != kPresetCW && gPresetCommand != kPresetCCW
-       && gPresetCommand != kPresetExec ) return;
+/** Deadband [deg]: no turn is started for a smaller difference to the
+  * preset heading, the current heading has a resolution of 5 degrees.
+  */
+#define GOTO_DEADBAND                3
 
-  if ( abs(gCurrentHeading - gPresetHeading) < 5 ) return; // do nothing
+/** Deadband [deg] after the first turn: a correction is only started if
+  * the heading is off by more than one step of its resolution.
+  */
+#define GOTO_DEADBAND_CORRECTION     6
 
-  uint8_t cmd;
+/** The stop is sent when the rest of the turn would take less than this
+  * number of compass samples at the speed so far (heading filter, relay
+  * sequence, run-out of the rotator), as long as the run-out has not been
+  * learned.
+  */
+#define GOTO_LEAD_SAMPLES            4
 
-//  if ( abs(gCurrentHeading - gPresetHeading) < 5 )
-//    cmd = kNone;
-//  else
-    cmd = GetDirection( gCurrentHeading, gPresetHeading );
+/** Only stops after this number of samples at full speed are used to
+  * learn the run-out.
+  */
+#define GOTO_COAST_SAMPLES          10
 
-  switch ( cmd ) {
+/** Largest run-out [deg] which is learned, more is a disturbance. */
+#define GOTO_COAST_MAX              45
 
-    case kTurnCW:
-  	 LED_PORT |= LED_RIGHT;
-  	 SetCommand( kTurnCW );
-  	 break;
+/** Marks a direction without a learned run-out. */
+#define GOTO_COAST_UNKNOWN      0xffff
 
-    case kTurnCCW:
-  	 LED_PORT |= LED_LEFT;
-  	 SetCommand( kTurnCCW );
-  	 break;
+/** Turns to one preset heading, corrections included, no hunting. */
+#define GOTO_MAX_TURNS               3
 
-    case kStop:
-    case kNone:
-    default:
-  	 SetCommand( kStop );
-         gPresetCommand = kPresetNone;
+/** A turn without a change of the heading for this time [10 ms] is
+  * stopped (rotator stalled, sensor data lost).
+  */
+#define GOTO_TIMEOUT               500
+
+/** Direction in which PresetGoto() turns the rotator, kNone if stopped. */
+static uint8_t gGotoDirection = kNone;
+
+static uint8_t gGotoTurns = 0;        // turns to the current preset
+static uint8_t gGotoSettle = 0;       // samples to wait after a stop
+static uint8_t gGotoSettleSamples = GOTO_SETTLE_SAMPLES;
+static int16_t gGotoStart;            // rotor angle at the start of the turn
+static int16_t gGotoLast;             // heading at the last progress
+static uint8_t gGotoSamples;          // samples of the turn at full speed
+
+/** Run-out [1/16 deg] clockwise and counter clockwise, from the headings
+  * at the stop and after the settle time: the rotator turns on during the
+  * relay sequence, depending on wind and load, and the heading filter
+  * lags behind. Whole degrees are kept in gConfig.fGotoCoast[].
+  */
+static uint16_t gGotoCoast[2] = { GOTO_COAST_UNKNOWN, GOTO_COAST_UNKNOWN };
+
+static uint8_t gCoastDirection = kNone;  // stop to be measured, if any
+static int16_t gCoastFrom;               // rotor angle at this stop
+
+#define CoastIndex(_cmd_) ((_cmd_) == kTurnCW ? 0 : 1)
+
+/** A new heading from the sensor, set by SetCurrentHeading(). */
+static uint8_t gHeadingSample = FALSE;
+
+#define IsGotoActive() \
+  (gPresetCommand == kPresetGoto || gPresetCommand == kPresetExec)
+
+void SetPresetHeading(int heading) {
+
+  gPresetCommand = kPresetGoto;        // PresetExec() leaves it alone
+  gPresetHeading = heading;
+  gGotoTurns = 0;
+}
+
+// --------------------------------------------------------------------------
+
+// angle [deg] from rotor angle 'from' to 'to' in the direction 'cmd', 0 if
+// the other way
+static uint16_t GotoDistance(int16_t from,int16_t to,uint8_t cmd) {
+
+  int16_t diff = cmd == kTurnCW ? to - from : from - to;
+
+  return diff < 0 ? 0 : diff;
+}
+
+// --------------------------------------------------------------------------
+
+static void GotoStop(void) {
 
-  	 // both PRESET LEDs off
-  	 LED_PORT &= ~(LED_LEFT | LED_RIGHT);
+  gCoastDirection = kNone;
+
+  SetCommand( kStop );
+  gGotoDirection = kNone;
+  gGotoSettle = gGotoSettleSamples;
+  gGotoLast = gCurrentHeading;
+
+  cli();
+   gGotoTicks = 0;
+  sei();
+
+  LED_PORT &= ~(LED_LEFT | LED_RIGHT);
+}
+
+// --------------------------------------------------------------------------
+
+// learn the run-out from the heading after a stop ahead of the target
+static void GotoLearnCoast(void) {
+
+  uint8_t index = CoastIndex( gCoastDirection );
+  uint16_t coast = GotoDistance( gCoastFrom, gRotorAngle, gCoastDirection );
+
+  gCoastDirection = kNone;
+
+  if ( coast > GOTO_COAST_MAX ) return;
+
+  coast *= 16;
+
+  // running average, the single values have the heading resolution
+  if ( gGotoCoast[index] == GOTO_COAST_UNKNOWN )
+    gGotoCoast[index] = coast;
+  else
+    gGotoCoast[index] = ((int16_t)gGotoCoast[index] * 7 + coast + 4) / 8;
+
+  // written only if the whole degrees change
+  coast = (gGotoCoast[index] + 8) / 16;
+
+  if ( gConfig.fGotoCoast[index] == coast ) return;
+
+  gConfig.fGotoCoast[index] = coast;
+  ConfigSave();
+}
+
+// --------------------------------------------------------------------------
+
+// stop of a turn by PresetGoto(), the run-out is measured if the rotator
+// turned at full speed long enough
+static void GotoStopAhead(void) {
+
+  uint8_t direction = gGotoDirection;
+  uint8_t samples = gGotoSamples;
+  uint16_t moved = GotoDistance( gGotoStart, gRotorAngle, direction );
+
+  // samples for 10 deg at the speed of the turn
+  if ( samples >= GOTO_COAST_SAMPLES && moved ) {
+    uint16_t settle = 10 * samples / moved;
+    gGotoSettleSamples = settle < GOTO_SETTLE_SAMPLES ? GOTO_SETTLE_SAMPLES
+                         : settle > 100 ? 100 : settle;
+  }
+
+  GotoStop();
+
+  if ( samples >= GOTO_COAST_SAMPLES ) {
+    gCoastDirection = direction;
+    gCoastFrom = gRotorAngle;
   }
 }
 
 // --------------------------------------------------------------------------
 
-void SetPresetCommand(uint8_t cmd) {
+static void GotoInit(void) {
 
-  gPresetCommand = cmd;
+  for ( uint8_t i=0; i<2; ++i ) {
+
+    uint8_t coast = gConfig.fGotoCoast[i];
+
+    gGotoCoast[i] = coast > GOTO_COAST_MAX ? GOTO_COAST_UNKNOWN : 16 * coast;
+  }
+}
+
+// --------------------------------------------------------------------------
+
+static void GotoEnd(void) {
+
+  gPresetCommand = kPresetNone;
+  gGotoTurns = 0;
+}
+
+// --------------------------------------------------------------------------
+
+// called by main(), decides once per compass sample
+void PresetGoto(void) {
+
+  if ( !IsGotoActive() ) {
+
+    // cancelled by a button, e.g. STOP or a new preset
+    if ( gGotoDirection != kNone ) GotoStop();
+
+    gGotoTurns = 0;
+    return;
+  }
+
+  cli();
+   uint16_t ticks = gGotoTicks;
+  sei();
+
+  if ( gGotoDirection != kNone ) {
+
+    if ( ticks > GOTO_TIMEOUT ) {
+      GotoStop();
+      GotoEnd();
+      return;
+    }
+  }
+
+  if ( !gHeadingSample || !gRotorAngleValid ) return;
+
+  gHeadingSample = FALSE;
+
+  // the preset heading on the shortest legal path
+  int16_t target = GetTargetAngle( gPresetHeading );
+  int16_t diff = abs( target - gRotorAngle );
+
+  uint8_t cmd = diff < GOTO_DEADBAND ? kNone : GetDirection( target );
+
+  if ( gGotoDirection != kNone ) {
+
+    // reached or passed the preset heading
+    if ( cmd != gGotoDirection ) {
+      GotoStopAhead();
+      return;
+    }
+
+    if ( gCurrentHeading != gGotoLast ) {
+      gGotoLast = gCurrentHeading;
+      cli();
+       gGotoTicks = 0;
+      sei();
+    }
+
+    if ( gRotatorState != kTurningCW && gRotatorState != kTurningCCW ) return;
+
+    if ( gGotoSamples < 0xff ) gGotoSamples++;
+
+    // stop ahead of the preset heading by the learned run-out, else
+    // rest / speed < GOTO_LEAD_SAMPLES
+    uint16_t coast = gGotoCoast[CoastIndex( cmd )];
+    uint16_t rest = GotoDistance( gRotorAngle, target, cmd );
+
+    if ( coast != GOTO_COAST_UNKNOWN ) {
+      if ( 16 * rest <= coast ) GotoStopAhead();
+    }
+    else {
+      uint16_t moved = GotoDistance( gGotoStart, gRotorAngle, cmd );
+
+      if ( (uint32_t)rest * gGotoSamples <= (uint32_t)moved * GOTO_LEAD_SAMPLES )
+        GotoStopAhead();
+    }
+
+    return;
+  }
+
+  // wait until the rotator has stopped and the heading has settled
+  if ( IsRotatorBusy() || gRotatorCommand != kNone ) return;
+
+  // the rotator may still turn on after the stop
+  if ( gCurrentHeading != gGotoLast ) {
+    gGotoLast = gCurrentHeading;
+    gGotoSettle = gGotoSettleSamples;
+  }
+
+  if ( gGotoSettle && ticks <= GOTO_TIMEOUT ) {
+    gGotoSettle--;
+    return;
+  }
+
+  if ( gCoastDirection != kNone ) GotoLearnCoast();
+
+  if (    cmd == kNone || gGotoTurns >= GOTO_MAX_TURNS
+       || (gGotoTurns && diff < GOTO_DEADBAND_CORRECTION) ) {
+    GotoEnd();
+    return;
+  }
+
+  LED_PORT |= cmd == kTurnCW ? LED_RIGHT : LED_LEFT;
+
+  SetCommand( cmd );
+
+  gGotoDirection = cmd;
+  gGotoTurns++;
+  gGotoStart = gRotorAngle;
+  gGotoLast = gCurrentHeading;
+  gGotoSamples = 0;
+  gGotoSettleSamples = GOTO_SETTLE_SAMPLES;
+
+  cli();
+   gGotoTicks = 0;
+  sei();
+}
+
+// --------------------------------------------------------------------------
+
+void SetRemoteCommand(uint8_t cmd) {
+
+  if ( IsGotoActive() ) {
+    GotoEnd();
+    gGotoDirection = kNone;
+    LED_PORT &= ~(LED_LEFT | LED_RIGHT);
+  }
+
+  // not yet executed, a second SetCommand() would look like a released
+  // button to main()
+  if ( gRotatorCommand == cmd ) return;
+
+  if ( cmd == kStop ) {
+    SetCommand( kStop );
+    return;
+  }
+
+  if ( !IsRotatorBusy() ) {
+    SetCommand( cmd );
+    return;
+  }
+
+  // turning into the other direction: stop, the tracking software repeats
+  if (    (cmd == kTurnCW && gRotatorState == kTurningCCW)
+       || (cmd == kTurnCCW && gRotatorState == kTurningCW) )
+    SetCommand( kStop );
 }
 
 // --------------------------------------------------------------------------
@@ -434,6 +832,11 @@ void SetPresetCommand(uint8_t cmd) {
 void SetCurrentHeading(int heading) {
 
   gCurrentHeading = heading;
+  gHeadingValid = TRUE;
+  gHeadingSample = TRUE;
+
+  RotorAngleUpdate( heading );
+  HeadingStore( heading );
 
   if ( gPresetCommand == kPresetNone ) {
     gPresetHeading = heading;
@@ -443,43 +846,146 @@ void SetCurrentHeading(int heading) {
 
 // --------------------------------------------------------------------------
 
-/** This function calculates the direction into which the rotator has to be
-  * turned from the 'actual direction' to reach the 'nominal direction'.
+static void RotorAngleInit(void) {
+
+  gLimit = gConfig.fLimitAngle;
+  gRange = gConfig.fRotorRange;
+
+  // erased or invalid EEPROM
+  if ( gLimit > MAX_ANGLE ) gLimit = LIMIT_ANGLE;
+  if ( gRange < 180 || gRange > ROTOR_RANGE_MAX ) gRange = MAX_ANGLE;
+
+  gRotorUpper = gConfig.fRotorUpper == 1;
+  gRotorAngleValid = FALSE;
+}
+
+// --------------------------------------------------------------------------
+
+// called with each new heading by SetCurrentHeading()
+static void RotorAngleUpdate(int16_t heading) {
+
+  if ( gRotorAngleValid ) {
+
+    int16_t delta = heading - gRotorHeading;
+
+    if ( delta > 180 ) delta -= 360;
+    else if ( delta < -180 ) delta += 360;
+
+    gRotorAngle += delta;
+
+    if ( gRotorAngle < -ROTOR_ANGLE_SLACK
+         || gRotorAngle > (int16_t)gRange + ROTOR_ANGLE_SLACK )
+      gRotorAngleValid = FALSE;
+  }
+
+  // first heading or lost: the lowest angle of this heading, in the
+  // overlap the one of the half of the range stored at the last move
+  if ( !gRotorAngleValid ) {
+
+    gRotorAngle = heading - gLimit;
+    if ( gRotorAngle < 0 ) gRotorAngle += 360;
+
+    while ( gRotorUpper && gRotorAngle + 360 <= (int16_t)gRange
+            && gRotorAngle < (int16_t)gRange / 2 )
+      gRotorAngle += 360;
+
+    gRotorAngleValid = TRUE;
+  }
+
+  gRotorHeading = heading;
+
+  // only rotators with an overlap need to know the half after a reset
+  if ( gRange <= MAX_ANGLE ) return;
+
+  if ( gRotorAngle > (int16_t)gRange / 2 + ROTOR_UPPER_HYSTERESIS )
+    gRotorUpper = TRUE;
+  else if ( gRotorAngle < (int16_t)gRange / 2 - ROTOR_UPPER_HYSTERESIS )
+    gRotorUpper = FALSE;
+  else
+    return;
+
+  if ( gConfig.fRotorUpper == gRotorUpper ) return;
+
+  gConfig.fRotorUpper = gRotorUpper;
+  ConfigSave();
+}
+
+// --------------------------------------------------------------------------
+
+// called with each new heading by SetCurrentHeading(), the heading at rest
+// is written once per stop, not for each change of a noisy one
+static void HeadingStore(int16_t heading) {
+
+  uint8_t busy = IsRotatorBusy();
+
+  if ( busy ) gHeadingStore = TRUE;
+
+  if ( busy || heading != gHeadingLast ) {
+    gHeadingLast = heading;
+    gHeadingStill = 0;
+    return;
+  }
+
+  if ( !gHeadingStore || ++gHeadingStill < HEADING_STORE_FRAMES ) return;
+
+  gHeadingStore = FALSE;
+
+  if ( gConfig.fHeading == heading ) return;
+
+  gConfig.fHeading = heading;
+  ConfigSave();
+}
+
+// --------------------------------------------------------------------------
+
+int GetRotorAngle(void) {
+
+  return gRotorAngle;
+}
+
+// --------------------------------------------------------------------------
+
+/** This function calculates the rotor angle at which the rotator points to
+  * the 'nominal direction', on the shortest path from its current angle.
   *
   * It takes the position of the mechanical limitation into account
-  * (LIMIT_ANGLE).
-  *
-  * This is how it works:
-  * In a configuration where the limit is at 0 degrees (north), we have to
-  * @li rotate CCW if nominal direction < actual direction
-  * @li rotate CW if nominal direction > actual direction
-  * @li do nothing else.
-  * Thus, if we first rotate our system back into this simple configuration, we
-  * easily can decide what to do. The rotation angle is 360 degrees (MAX_ANGLE)
-  * minus the angular position of the bracket, it must always be a positive
-  * value.
+  * (gLimit) and the range of the rotator (gRange). With a range
+  * of 360 degrees there is just one such angle. Rotators with an overlap
+  * (e.g. 450 degrees) can reach the headings near the stop at two angles,
+  * the nearer one is taken, thus a turn is never longer than necessary.
+  * A range below 360 degrees leaves a dead zone behind the clockwise stop,
+  * a heading in it is replaced by the nearer end of the range.
   *
-  * Additionally, the angles obtained must be normalized, i.e. must be below
-  * 360 degrees.
-  *
-  * @return either kTurnCW or kTurnCCW or kNone if no action is required.
-  *
-  * Note: This may not work for configurations where the total angular range is
-  * larger than 360 degrees.
+  * @return rotor angle [deg] from the counter clockwise stop, 0 ... gRange.
   */
-static uint8_t GetDirection(uint16_t cur_heading,uint16_t nom_heading) {
+static int16_t GetTargetAngle(uint16_t nom_heading) {
+
+  int16_t target = nom_heading - gLimit;
+  if ( target < 0 ) target += 360;
 
-  uint16_t rotation_angle = MAX_ANGLE - LIMIT_ANGLE;
+  if ( target > (int16_t)gRange )
+    return target - (int16_t)gRange <= 360 - target ? (int16_t)gRange : 0;
 
-  uint16_t cur_heading_rotated = cur_heading + rotation_angle;
-  if ( cur_heading_rotated > MAX_ANGLE ) cur_heading_rotated -= MAX_ANGLE;
+  while ( target + 360 <= (int16_t)gRange
+          && abs( target + 360 - gRotorAngle ) < abs( target - gRotorAngle ) )
+    target += 360;
 
-  uint16_t nom_heading_rotated = nom_heading + rotation_angle;
-  if ( nom_heading_rotated > MAX_ANGLE ) nom_heading_rotated -= MAX_ANGLE;
+  return target;
+}
+
+// --------------------------------------------------------------------------
+
+/** This function calculates the direction into which the rotator has to be
+  * turned from its current angle to the rotor angle 'target' (see
+  * GetTargetAngle()).
+  *
+  * @return either kTurnCW or kTurnCCW or kNone if no action is required.
+  */
+static uint8_t GetDirection(int16_t target) {
 
-  if ( nom_heading_rotated < cur_heading_rotated )
+  if ( target < gRotorAngle )
     return kTurnCCW;
-  else if ( nom_heading_rotated > cur_heading_rotated )
+  else if ( target > gRotorAngle )
     return kTurnCW;
   else
     return kNone;
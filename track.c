@@ -0,0 +1,227 @@
+/*
+ * File   : track.c
+ *
+ * Copyright:      Hermann-Josef Mathes  mailto: dc2ip@darc.de
+ * Author:         Hermann-Josef Mathes
+ * Remarks:
+ * Known problems: development status
+ * Version:        Version v1r0
+ * Description:    Queue of timestamped azimuths (satellite/moon tracking).
+ *
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+   If not, write to the Free Software Foundation,
+   Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+
+ *
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/** @file track.c
+  * Queue of timestamped azimuths (satellite/moon tracking).
+  *
+  * The host sets the clock to its time base and streams the points of the
+  * track ahead of time (gs232.c, 'K' and 'Q'), thus a late or bursty
+  * serial line does not delay the rotator. Once per tick of 10 ms the
+  * azimuth of the track is interpolated between the queued points. The
+  * rotator is only turned when it is more than TRACK_TOLERANCE off, then
+  * to the azimuth where the track will leave the band of the same width
+  * on the other side. The many small steps of the track are so merged
+  * into a few longer turns of PresetGoto(). Before the first point the
+  * rotator is turned to it, after the last one the track ends.
+  *
+  * @author H.-J. Mathes <dc2ip@darc.de>
+  */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "global.h"
+
+#include "track.h"
+
+/* local data types and variables */
+
+/** One point of the track. */
+typedef struct _track_point {
+
+  uint16_t fTime;                        // [s] of the clock
+  uint16_t fAzimuth;                     // [deg]
+
+} track_point_t;
+
+static track_point_t gTrack[TRACK_QUEUE_SIZE];
+
+static uint8_t gTrackHead = 0;           // oldest entry
+static uint8_t gTrackCount = 0;
+
+#define TrackPoint(_i_) gTrack[(gTrackHead + (_i_)) % TRACK_QUEUE_SIZE]
+
+/** CPU clocks per call of TrackTimer(): CLK/1024 from CNT0_PRESET to the
+  * overflow, 118 counts or 10.07 ms at 12 MHz. Counted as 10 ms the clock
+  * was 0.7 % slow, the track came late by 25 s per hour.
+  */
+#define TRACK_TICK_CLOCKS       (1024UL * (0x100 - CNT0_PRESET))
+
+static volatile uint16_t gClock = 0;     // [s]
+static volatile uint32_t gClockFraction = 0; // [CPU clocks] of the current second
+static volatile uint8_t  gTick = FALSE;  // TrackTimer() was called
+
+// --------------------------------------------------------------------------
+
+// difference of two azimuths, -180 ... 179
+static int16_t TrackAngle(int16_t diff) {
+
+  while ( diff >= 180 ) diff -= 360;
+  while ( diff < -180 ) diff += 360;
+
+  return diff;
+}
+
+// --------------------------------------------------------------------------
+
+void TrackSetTime(uint16_t sec) {
+
+  cli();
+   gClock = sec;
+   gClockFraction = 0;
+  sei();
+}
+
+// --------------------------------------------------------------------------
+
+uint16_t TrackGetTime(void) {
+
+  cli();
+   uint16_t sec = gClock;
+  sei();
+
+  return sec;
+}
+
+// --------------------------------------------------------------------------
+
+uint8_t TrackAdd(uint16_t sec,uint16_t azimuth) {
+
+  if ( gTrackCount == TRACK_QUEUE_SIZE ) return 1;
+
+  if ( gTrackCount && (int16_t)(sec - TrackPoint(gTrackCount-1).fTime) <= 0 )
+    return 1;
+
+  TrackPoint(gTrackCount).fTime = sec;
+  TrackPoint(gTrackCount).fAzimuth = azimuth;
+  gTrackCount++;
+
+  return 0;
+}
+
+// --------------------------------------------------------------------------
+
+uint8_t TrackFree(void) {
+
+  return TRACK_QUEUE_SIZE - gTrackCount;
+}
+
+// --------------------------------------------------------------------------
+
+void TrackClear(void) {
+
+  gTrackHead = gTrackCount = 0;
+}
+
+// --------------------------------------------------------------------------
+
+// called from ISR(TIMER0_OVF_vect)
+void TrackTimer(void) {
+
+  gClockFraction += TRACK_TICK_CLOCKS;
+
+  if ( gClockFraction >= F_CPU ) {
+    gClockFraction -= F_CPU;
+    gClock++;
+  }
+
+  gTick = TRUE;
+}
+
+// --------------------------------------------------------------------------
+
+// called by main(), decides once per tick
+void TrackExec(void) {
+
+  if ( !gTick ) return;
+
+  gTick = FALSE;
+
+  if ( !gTrackCount ) return;
+
+  cli();
+   uint16_t sec = gClock;
+   uint32_t fraction = gClockFraction;
+  sei();
+
+  uint8_t ticks = fraction / (F_CPU / 100);  // [10 ms]
+
+  // drop the points which have been passed, the last one is kept
+  while ( gTrackCount > 1 && (int16_t)(sec - TrackPoint(1).fTime) >= 0 ) {
+    gTrackHead = (gTrackHead + 1) % TRACK_QUEUE_SIZE;
+    gTrackCount--;
+  }
+
+  int16_t dt = sec - TrackPoint(0).fTime;   // < 0 before the first point
+  int16_t azimuth = TrackPoint(0).fAzimuth;
+  uint8_t end = dt >= 0 && gTrackCount == 1;
+
+  // azimuth of the track now, between the first two points
+  if ( dt >= 0 && gTrackCount > 1 ) {
+
+    int16_t step = TrackAngle( TrackPoint(1).fAzimuth - azimuth );
+    uint16_t span = TrackPoint(1).fTime - TrackPoint(0).fTime;
+
+    azimuth += (int32_t)step * (100L * dt + ticks) / (100L * span);
+  }
+
+  // a turn (PresetGoto()) or the PRESET buttons are still busy
+  if ( gPresetCommand != kPresetNone ) return;
+
+  if ( abs( TrackAngle( azimuth - GetCurrentHeading() ) ) <= TRACK_TOLERANCE ) {
+    if ( end ) TrackClear();
+    return;
+  }
+
+  // look ahead: the last point in the band around the azimuth now, or
+  // its edge where the track leaves it
+  int16_t target = azimuth;
+
+  for ( uint8_t i=1; i<gTrackCount; ++i ) {
+
+    int16_t dev = TrackAngle( TrackPoint(i).fAzimuth - azimuth );
+
+    if ( abs( dev ) > TRACK_TOLERANCE ) {
+      target = dev > 0 ? azimuth + TRACK_TOLERANCE : azimuth - TRACK_TOLERANCE;
+      break;
+    }
+
+    target = TrackPoint(i).fAzimuth;
+  }
+
+  if ( end ) TrackClear();
+
+  SetPresetHeading( (target + 360) % 360 );
+}
+
+// --------------------------------------------------------------------------
+// --------------------------------------------------------------------------
@@ -0,0 +1,87 @@
+/*
+ * File   : track.h
+ *
+ * Copyright:      Hermann-Josef Mathes  mailto: dc2ip@darc.de
+ * Author:         Hermann-Josef Mathes
+ * Remarks:
+ * Known problems: development status
+ * Version:        Version v1r0
+ * Description:    Declarations for the queue of timestamped azimuths
+ *                 (satellite/moon tracking).
+ *
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+   If not, write to the Free Software Foundation,
+   Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+
+ *
+ */
+
+
+/** @file track.h
+  * Declarations for the queue of timestamped azimuths (satellite/moon
+  * tracking).
+  * @author H.-J.Mathes <dc2ip@darc.de>
+  */
+
+#ifndef _track_h_
+#define _track_h_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Number of points which can be queued. */
+#define TRACK_QUEUE_SIZE        32
+
+/** The rotator is turned when the track is more than this number of
+  * degrees off the heading, it then turns to where the track will leave
+  * the same band on the other side. Should not be below the resolution of
+  * the heading (5 deg).
+  */
+#define TRACK_TOLERANCE         5
+
+/** Set the clock of the track to 'sec' seconds of the time base of the
+  * host (e.g. seconds of the day modulo 65536).
+  */
+extern void TrackSetTime(uint16_t sec);
+
+/** The clock of the track in seconds. */
+extern uint16_t TrackGetTime(void);
+
+/** Append a point, azimuth 'azimuth' (0 ... 359) at 'sec' seconds of the
+  * clock. Returns 0 if queued, 1 if the queue is full or the point is not
+  * later than the last queued one.
+  */
+extern uint8_t TrackAdd(uint16_t sec,uint16_t azimuth);
+
+/** Number of free entries of the queue. */
+extern uint8_t TrackFree(void);
+
+/** Empty the queue, the track ends (e.g. any other command). */
+extern void TrackClear(void);
+
+/** To be called every 10 ms from the timer interrupt (clock). */
+extern void TrackTimer(void);
+
+/** To be called by main(): turns the rotator along the queued points. */
+extern void TrackExec(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _track_h_ */